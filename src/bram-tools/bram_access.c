@@ -0,0 +1,513 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_access.h"
+#include "bram_kernels.h"
+
+void bram_xfer_stats_init(struct bram_xfer_stats *stats)
+{
+	stats->bytes = 0;
+	stats->transactions = 0;
+	return;
+}
+
+static int bram_check_range(struct bram_resource *bram, size_t offset,
+		size_t len)
+{
+	if (!bram || !bram->map) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if ((offset > bram->map_size) || (len > (bram->map_size - offset))) {
+		fprintf(stderr, "Error: Access of %zu bytes at 0x%zx exceeds map size\n",
+				len, offset);
+		return -1;
+	}
+	return 0;
+}
+
+/* Resources set up by hand rather than by bram_create() get the default */
+static const struct bram_kernels *kernels_for(struct bram_resource *bram)
+{
+	if (!bram->kernels) {
+		bram->kernels = bram_kernels_select(bram->map_width ?
+				(unsigned int) bram->map_width : BRAM_AXI_CTRL_WIDTH);
+	}
+	return bram->kernels;
+}
+
+/* Clock reads are only paid for with the instrumentation on */
+static uint64_t perf_start(const struct bram_resource *bram)
+{
+	return bram->perf ? bram_clock_ns() : 0;
+}
+
+static void add_stats(struct bram_resource *bram, struct bram_xfer_stats *stats,
+		size_t bytes, size_t ntrans, uint64_t start)
+{
+	if (stats) {
+		stats->bytes += bytes;
+		stats->transactions += ntrans;
+	}
+	if (bram->perf) {
+		bram_perf_record(bram->perf, BRAM_PHASE_TRANSFER, start, bytes);
+		bram->perf->transactions += ntrans;
+	}
+	return;
+}
+
+/*
+ * Pointer to offset in the current mapping, moving the window of a windowed
+ * map first if offset is outside it. Accesses through it must not go past
+ * the end of the window, see window_span().
+ */
+static volatile uint8_t *window_ptr(struct bram_resource *bram, size_t offset)
+{
+	if (!bram->windowed) {
+		return (volatile uint8_t *) bram->map + offset;
+	}
+	if ((offset < bram->window_offset) ||
+			((offset - bram->window_offset) >= bram->window_size)) {
+		if (bram_move_window(bram, offset)) {
+			return NULL;
+		}
+	}
+	return (volatile uint8_t *) bram->map + (offset - bram->window_offset);
+}
+
+/* Length of the part of an access at offset that lies in a single window */
+static size_t window_span(const struct bram_resource *bram, size_t offset,
+		size_t len)
+{
+	size_t span;
+
+	if (!bram->windowed) {
+		return len;
+	}
+	span = bram->window_size - (offset % bram->window_size);
+	return (span < len) ? span : len;
+}
+
+volatile void *bram_ptr(struct bram_resource *bram, size_t offset, size_t len)
+{
+	if (bram_check_range(bram, offset, len)) {
+		return NULL;
+	}
+	if (window_span(bram, offset, len) != len) {
+		fprintf(stderr, "Error: Access of %zu bytes at 0x%zx crosses a window\n",
+				len, offset);
+		return NULL;
+	}
+	return window_ptr(bram, offset);
+}
+
+int bram_write_range(struct bram_resource *bram, size_t offset,
+		const void *src, size_t len, struct bram_xfer_stats *stats)
+{
+	const struct bram_kernels *kernels;
+	volatile uint8_t *dev;
+	const uint8_t *src8 = src;
+	size_t ntrans = 0;
+	size_t pos = 0;
+	uint64_t start;
+	size_t n;
+
+	if ((!src && len) || bram_check_range(bram, offset, len)) {
+		return -1;
+	}
+	kernels = kernels_for(bram);
+	start = perf_start(bram);
+	while (pos != len) {
+		n = window_span(bram, offset + pos, len - pos);
+		dev = window_ptr(bram, offset + pos);
+		if (!dev) {
+			return -1;
+		}
+		ntrans += kernels->write(dev, src8 + pos, n, bram->narrow_burst);
+		pos += n;
+	}
+	add_stats(bram, stats, len, ntrans, start);
+	return 0;
+}
+
+/*
+ * Differential write of a range that lies within a single window, adding the
+ * number of words written to changed and returning the bus transactions
+ */
+static size_t diff_window(const struct bram_kernels *kernels, int narrow,
+		volatile uint8_t *dev, size_t offset, const uint8_t *src8,
+		size_t len, size_t *changed)
+{
+	size_t word = kernels->width / 8;
+	size_t ntrans = 0;
+	size_t equal;
+	size_t run_start;
+	size_t run_end;
+	size_t word_end;
+	size_t i = 0;
+
+	while (i != len) {
+		ntrans += kernels->compare(dev + i, src8 + i, len - i, narrow, &equal);
+		i += equal;
+		if (i == len) {
+			break;
+		}
+		/*
+		 * Grow the run from the first differing byte a bus word at a time
+		 * until a word that already matches or the end of the range
+		 */
+		run_start = i;
+		run_end = i + word - ((offset + i) % word);
+		if (run_end > len) {
+			run_end = len;
+		}
+		word_end = run_end;
+		while (run_end != len) {
+			word_end = (run_end + word > len) ? len : (run_end + word);
+			ntrans += kernels->compare(dev + run_end, src8 + run_end,
+					word_end - run_end, narrow, &equal);
+			if (equal == (word_end - run_end)) {
+				break;
+			}
+			run_end = word_end;
+		}
+		ntrans += kernels->write(dev + run_start, src8 + run_start,
+				run_end - run_start, narrow);
+		*changed += ((offset + run_end + word - 1) / word) -
+			((offset + run_start) / word);
+		/* The word that ended the run is already known to match */
+		i = (run_end == len) ? len : word_end;
+	}
+	return ntrans;
+}
+
+int bram_write_diff(struct bram_resource *bram, size_t offset,
+		const void *src, size_t len, size_t *changed,
+		struct bram_xfer_stats *stats)
+{
+	const struct bram_kernels *kernels;
+	volatile uint8_t *dev;
+	const uint8_t *src8 = src;
+	size_t num_changed = 0;
+	size_t ntrans = 0;
+	size_t pos = 0;
+	uint64_t start;
+	size_t n;
+
+	if ((!src && len) || bram_check_range(bram, offset, len)) {
+		return -1;
+	}
+	kernels = kernels_for(bram);
+	start = perf_start(bram);
+	while (pos != len) {
+		n = window_span(bram, offset + pos, len - pos);
+		dev = window_ptr(bram, offset + pos);
+		if (!dev) {
+			return -1;
+		}
+		ntrans += diff_window(kernels, bram->narrow_burst, dev, offset + pos,
+				src8 + pos, n, &num_changed);
+		pos += n;
+	}
+
+	add_stats(bram, stats, len, ntrans, start);
+	if (changed) {
+		*changed += num_changed;
+	}
+	return 0;
+}
+
+int bram_read_range(struct bram_resource *bram, size_t offset,
+		void *dst, size_t len, struct bram_xfer_stats *stats)
+{
+	const struct bram_kernels *kernels;
+	volatile uint8_t *dev;
+	uint8_t *dst8 = dst;
+	size_t ntrans = 0;
+	size_t pos = 0;
+	uint64_t start;
+	size_t n;
+
+	if ((!dst && len) || bram_check_range(bram, offset, len)) {
+		return -1;
+	}
+	kernels = kernels_for(bram);
+	start = perf_start(bram);
+	while (pos != len) {
+		n = window_span(bram, offset + pos, len - pos);
+		dev = window_ptr(bram, offset + pos);
+		if (!dev) {
+			return -1;
+		}
+		ntrans += kernels->read(dst8 + pos, dev, n, bram->narrow_burst);
+		pos += n;
+	}
+	add_stats(bram, stats, len, ntrans, start);
+	return 0;
+}
+
+int bram_fill_range(struct bram_resource *bram, size_t offset,
+		size_t len, uint8_t value, struct bram_xfer_stats *stats)
+{
+	const struct bram_kernels *kernels;
+	volatile uint8_t *dev;
+	size_t ntrans = 0;
+	size_t pos = 0;
+	uint64_t start;
+	size_t n;
+
+	if (bram_check_range(bram, offset, len)) {
+		return -1;
+	}
+	kernels = kernels_for(bram);
+	start = perf_start(bram);
+	while (pos != len) {
+		n = window_span(bram, offset + pos, len - pos);
+		dev = window_ptr(bram, offset + pos);
+		if (!dev) {
+			return -1;
+		}
+		ntrans += kernels->fill(dev, value, n, bram->narrow_burst);
+		pos += n;
+	}
+	add_stats(bram, stats, len, ntrans, start);
+	return 0;
+}
+
+int bram_compare_range(struct bram_resource *bram, size_t offset,
+		const void *buf, size_t len, size_t *equal,
+		struct bram_xfer_stats *stats)
+{
+	const struct bram_kernels *kernels;
+	volatile uint8_t *dev;
+	const uint8_t *buf8 = buf;
+	size_t ntrans = 0;
+	size_t pos = 0;
+	uint64_t start;
+	size_t window_equal;
+	size_t n;
+
+	if ((!buf && len) || !equal || bram_check_range(bram, offset, len)) {
+		return -1;
+	}
+	kernels = kernels_for(bram);
+	start = perf_start(bram);
+	while (pos != len) {
+		n = window_span(bram, offset + pos, len - pos);
+		dev = window_ptr(bram, offset + pos);
+		if (!dev) {
+			return -1;
+		}
+		ntrans += kernels->compare(dev, buf8 + pos, n, bram->narrow_burst,
+				&window_equal);
+		pos += window_equal;
+		if (window_equal != n) {
+			break;
+		}
+	}
+	*equal = pos;
+	add_stats(bram, stats, pos, ntrans, start);
+	return 0;
+}
+
+int bram_peek(struct bram_resource *bram, size_t offset, unsigned int width,
+		uint32_t *value)
+{
+	volatile uint8_t *addr = NULL;
+	uint64_t start;
+
+	if (!value || bram_check_range(bram, offset, width)) {
+		return -1;
+	}
+	if (((width != 1) && (width != 2) && (width != 4)) || (offset % width)) {
+		fprintf(stderr, "Error: Bad access width %u at 0x%zx\n", width, offset);
+		return -1;
+	}
+
+	start = perf_start(bram);
+	/* Aligned accesses never straddle a window */
+	addr = window_ptr(bram, offset);
+	if (!addr) {
+		return -1;
+	}
+	switch (width) {
+		case 1:
+			*value = *addr;
+			break;
+		case 2:
+			*value = *(volatile uint16_t *) addr;
+			break;
+		default:
+			*value = *(volatile uint32_t *) addr;
+			break;
+	}
+	add_stats(bram, NULL, width, 1, start);
+	return 0;
+}
+
+int bram_poke(struct bram_resource *bram, size_t offset, unsigned int width,
+		uint32_t value)
+{
+	volatile uint8_t *addr = NULL;
+	uint64_t start;
+
+	if (bram_check_range(bram, offset, width)) {
+		return -1;
+	}
+	if (((width != 1) && (width != 2) && (width != 4)) || (offset % width)) {
+		fprintf(stderr, "Error: Bad access width %u at 0x%zx\n", width, offset);
+		return -1;
+	}
+
+	start = perf_start(bram);
+	addr = window_ptr(bram, offset);
+	if (!addr) {
+		return -1;
+	}
+	switch (width) {
+		case 1:
+			*addr = (uint8_t) value;
+			break;
+		case 2:
+			*(volatile uint16_t *) addr = (uint16_t) value;
+			break;
+		default:
+			*(volatile uint32_t *) addr = value;
+			break;
+	}
+	add_stats(bram, NULL, width, 1, start);
+	return 0;
+}
+
+/* Common checks for the typed accessors, with count given in elements */
+static int bram_check_typed(struct bram_resource *bram, size_t offset,
+		const void *buf, size_t count, size_t size)
+{
+	if (!buf && count) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if (count > (SIZE_MAX / size)) {
+		fprintf(stderr, "Error: Access count too large\n");
+		return -1;
+	}
+	if (offset % size) {
+		fprintf(stderr, "Error: Offset 0x%zx is not aligned to %zu bytes\n",
+				offset, size);
+		return -1;
+	}
+	return bram_check_range(bram, offset, count * size);
+}
+
+/*
+ * Element by element copy for the typed accessors, a window at a time. The
+ * offset is aligned to the element size, so no element straddles a window.
+ */
+static int typed_copy(struct bram_resource *bram, size_t offset, void *buf,
+		size_t count, size_t size, bool to_dev)
+{
+	volatile uint8_t *dev;
+	uint8_t *buf8 = buf;
+	size_t len = count * size;
+	size_t pos = 0;
+	uint64_t start = perf_start(bram);
+	size_t n;
+
+	while (pos != len) {
+		n = window_span(bram, offset + pos, len - pos);
+		dev = window_ptr(bram, offset + pos);
+		if (!dev) {
+			return -1;
+		}
+		for (size_t i = 0; i < n; i += size) {
+			switch (size) {
+				case 1:
+					if (to_dev) {
+						dev[i] = buf8[pos + i];
+					} else {
+						buf8[pos + i] = dev[i];
+					}
+					break;
+				case 2:
+					if (to_dev) {
+						*(volatile uint16_t *) (dev + i) =
+							*(uint16_t *) (buf8 + pos + i);
+					} else {
+						*(uint16_t *) (buf8 + pos + i) =
+							*(volatile uint16_t *) (dev + i);
+					}
+					break;
+				default:
+					if (to_dev) {
+						*(volatile uint32_t *) (dev + i) =
+							*(uint32_t *) (buf8 + pos + i);
+					} else {
+						*(uint32_t *) (buf8 + pos + i) =
+							*(volatile uint32_t *) (dev + i);
+					}
+					break;
+			}
+		}
+		pos += n;
+	}
+	add_stats(bram, NULL, len, count, start);
+	return 0;
+}
+
+int bram_read8(struct bram_resource *bram, size_t offset, uint8_t *dst,
+		size_t count)
+{
+	if (bram_check_typed(bram, offset, dst, count, sizeof(*dst))) {
+		return -1;
+	}
+	return typed_copy(bram, offset, dst, count, sizeof(*dst), false);
+}
+
+int bram_read16(struct bram_resource *bram, size_t offset, uint16_t *dst,
+		size_t count)
+{
+	if (bram_check_typed(bram, offset, dst, count, sizeof(*dst))) {
+		return -1;
+	}
+	return typed_copy(bram, offset, dst, count, sizeof(*dst), false);
+}
+
+int bram_read32(struct bram_resource *bram, size_t offset, uint32_t *dst,
+		size_t count)
+{
+	if (bram_check_typed(bram, offset, dst, count, sizeof(*dst))) {
+		return -1;
+	}
+	return typed_copy(bram, offset, dst, count, sizeof(*dst), false);
+}
+
+int bram_write8(struct bram_resource *bram, size_t offset, const uint8_t *src,
+		size_t count)
+{
+	if (bram_check_typed(bram, offset, src, count, sizeof(*src))) {
+		return -1;
+	}
+	return typed_copy(bram, offset, (void *) src, count, sizeof(*src), true);
+}
+
+int bram_write16(struct bram_resource *bram, size_t offset, const uint16_t *src,
+		size_t count)
+{
+	if (bram_check_typed(bram, offset, src, count, sizeof(*src))) {
+		return -1;
+	}
+	return typed_copy(bram, offset, (void *) src, count, sizeof(*src), true);
+}
+
+int bram_write32(struct bram_resource *bram, size_t offset, const uint32_t *src,
+		size_t count)
+{
+	if (bram_check_typed(bram, offset, src, count, sizeof(*src))) {
+		return -1;
+	}
+	return typed_copy(bram, offset, (void *) src, count, sizeof(*src), true);
+}
@@ -0,0 +1,93 @@
+#ifndef BRAM_ACCESS_H
+#define BRAM_ACCESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bram_resource.h"
+
+/*
+ * Running totals for traffic generated on the AXI bus. A transaction here is
+ * a single load or store instruction issued against the mapping, regardless
+ * of how many bytes it moves, since that is what the block RAM controller
+ * ends up seeing.
+ */
+struct bram_xfer_stats {
+	size_t bytes;
+	size_t transactions;
+};
+
+void bram_xfer_stats_init(struct bram_xfer_stats *stats);
+
+/*
+ * Copy len bytes from src into the block RAM starting at offset. Everything
+ * in whole bus words is written with the widest aligned stores the controller
+ * allows (see bram_kernels.h), and partial words at either end are written
+ * with single-beat narrower stores, never with a read-modify-write.
+ */
+int bram_write_range(struct bram_resource *bram, size_t offset,
+		const void *src, size_t len, struct bram_xfer_stats *stats);
+
+/*
+ * Like bram_write_range() but the range is compared against src first and
+ * only the bus words whose contents differ are written, so words that already
+ * match are never touched. The number of words written is added to changed.
+ * Both the read and write traffic are counted in stats.
+ */
+int bram_write_diff(struct bram_resource *bram, size_t offset,
+		const void *src, size_t len, size_t *changed,
+		struct bram_xfer_stats *stats);
+
+/* The reverse of bram_write_range(), copying out of the block RAM into dst */
+int bram_read_range(struct bram_resource *bram, size_t offset,
+		void *dst, size_t len, struct bram_xfer_stats *stats);
+
+/* Fill len bytes of block RAM starting at offset with a single value */
+int bram_fill_range(struct bram_resource *bram, size_t offset,
+		size_t len, uint8_t value, struct bram_xfer_stats *stats);
+
+/*
+ * Compare the block RAM at offset against buf, reading a bus word at a time
+ * and stopping at the first difference. The number of leading bytes that
+ * match is stored in equal.
+ */
+int bram_compare_range(struct bram_resource *bram, size_t offset,
+		const void *buf, size_t len, size_t *equal,
+		struct bram_xfer_stats *stats);
+
+/*
+ * Single accesses of 1, 2 or 4 bytes. The offset has to be naturally aligned
+ * for the width, otherwise the access would be split into narrower ones.
+ */
+int bram_peek(struct bram_resource *bram, size_t offset, unsigned int width,
+		uint32_t *value);
+int bram_poke(struct bram_resource *bram, size_t offset, unsigned int width,
+		uint32_t value);
+
+/*
+ * Pointer to len bytes at offset for callers that access the mapping
+ * directly. On a windowed map the window is moved to cover the range, and
+ * the pointer is only good until the next access that moves it again. NULL
+ * if the range does not fit in one window.
+ */
+volatile void *bram_ptr(struct bram_resource *bram, size_t offset, size_t len);
+
+/*
+ * Typed range accesses where every element is moved with exactly one access of
+ * its own width, for callers that care how the controller sees the traffic.
+ * The offset has to be aligned to the element size.
+ */
+int bram_read8(struct bram_resource *bram, size_t offset, uint8_t *dst,
+		size_t count);
+int bram_read16(struct bram_resource *bram, size_t offset, uint16_t *dst,
+		size_t count);
+int bram_read32(struct bram_resource *bram, size_t offset, uint32_t *dst,
+		size_t count);
+int bram_write8(struct bram_resource *bram, size_t offset, const uint8_t *src,
+		size_t count);
+int bram_write16(struct bram_resource *bram, size_t offset, const uint16_t *src,
+		size_t count);
+int bram_write32(struct bram_resource *bram, size_t offset, const uint32_t *src,
+		size_t count);
+
+#endif /* BRAM_ACCESS_H */
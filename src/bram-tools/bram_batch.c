@@ -0,0 +1,187 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+
+#include "bram_resource.h"
+#include "bram_access.h"
+#include "bram_batch.h"
+
+/* Most fields a single access line can have */
+#define BATCH_MAX_TOKENS	4
+
+static int parse_hex32(uint32_t *value, const char *str)
+{
+	char *endptr = NULL;
+	unsigned long result;
+
+	errno = 0;
+	result = strtoul(str, &endptr, 16);
+	if ((str == endptr) || *endptr || errno || (*str == '-') ||
+			(result > UINT32_MAX)) {
+		fprintf(stderr, "Error: Invalid number `%s'\n", str);
+		return -1;
+	}
+	*value = (uint32_t) result;
+	return 0;
+}
+
+int bram_batch_parse_width(unsigned int *width, const char *str)
+{
+	char *endptr = NULL;
+	unsigned long result;
+
+	errno = 0;
+	result = strtoul(str, &endptr, 10);
+	if ((str == endptr) || *endptr || errno) {
+		result = 0;
+	}
+	switch (result) {
+		case 1:
+		case 8:
+			*width = 1;
+			return 0;
+		case 2:
+		case 16:
+			*width = 2;
+			return 0;
+		case 4:
+		case 32:
+			*width = 4;
+			return 0;
+		default:
+			fprintf(stderr, "Error: Width `%s' is not 8, 16 or 32\n", str);
+			return -1;
+	}
+}
+
+int bram_batch_parse(struct bram_batch_op *op, int ntokens, char *tokens[],
+		bool is_write, unsigned int default_width)
+{
+	uint32_t addr;
+	uint32_t limit;
+
+	memset(op, 0, sizeof(*op));
+	if (is_write ? ((ntokens < 3) || (ntokens > 4)) :
+			((ntokens < 1) || (ntokens > 2))) {
+		fprintf(stderr, "Error: Expected %s\n", is_write ?
+				"ADDR WIDTH VALUE [MASK]" : "ADDR [WIDTH]");
+		return -1;
+	}
+	if (parse_hex32(&addr, tokens[0])) {
+		return -1;
+	}
+	op->addr = addr;
+	op->width = default_width;
+	if ((ntokens > 1) && bram_batch_parse_width(&op->width, tokens[1])) {
+		return -1;
+	}
+	if (!is_write) {
+		return 0;
+	}
+
+	limit = (op->width == 4) ? UINT32_MAX : ((1U << (8 * op->width)) - 1);
+	op->mask = limit;
+	if (parse_hex32(&op->value, tokens[2])) {
+		return -1;
+	}
+	if ((ntokens > 3) && parse_hex32(&op->mask, tokens[3])) {
+		return -1;
+	}
+	op->masked = (ntokens > 3);
+	if ((op->value > limit) || (op->mask > limit)) {
+		fprintf(stderr, "Error: Value or mask does not fit in %u bits\n",
+				8 * op->width);
+		return -1;
+	}
+	return 0;
+}
+
+int bram_batch_run(struct bram_resource *bram, struct bram_batch_op *op,
+		bool is_write)
+{
+	uint32_t old;
+
+	if (!is_write) {
+		return bram_peek(bram, op->addr, op->width, &op->value);
+	}
+	if (op->masked) {
+		if (bram_peek(bram, op->addr, op->width, &old)) {
+			return -1;
+		}
+		op->value = (old & ~op->mask) | (op->value & op->mask);
+	}
+	return bram_poke(bram, op->addr, op->width, op->value);
+}
+
+void bram_batch_print(FILE *stream, const struct bram_batch_op *op)
+{
+	fprintf(stream, "0x%04zx 0x%0*"PRIx32"\n", op->addr, (int) (2 * op->width),
+			op->value);
+	return;
+}
+
+/* The address is echoed as given if it is not a number */
+static void print_failure(FILE *stream, const char *addr_str)
+{
+	char *endptr = NULL;
+	unsigned long addr;
+
+	errno = 0;
+	addr = strtoul(addr_str, &endptr, 16);
+	if ((addr_str == endptr) || *endptr || errno || (*addr_str == '-') ||
+			(addr > UINT32_MAX)) {
+		fprintf(stream, "%s ERR\n", addr_str);
+	} else {
+		fprintf(stream, "0x%04lx ERR\n", addr);
+	}
+	return;
+}
+
+int bram_batch_stream(struct bram_resource *bram, FILE *stream, bool is_write,
+		unsigned int default_width, bool quiet, bool keep_going)
+{
+	struct bram_batch_op op;
+	char *line = NULL;
+	size_t line_size = 0;
+	char *tokens[BATCH_MAX_TOKENS + 1];
+	char *token;
+	int ntokens;
+	size_t line_number = 0;
+	int retval = 0;
+
+	while (getline(&line, &line_size, stream) != -1) {
+		line_number++;
+		ntokens = 0;
+		token = strtok(line, " \t\r\n");
+		/* Collect one extra so that trailing junk is caught */
+		while (token && (ntokens < (BATCH_MAX_TOKENS + 1))) {
+			tokens[ntokens++] = token;
+			token = strtok(NULL, " \t\r\n");
+		}
+		/* Blank lines and comments */
+		if (!ntokens || (tokens[0][0] == '#')) {
+			continue;
+		}
+		if (bram_batch_parse(&op, ntokens, tokens, is_write, default_width) ||
+				bram_batch_run(bram, &op, is_write)) {
+			fprintf(stderr, "Error: Line %zu failed\n", line_number);
+			if (!quiet) {
+				print_failure(stdout, tokens[0]);
+			}
+			retval = -1;
+			if (!keep_going) {
+				break;
+			}
+			continue;
+		}
+		if (!quiet) {
+			bram_batch_print(stdout, &op);
+		}
+	}
+	free(line);
+	return retval;
+}
@@ -0,0 +1,47 @@
+#ifndef BRAM_BATCH_H
+#define BRAM_BATCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bram_resource.h"
+
+/* A single access as given to bram_peek or bram_poke */
+struct bram_batch_op {
+	size_t addr;
+	/* Access width in bytes */
+	unsigned int width;
+	uint32_t value;
+	/* Bits to change for a read-modify-write, all of them otherwise */
+	uint32_t mask;
+	bool masked;
+};
+
+/*
+ * Parse the fields of one access, which are ADDR [WIDTH] for reads and
+ * ADDR WIDTH VALUE [MASK] for writes. Numbers are hexadecimal and widths are
+ * given in bits (8, 16 or 32) or bytes (1, 2 or 4).
+ */
+int bram_batch_parse(struct bram_batch_op *op, int ntokens, char *tokens[],
+		bool is_write, unsigned int default_width);
+int bram_batch_parse_width(unsigned int *width, const char *str);
+
+/* Carry out a parsed access, leaving the value read or written in op */
+int bram_batch_run(struct bram_resource *bram, struct bram_batch_op *op,
+		bool is_write);
+
+void bram_batch_print(FILE *stream, const struct bram_batch_op *op);
+
+/*
+ * Run one access per line from stream against the same mapping, printing
+ * each result as it goes. Blank lines and lines starting with # are skipped.
+ * A line that cannot be parsed or run is reported on stderr and printed as
+ * ADDR ERR in its place, so the output still lines up with the input, and
+ * makes the return value -1. Without keep_going the batch stops there.
+ */
+int bram_batch_stream(struct bram_resource *bram, FILE *stream, bool is_write,
+		unsigned int default_width, bool quiet, bool keep_going);
+
+#endif /* BRAM_BATCH_H */
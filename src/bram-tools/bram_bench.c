@@ -0,0 +1,611 @@
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <errno.h>
+
+#include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_access.h"
+#include "bram_kernels.h"
+
+/* Long options without a short equivalent */
+enum {
+	OPT_JSON = 0x100,
+	OPT_STATS,
+	OPT_WAIT,
+};
+
+/* Timed passes of every case unless -n says otherwise */
+#define BENCH_DEFAULT_PASSES	16
+/* Distance between consecutive accesses of the strided latency cases */
+#define BENCH_DEFAULT_STRIDE	0x400
+/* Bus width in bits of a stand-in unless -W says otherwise */
+#define BENCH_DEFAULT_WIDTH	BRAM_AXI_CTRL_WIDTH
+/* Copies go through a buffer of this size, as bram_access.h does */
+#define BENCH_BOUNCE_SIZE	4096
+/* Widest single access, in bytes */
+#define BENCH_MAX_WIDTH		8
+
+struct bench_ctx {
+	volatile uint8_t *map;
+	/* Bytes covered by each pass */
+	size_t len;
+	size_t stride;
+	int narrow;
+	uint8_t *buf;
+	uint8_t bounce[BENCH_BOUNCE_SIZE];
+};
+
+/*
+ * One case moves ctx->len bytes (half that for copies) and returns the
+ * number of bus transactions it issued, or 0 if it cannot tell
+ */
+struct bench_case {
+	const char *op;
+	const char *method;
+	const char *pattern;
+	size_t (*run)(struct bench_ctx *ctx, const struct bram_kernels *kernels);
+	/* Only for the cases that go through a set of kernels */
+	const struct bram_kernels *kernels;
+	/* Bytes per access, 0 where the C library picks its own */
+	unsigned int width;
+	/* Copies only move half of the range */
+	bool half;
+};
+
+/* Results of loads are folded into this so none of them can be left out */
+static volatile uint64_t sink;
+
+void print_usage()
+{
+	printf("Usage: bram_bench [-n PASSES] [-l LENGTH] [-t STRIDE] [--json] DEVICE MAP\n");
+	printf("       bram_bench -s SIZE [-W WIDTH] [-n PASSES] [-l LENGTH] [-t STRIDE] [--json]\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("  %-15s%-30s\n", "-h", "display program usage");
+	printf("  %-15s%-30s\n", "-s SIZE", "benchmark an anonymous memory stand-in");
+	printf("  %-15s%-30s\n", "", "of SIZE bytes instead of a map");
+	printf("  %-15s%-30s\n", "-W WIDTH", "bus width of the stand-in in bits");
+	printf("  %-15s%-30s\n", "", "(default 32)");
+	printf("  %-15s%-30s\n", "-n PASSES", "time every case PASSES times (default 16)");
+	printf("  %-15s%-30s\n", "-l LENGTH", "bytes covered by each pass (default the");
+	printf("  %-15s%-30s\n", "", "whole map or its first window)");
+	printf("  %-15s%-30s\n", "-t STRIDE", "distance between strided accesses");
+	printf("  %-15s%-30s\n", "", "(default 0x400)");
+	printf("  %-15s%-30s\n", "--json", "print one JSON object per case instead");
+	printf("  %-15s%-30s\n", "", "of a table");
+	printf("  %-15s%-30s\n", "--wait MS", "give up on a locked map after MS ms");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase to stderr");
+	printf("\n");
+	printf("Read, write, fill, compare and copy throughput is measured with each\n");
+	printf("set of access kernels the bus allows and with the C library. Single\n");
+	printf("loads and stores of each width are timed in address order and in\n");
+	printf("STRIDE steps. Every case overwrites the range. SIZE, LENGTH and\n");
+	printf("STRIDE are in hex.\n");
+	printf("\n");
+	return;
+}
+
+static size_t kernel_read(struct bench_ctx *ctx, const struct bram_kernels *k)
+{
+	size_t ntrans;
+
+	ntrans = k->read(ctx->buf, ctx->map, ctx->len, ctx->narrow);
+	sink ^= ctx->buf[ctx->len - 1];
+	return ntrans;
+}
+
+static size_t kernel_write(struct bench_ctx *ctx, const struct bram_kernels *k)
+{
+	return k->write(ctx->map, ctx->buf, ctx->len, ctx->narrow);
+}
+
+static size_t kernel_fill(struct bench_ctx *ctx, const struct bram_kernels *k)
+{
+	return k->fill(ctx->map, 0xa5, ctx->len, ctx->narrow);
+}
+
+/* The buffer holds what was last written, so the whole range is compared */
+static size_t kernel_compare(struct bench_ctx *ctx, const struct bram_kernels *k)
+{
+	size_t equal;
+	size_t ntrans;
+
+	ntrans = k->compare(ctx->map, ctx->buf, ctx->len, ctx->narrow, &equal);
+	sink ^= equal;
+	return ntrans;
+}
+
+/* First half of the range into the second, through a bounce buffer */
+static size_t kernel_copy(struct bench_ctx *ctx, const struct bram_kernels *k)
+{
+	size_t half = ctx->len / 2;
+	size_t ntrans = 0;
+	size_t n;
+
+	for (size_t pos = 0; pos < half; pos += n) {
+		n = half - pos;
+		n = (n < sizeof(ctx->bounce)) ? n : sizeof(ctx->bounce);
+		ntrans += k->read(ctx->bounce, ctx->map + pos, n, ctx->narrow);
+		ntrans += k->write(ctx->map + half + pos, ctx->bounce, n, ctx->narrow);
+	}
+	return ntrans;
+}
+
+/*
+ * The C library gets to pick its own access widths and may use unaligned or
+ * wider accesses than the bus takes, which is exactly what is being compared
+ */
+static size_t libc_read(struct bench_ctx *ctx, const struct bram_kernels *k)
+{
+	(void) k;
+	memcpy(ctx->buf, (const void *) ctx->map, ctx->len);
+	sink ^= ctx->buf[ctx->len - 1];
+	return 0;
+}
+
+static size_t libc_write(struct bench_ctx *ctx, const struct bram_kernels *k)
+{
+	(void) k;
+	memcpy((void *) ctx->map, ctx->buf, ctx->len);
+	return 0;
+}
+
+static size_t libc_fill(struct bench_ctx *ctx, const struct bram_kernels *k)
+{
+	(void) k;
+	memset((void *) ctx->map, 0xa5, ctx->len);
+	return 0;
+}
+
+static size_t libc_compare(struct bench_ctx *ctx, const struct bram_kernels *k)
+{
+	(void) k;
+	sink ^= (uint64_t) memcmp((const void *) ctx->map, ctx->buf, ctx->len);
+	return 0;
+}
+
+static size_t libc_copy(struct bench_ctx *ctx, const struct bram_kernels *k)
+{
+	size_t half = ctx->len / 2;
+
+	(void) k;
+	memcpy((void *) (ctx->map + half), (const void *) ctx->map, half);
+	return 0;
+}
+
+/*
+ * Single accesses of one width covering every word of the range once, either
+ * in address order or in stride sized steps wrapping around to the next word
+ * along, so both patterns touch the same words
+ */
+#define DEFINE_LATENCY(bits)							\
+static size_t load_seq_##bits(struct bench_ctx *ctx,				\
+		const struct bram_kernels *k)					\
+{										\
+	uint##bits##_t acc = 0;							\
+	size_t count = 0;							\
+										\
+	(void) k;								\
+	for (size_t off = 0; (off + (bits / 8)) <= ctx->len; off += bits / 8) {	\
+		acc ^= *(const volatile uint##bits##_t *) (ctx->map + off);	\
+		count++;							\
+	}									\
+	sink ^= acc;								\
+	return count;								\
+}										\
+static size_t load_stride_##bits(struct bench_ctx *ctx,			\
+		const struct bram_kernels *k)					\
+{										\
+	uint##bits##_t acc = 0;							\
+	size_t count = 0;							\
+										\
+	(void) k;								\
+	for (size_t first = 0; first < ctx->stride; first += bits / 8) {	\
+		for (size_t off = first; (off + (bits / 8)) <= ctx->len;	\
+				off += ctx->stride) {				\
+			acc ^= *(const volatile uint##bits##_t *) (ctx->map + off); \
+			count++;						\
+		}								\
+	}									\
+	sink ^= acc;								\
+	return count;								\
+}										\
+static size_t store_seq_##bits(struct bench_ctx *ctx,				\
+		const struct bram_kernels *k)					\
+{										\
+	size_t count = 0;							\
+										\
+	(void) k;								\
+	for (size_t off = 0; (off + (bits / 8)) <= ctx->len; off += bits / 8) {	\
+		*(volatile uint##bits##_t *) (ctx->map + off) =			\
+			(uint##bits##_t) off;					\
+		count++;							\
+	}									\
+	return count;								\
+}										\
+static size_t store_stride_##bits(struct bench_ctx *ctx,			\
+		const struct bram_kernels *k)					\
+{										\
+	size_t count = 0;							\
+										\
+	(void) k;								\
+	for (size_t first = 0; first < ctx->stride; first += bits / 8) {	\
+		for (size_t off = first; (off + (bits / 8)) <= ctx->len;	\
+				off += ctx->stride) {				\
+			*(volatile uint##bits##_t *) (ctx->map + off) =		\
+				(uint##bits##_t) off;				\
+			count++;						\
+		}								\
+	}									\
+	return count;								\
+}
+
+DEFINE_LATENCY(8)
+DEFINE_LATENCY(16)
+DEFINE_LATENCY(32)
+DEFINE_LATENCY(64)
+
+struct latency_funcs {
+	unsigned int width;
+	const char *method;
+	size_t (*load_seq)(struct bench_ctx *, const struct bram_kernels *);
+	size_t (*load_stride)(struct bench_ctx *, const struct bram_kernels *);
+	size_t (*store_seq)(struct bench_ctx *, const struct bram_kernels *);
+	size_t (*store_stride)(struct bench_ctx *, const struct bram_kernels *);
+};
+
+static const struct latency_funcs latency_table[] = {
+	{ 1, "8-bit", load_seq_8, load_stride_8, store_seq_8, store_stride_8 },
+	{ 2, "16-bit", load_seq_16, load_stride_16, store_seq_16, store_stride_16 },
+	{ 4, "32-bit", load_seq_32, load_stride_32, store_seq_32, store_stride_32 },
+	{ 8, "64-bit", load_seq_64, load_stride_64, store_seq_64, store_stride_64 },
+};
+
+#define NUM_LATENCY	(sizeof(latency_table) / sizeof(latency_table[0]))
+
+/*
+ * Five bulk operations for each of at most eight sets of kernels and the C
+ * library, plus four latency cases per width
+ */
+#define BENCH_MAX_CASES	(5 * (8 + 1) + 4 * NUM_LATENCY)
+
+/*
+ * Every case that is legal on bram: kernel sets and single accesses no wider
+ * than the bus. Single stores narrower than the bus are single beats, which
+ * every controller takes.
+ */
+static size_t build_cases(struct bench_case *cases,
+		const struct bram_resource *bram)
+{
+	static const struct {
+		const char *op;
+		size_t (*kernel)(struct bench_ctx *, const struct bram_kernels *);
+		size_t (*libc)(struct bench_ctx *, const struct bram_kernels *);
+		const char *libc_name;
+		bool half;
+	} bulk[] = {
+		{ "read", kernel_read, libc_read, "memcpy", false },
+		{ "write", kernel_write, libc_write, "memcpy", false },
+		{ "fill", kernel_fill, libc_fill, "memset", false },
+		{ "compare", kernel_compare, libc_compare, "memcmp", false },
+		{ "copy", kernel_copy, libc_copy, "memcpy", true },
+	};
+	const struct bram_kernels *k;
+	const struct latency_funcs *lat;
+	size_t count = 0;
+
+	for (size_t i = 0; i < (sizeof(bulk) / sizeof(bulk[0])); i++) {
+		for (size_t j = 0; (k = bram_kernels_get(j)); j++) {
+			if ((k->width > bram->map_width) || (count == BENCH_MAX_CASES)) {
+				continue;
+			}
+			cases[count++] = (struct bench_case) { bulk[i].op, k->name, "seq",
+				bulk[i].kernel, k, k->width / 8, bulk[i].half };
+		}
+		if (count < BENCH_MAX_CASES) {
+			cases[count++] = (struct bench_case) { bulk[i].op, bulk[i].libc_name, "seq",
+				bulk[i].libc, NULL, 0, bulk[i].half };
+		}
+	}
+	for (size_t i = 0; i < NUM_LATENCY; i++) {
+		lat = &latency_table[i];
+		if (((8 * lat->width) > bram->map_width) ||
+				((count + 4) > BENCH_MAX_CASES)) {
+			continue;
+		}
+		cases[count++] = (struct bench_case) { "load", lat->method, "seq",
+			lat->load_seq, NULL, lat->width, false };
+		cases[count++] = (struct bench_case) { "load", lat->method, "stride",
+			lat->load_stride, NULL, lat->width, false };
+		cases[count++] = (struct bench_case) { "store", lat->method, "seq",
+			lat->store_seq, NULL, lat->width, false };
+		cases[count++] = (struct bench_case) { "store", lat->method, "stride",
+			lat->store_stride, NULL, lat->width, false };
+	}
+	return count;
+}
+
+struct bench_result {
+	size_t bytes;
+	size_t transactions;
+	uint64_t best_ns;
+	uint64_t total_ns;
+};
+
+/* One untimed pass to settle, then the best and mean of the timed ones */
+static void run_case(const struct bench_case *bc, struct bench_ctx *ctx,
+		unsigned long passes, struct bench_result *result)
+{
+	uint64_t t_start;
+	uint64_t ns;
+
+	memset(result, 0, sizeof(*result));
+	result->bytes = bc->half ? (ctx->len / 2) : ctx->len;
+	result->best_ns = UINT64_MAX;
+	bc->run(ctx, bc->kernels);
+	for (unsigned long i = 0; i < passes; i++) {
+		t_start = bram_clock_ns();
+		result->transactions = bc->run(ctx, bc->kernels);
+		ns = bram_clock_ns() - t_start;
+		result->total_ns += ns;
+		if (ns < result->best_ns) {
+			result->best_ns = ns;
+		}
+	}
+	/* Compares only make sense against what the last write left behind */
+	if (!strcmp(bc->op, "write") || !strcmp(bc->op, "fill")) {
+		memcpy(ctx->buf, (const void *) ctx->map, ctx->len);
+	}
+	return;
+}
+
+static double mb_per_s(size_t bytes, uint64_t ns)
+{
+	return ns ? ((double) bytes * 1e3 / (double) ns) : 0.0;
+}
+
+static void print_result(const struct bench_case *bc,
+		const struct bench_result *result, unsigned long passes, bool json)
+{
+	double mean_ns = (double) result->total_ns / (double) passes;
+	double best = mb_per_s(result->bytes, result->best_ns);
+	double mean = mean_ns ? ((double) result->bytes * 1e3 / mean_ns) : 0.0;
+	double per_access = result->transactions ?
+		((double) result->best_ns / (double) result->transactions) : 0.0;
+
+	if (json) {
+		printf("{\"op\":\"%s\",\"method\":\"%s\",\"pattern\":\"%s\","
+				"\"width\":%u,\"bytes\":%zu,\"passes\":%lu,\"best_ns\":%"PRIu64","
+				"\"mean_ns\":%.0f,\"best_mbps\":%.2f,\"mean_mbps\":%.2f,"
+				"\"transactions\":%zu,\"ns_per_access\":%.2f}\n",
+				bc->op, bc->method, bc->pattern, 8 * bc->width,
+				result->bytes, passes, result->best_ns, mean_ns, best, mean,
+				result->transactions, per_access);
+		return;
+	}
+	printf("%-9s%-13s%-8s%10zu%12.2f%12.2f", bc->op, bc->method, bc->pattern,
+			result->bytes, best, mean);
+	if (result->transactions) {
+		printf("%12.2f\n", per_access);
+	} else {
+		printf("%12s\n", "-");
+	}
+	return;
+}
+
+int bench_bram(struct bram_resource *bram, size_t len, size_t stride,
+		unsigned long passes, bool json)
+{
+	struct bench_case cases[BENCH_MAX_CASES];
+	struct bench_result result;
+	struct bench_ctx *ctx;
+	size_t count;
+
+	/* Everything runs straight on the mapping, so it has to cover the range */
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	ctx->map = bram_ptr(bram, 0, len);
+	if (!ctx->map) {
+		free(ctx);
+		return -1;
+	}
+	ctx->buf = malloc(len);
+	if (!ctx->buf) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		free(ctx);
+		return -1;
+	}
+	ctx->len = len;
+	ctx->stride = stride;
+	ctx->narrow = bram->narrow_burst;
+	for (size_t i = 0; i < len; i++) {
+		ctx->buf[i] = (uint8_t) (i * 131 + 7);
+	}
+
+	count = build_cases(cases, bram);
+	if (!json) {
+		printf("%s: %zu bytes per pass, %zu-bit bus, %lu passes, stride 0x%zx\n",
+				bram->map_name, len, bram->map_width, passes, stride);
+		printf("%-9s%-13s%-8s%10s%12s%12s%12s\n", "OP", "METHOD", "PATTERN",
+				"BYTES", "BEST MB/s", "MEAN MB/s", "NS/ACCESS");
+	}
+	for (size_t i = 0; i < count; i++) {
+		run_case(&cases[i], ctx, passes, &result);
+		print_result(&cases[i], &result, passes, json);
+		fflush(stdout);
+	}
+
+	free(ctx->buf);
+	free(ctx);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int result;
+	int retval;
+
+	struct bram_resource bram;
+	int uio_number = -1;
+	int map_number = -1;
+	size_t standin_size = 0;
+	size_t length = 0;
+	size_t stride = BENCH_DEFAULT_STRIDE;
+	unsigned long width = BENCH_DEFAULT_WIDTH;
+	unsigned long passes = BENCH_DEFAULT_PASSES;
+	bool json = false;
+	char *endptr = NULL;
+	int num_pos_args;
+
+	static const struct option long_options[] = {
+		{ "json", no_argument, NULL, OPT_JSON },
+		{ "wait", required_argument, NULL, OPT_WAIT },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct bram_perf perf;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+	struct bram_lock lock;
+
+	bram_perf_init(&perf);
+	bram_lock_init(&lock, BRAM_LOCK_EXCLUSIVE);
+	int opt;
+	while ((opt = getopt_long(argc, argv, "hs:W:n:l:t:", long_options,
+					NULL)) != -1) {
+		switch (opt) {
+			case 'h':
+				print_usage();
+				return 0;
+			case 's':
+				if (str_to_size(&standin_size, optarg) || !standin_size) {
+					fprintf(stderr, "Error: Bad stand-in size\n");
+					return 1;
+				}
+				break;
+			case 'W':
+				errno = 0;
+				width = strtoul(optarg, &endptr, 10);
+				if (errno || (endptr == optarg) || *endptr ||
+						((width != 8) && (width != 16) && (width != 32) &&
+						 (width != 64))) {
+					fprintf(stderr, "Error: Width has to be 8, 16, 32 or 64 bits\n");
+					return 1;
+				}
+				break;
+			case 'n':
+				errno = 0;
+				passes = strtoul(optarg, &endptr, 10);
+				if (errno || (endptr == optarg) || *endptr || (*optarg == '-') ||
+						!passes) {
+					fprintf(stderr, "Error: Bad number of passes\n");
+					return 1;
+				}
+				break;
+			case 'l':
+				if (str_to_size(&length, optarg) || !length) {
+					fprintf(stderr, "Error: Bad length\n");
+					return 1;
+				}
+				break;
+			case 't':
+				if (str_to_size(&stride, optarg) || !stride ||
+						(stride % BENCH_MAX_WIDTH)) {
+					fprintf(stderr, "Error: Stride has to be a non-zero multiple "
+							"of %d\n", BENCH_MAX_WIDTH);
+					return 1;
+				}
+				break;
+			case OPT_JSON:
+				json = true;
+				break;
+			case OPT_WAIT:
+				if (bram_lock_parse_wait(&lock.timeout_ms, optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				break;
+			case '?':
+				if ((optopt == 's') || (optopt == 'W') || (optopt == 'n') ||
+						(optopt == 'l') || (optopt == 't')) {
+					fprintf(stderr, "Error: Option -%c requires an argument\n", optopt);
+				} else if (isprint(optopt)) {
+					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+				} else {
+					fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+				}
+				return 1;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+	/* The stand-in takes the place of the DEVICE and MAP arguments */
+	num_pos_args = argc - optind;
+	if (num_pos_args != (standin_size ? 0 : 2)) {
+		fprintf(stderr, "Error: Incorrect number of positional arguments\n");
+		print_usage();
+		return 1;
+	}
+
+	if (standin_size) {
+		result = bram_create_standin(&bram, standin_size, (unsigned int) width);
+		bram.perf = stats_format ? &perf : NULL;
+	} else {
+		if (str_to_index(&uio_number, argv[optind])) {
+			fprintf(stderr, "Error: Bad UIO device number\n");
+			return 1;
+		}
+		if (str_to_index(&map_number, argv[optind + 1])) {
+			fprintf(stderr, "Error: Bad map number\n");
+			return 1;
+		}
+		result = bram_create_locked(&bram, uio_number, map_number,
+				stats_format ? &perf : NULL, &lock);
+	}
+	if (result && standin_size) {
+		fprintf(stderr, "Could not create stand-in map\n");
+		return 1;
+	}
+	if (result) {
+		fprintf(stderr, "Could not create block RAM resource for UIO device %d "
+				"or map number %d\n", uio_number, map_number);
+		return 1;
+	}
+
+	/* Without a length, cover as much as is mapped at once */
+	if (!length) {
+		length = bram.window_size;
+	}
+	retval = 0;
+	if ((length > bram.map_size) || (length % BENCH_MAX_WIDTH)) {
+		fprintf(stderr, "Error: Length has to be a multiple of %d that fits "
+				"in the map\n", BENCH_MAX_WIDTH);
+		retval = 1;
+	} else if (bench_bram(&bram, length, stride, passes, json)) {
+		fprintf(stderr, "Could not benchmark block RAM resource\n");
+		retval = 1;
+	}
+
+	if (bram_destroy(&bram)) {
+		fprintf(stderr, "Could not destroy block RAM resource\n");
+		retval = 1;
+	}
+	if (stats_format) {
+		bram_perf_print(stderr, "bram_bench", &perf, stats_format);
+	}
+	return retval;
+}
@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef BRAM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef BRAM_HAVE_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef BRAM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "bram_decomp.h"
+
+static const uint8_t gzip_magic[] = { 0x1f, 0x8b };
+/* 0x184d2204 and 0xfd2fb528, both little-endian */
+static const uint8_t lz4_magic[] = { 0x04, 0x22, 0x4d, 0x18 };
+static const uint8_t zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+/*
+ * Decode from in[in_pos..in_len] into at most len bytes of out, advancing
+ * in_pos past the input used and setting stream_done at the end of a stream
+ */
+typedef int (*decomp_step_fn)(struct bram_decomp *decomp, uint8_t *out,
+		size_t len, size_t *produced);
+
+const char *bram_compression_name(enum bram_compression compression)
+{
+	switch (compression) {
+		case BRAM_COMPRESSION_NONE:
+			return "none";
+		case BRAM_COMPRESSION_GZIP:
+			return "gzip";
+		case BRAM_COMPRESSION_LZ4:
+			return "lz4";
+		case BRAM_COMPRESSION_ZSTD:
+			return "zstd";
+	}
+	return "unknown";
+}
+
+static bool has_magic(const uint8_t *buf, size_t len, const uint8_t *magic,
+		size_t magic_len)
+{
+	return (len >= magic_len) && !memcmp(buf, magic, magic_len);
+}
+
+enum bram_compression bram_decomp_detect(const uint8_t *buf, size_t len)
+{
+	if (has_magic(buf, len, gzip_magic, sizeof(gzip_magic))) {
+		return BRAM_COMPRESSION_GZIP;
+	}
+	if (has_magic(buf, len, lz4_magic, sizeof(lz4_magic))) {
+		return BRAM_COMPRESSION_LZ4;
+	}
+	if (has_magic(buf, len, zstd_magic, sizeof(zstd_magic))) {
+		return BRAM_COMPRESSION_ZSTD;
+	}
+	return BRAM_COMPRESSION_NONE;
+}
+
+bool bram_decomp_supported(enum bram_compression compression)
+{
+	switch (compression) {
+		case BRAM_COMPRESSION_NONE:
+			return true;
+#ifdef BRAM_HAVE_ZLIB
+		case BRAM_COMPRESSION_GZIP:
+			return true;
+#endif
+#ifdef BRAM_HAVE_LZ4
+		case BRAM_COMPRESSION_LZ4:
+			return true;
+#endif
+#ifdef BRAM_HAVE_ZSTD
+		case BRAM_COMPRESSION_ZSTD:
+			return true;
+#endif
+		default:
+			return false;
+	}
+}
+
+#ifdef BRAM_HAVE_ZLIB
+static int gzip_step(struct bram_decomp *decomp, uint8_t *out, size_t len,
+		size_t *produced)
+{
+	z_stream *zs = decomp->stream;
+	int result;
+
+	/* A new member after the end of the last one */
+	if (decomp->stream_done) {
+		inflateReset(zs);
+		decomp->stream_done = false;
+	}
+	len = (len < UINT_MAX) ? len : UINT_MAX;
+	zs->next_in = decomp->in + decomp->in_pos;
+	zs->avail_in = (uInt) (decomp->in_len - decomp->in_pos);
+	zs->next_out = out;
+	zs->avail_out = (uInt) len;
+	result = inflate(zs, Z_NO_FLUSH);
+	decomp->in_pos = decomp->in_len - zs->avail_in;
+	*produced = len - zs->avail_out;
+	if (result == Z_STREAM_END) {
+		decomp->stream_done = true;
+	} else if ((result != Z_OK) && (result != Z_BUF_ERROR)) {
+		fprintf(stderr, "Error: Corrupt gzip data: %s\n",
+				zs->msg ? zs->msg : "unknown error");
+		return -1;
+	}
+	return 0;
+}
+#endif
+
+#ifdef BRAM_HAVE_LZ4
+/* The context starts on a new frame by itself once one has been completed */
+static int lz4_step(struct bram_decomp *decomp, uint8_t *out, size_t len,
+		size_t *produced)
+{
+	size_t in_len = decomp->in_len - decomp->in_pos;
+	size_t result;
+
+	decomp->stream_done = false;
+	*produced = len;
+	result = LZ4F_decompress(decomp->stream, out, produced,
+			decomp->in + decomp->in_pos, &in_len, NULL);
+	if (LZ4F_isError(result)) {
+		fprintf(stderr, "Error: Corrupt LZ4 data: %s\n",
+				LZ4F_getErrorName(result));
+		return -1;
+	}
+	decomp->in_pos += in_len;
+	decomp->stream_done = !result;
+	return 0;
+}
+#endif
+
+#ifdef BRAM_HAVE_ZSTD
+/* Likewise, a return of 0 means a frame was completed and flushed */
+static int zstd_step(struct bram_decomp *decomp, uint8_t *out, size_t len,
+		size_t *produced)
+{
+	ZSTD_inBuffer in = { decomp->in + decomp->in_pos,
+		decomp->in_len - decomp->in_pos, 0 };
+	ZSTD_outBuffer output = { out, len, 0 };
+	size_t result;
+
+	decomp->stream_done = false;
+	result = ZSTD_decompressStream(decomp->stream, &output, &in);
+	if (ZSTD_isError(result)) {
+		fprintf(stderr, "Error: Corrupt zstd data: %s\n",
+				ZSTD_getErrorName(result));
+		return -1;
+	}
+	decomp->in_pos += in.pos;
+	*produced = output.pos;
+	decomp->stream_done = !result;
+	return 0;
+}
+#endif
+
+int bram_decomp_init(struct bram_decomp *decomp,
+		enum bram_compression compression, int fd)
+{
+	if (!decomp) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	memset(decomp, 0, sizeof(*decomp));
+	decomp->compression = compression;
+	decomp->fd = fd;
+	if (!bram_decomp_supported(compression) ||
+			(compression == BRAM_COMPRESSION_NONE)) {
+		fprintf(stderr, "Error: This build cannot decompress %s data\n",
+				bram_compression_name(compression));
+		return -1;
+	}
+
+	switch (compression) {
+#ifdef BRAM_HAVE_ZLIB
+		case BRAM_COMPRESSION_GZIP:
+			decomp->stream = calloc(1, sizeof(z_stream));
+			/* 32 on top of the window bits detects gzip or zlib headers */
+			if (decomp->stream && (inflateInit2(decomp->stream, 15 + 32) != Z_OK)) {
+				free(decomp->stream);
+				decomp->stream = NULL;
+			}
+			break;
+#endif
+#ifdef BRAM_HAVE_LZ4
+		case BRAM_COMPRESSION_LZ4:
+			if (LZ4F_isError(LZ4F_createDecompressionContext(
+							(LZ4F_dctx **) &decomp->stream, LZ4F_VERSION))) {
+				decomp->stream = NULL;
+			}
+			break;
+#endif
+#ifdef BRAM_HAVE_ZSTD
+		case BRAM_COMPRESSION_ZSTD:
+			decomp->stream = ZSTD_createDStream();
+			if (decomp->stream && ZSTD_isError(ZSTD_initDStream(decomp->stream))) {
+				ZSTD_freeDStream(decomp->stream);
+				decomp->stream = NULL;
+			}
+			break;
+#endif
+		default:
+			break;
+	}
+	if (!decomp->stream) {
+		fprintf(stderr, "Error: Could not set up %s decompression\n",
+				bram_compression_name(compression));
+		return -1;
+	}
+	return 0;
+}
+
+void bram_decomp_free(struct bram_decomp *decomp)
+{
+	if (!decomp->stream) {
+		return;
+	}
+	switch (decomp->compression) {
+#ifdef BRAM_HAVE_ZLIB
+		case BRAM_COMPRESSION_GZIP:
+			inflateEnd(decomp->stream);
+			free(decomp->stream);
+			break;
+#endif
+#ifdef BRAM_HAVE_LZ4
+		case BRAM_COMPRESSION_LZ4:
+			LZ4F_freeDecompressionContext(decomp->stream);
+			break;
+#endif
+#ifdef BRAM_HAVE_ZSTD
+		case BRAM_COMPRESSION_ZSTD:
+			ZSTD_freeDStream(decomp->stream);
+			break;
+#endif
+		default:
+			break;
+	}
+	decomp->stream = NULL;
+	return;
+}
+
+/* Read more compressed input once everything read so far has been used */
+static int refill(struct bram_decomp *decomp)
+{
+	ssize_t num_read;
+
+	if ((decomp->in_pos != decomp->in_len) || decomp->eof) {
+		return 0;
+	}
+	do {
+		num_read = read(decomp->fd, decomp->in, sizeof(decomp->in));
+	} while ((num_read < 0) && (errno == EINTR));
+	if (num_read < 0) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	decomp->in_pos = 0;
+	decomp->in_len = (size_t) num_read;
+	decomp->eof = !num_read;
+	decomp->bytes_in += (size_t) num_read;
+	return 0;
+}
+
+static decomp_step_fn step_for(enum bram_compression compression)
+{
+	switch (compression) {
+#ifdef BRAM_HAVE_ZLIB
+		case BRAM_COMPRESSION_GZIP:
+			return gzip_step;
+#endif
+#ifdef BRAM_HAVE_LZ4
+		case BRAM_COMPRESSION_LZ4:
+			return lz4_step;
+#endif
+#ifdef BRAM_HAVE_ZSTD
+		case BRAM_COMPRESSION_ZSTD:
+			return zstd_step;
+#endif
+		default:
+			return NULL;
+	}
+}
+
+ssize_t bram_decomp_read(struct bram_decomp *decomp, uint8_t *buf, size_t len)
+{
+	decomp_step_fn step = step_for(decomp->compression);
+	size_t done = 0;
+	size_t produced;
+	size_t in_pos;
+
+	if (!step || !decomp->stream) {
+		fprintf(stderr, "Error: Decompression has not been set up\n");
+		return -1;
+	}
+	while (done < len) {
+		if (refill(decomp)) {
+			return -1;
+		}
+		/* The data ends cleanly only where a stream does */
+		if ((decomp->in_pos == decomp->in_len) && decomp->eof &&
+				decomp->stream_done) {
+			break;
+		}
+		/* Past the end of the input the decoder may still hold output */
+		in_pos = decomp->in_pos;
+		if (step(decomp, buf + done, len - done, &produced)) {
+			return -1;
+		}
+		done += produced;
+		/* Neither input used nor output made, with room for both */
+		if (!produced && (decomp->in_pos == in_pos) && !decomp->stream_done) {
+			fprintf(stderr, "Error: %s %s data\n",
+					decomp->eof ? "Truncated" : "Corrupt",
+					bram_compression_name(decomp->compression));
+			return -1;
+		}
+	}
+	decomp->bytes_out += done;
+	return (ssize_t) done;
+}
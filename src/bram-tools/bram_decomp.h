@@ -0,0 +1,64 @@
+#ifndef BRAM_DECOMP_H
+#define BRAM_DECOMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * Streaming decompression of files read through a descriptor, so that
+ * compressed images can be loaded without unpacking them to a file first.
+ * Each method is only available if the library for it was found when
+ * libbram was built, see the Makefile. Concatenated streams, as made by
+ * appending compressed files to each other, are read as one.
+ */
+enum bram_compression {
+	BRAM_COMPRESSION_NONE,
+	/* gzip, and zlib streams for good measure, through zlib */
+	BRAM_COMPRESSION_GZIP,
+	/* LZ4 frame format through liblz4 */
+	BRAM_COMPRESSION_LZ4,
+	/* Zstandard frames through libzstd */
+	BRAM_COMPRESSION_ZSTD,
+};
+
+/* Compressed input is read from the file in blocks of this size */
+#define BRAM_DECOMP_IN_SIZE		(16 * 1024)
+
+struct bram_decomp {
+	enum bram_compression compression;
+	int fd;
+	/* Decoder state of whichever library does the work */
+	void *stream;
+	uint8_t in[BRAM_DECOMP_IN_SIZE];
+	size_t in_pos;
+	size_t in_len;
+	/* read() has returned 0 */
+	bool eof;
+	/* The last stream has been decoded in full and nothing followed it yet */
+	bool stream_done;
+	/* Totals for reporting */
+	size_t bytes_in;
+	size_t bytes_out;
+};
+
+const char *bram_compression_name(enum bram_compression compression);
+/* Recognize a compressed file from its first bytes */
+enum bram_compression bram_decomp_detect(const uint8_t *buf, size_t len);
+/* Whether this build of the library can decompress it */
+bool bram_decomp_supported(enum bram_compression compression);
+
+/* Decompress what is read from fd, starting at its current offset */
+int bram_decomp_init(struct bram_decomp *decomp,
+		enum bram_compression compression, int fd);
+void bram_decomp_free(struct bram_decomp *decomp);
+
+/*
+ * Put up to len decompressed bytes into buf, filling it unless the end of the
+ * data comes first. Returns how many, 0 at the end or -1 on corrupt or
+ * truncated input.
+ */
+ssize_t bram_decomp_read(struct bram_decomp *decomp, uint8_t *buf, size_t len);
+
+#endif /* BRAM_DECOMP_H */
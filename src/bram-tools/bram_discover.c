@@ -0,0 +1,328 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_discover.h"
+
+/*
+ * The cache lives on tmpfs by default, which conveniently throws it away on
+ * every boot - the only time the kernel or device tree can change
+ */
+#define BRAM_INDEX_CACHE_PATH		"/var/run/bram.index"
+#define BRAM_INDEX_CACHE_ENV		"BRAM_INDEX_CACHE"
+#define BRAM_INDEX_MAGIC		"BRAMIDX1"
+
+struct bram_index_header {
+	char magic[8];
+	/* Guards against a cache written by a build with a different layout */
+	uint32_t entry_size;
+	uint32_t count;
+};
+
+const char *bram_index_cache_path(void)
+{
+	return bram_env_path(BRAM_INDEX_CACHE_ENV, BRAM_INDEX_CACHE_PATH);
+}
+
+/* Read a single sysfs attribute relative to a directory descriptor */
+static int read_attr(int dirfd, const char *name, char *buf, size_t size)
+{
+	ssize_t result;
+	int fd;
+
+	fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	result = read(fd, buf, size - 1);
+	close(fd);
+	if (result <= 0) {
+		return -1;
+	}
+	buf[result] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+static int read_attr_hex(int dirfd, const char *name, uint32_t *value)
+{
+	char buf[32];
+	char *endptr = NULL;
+	unsigned long result;
+
+	if (read_attr(dirfd, name, buf, sizeof(buf))) {
+		return -1;
+	}
+	errno = 0;
+	result = strtoul(buf, &endptr, 16);
+	if ((endptr == buf) || *endptr || errno || (result > UINT32_MAX)) {
+		return -1;
+	}
+	*value = (uint32_t) result;
+	return 0;
+}
+
+static int dev_numbers(int uio_number, unsigned int *major_number,
+		unsigned int *minor_number)
+{
+	char dev_path[BRAM_DEV_PATH_SIZE];
+	struct stat sb;
+
+	snprintf(dev_path, sizeof(dev_path), "%s/uio%d", bram_dev_root(), uio_number);
+	if (stat(dev_path, &sb)) {
+		return -1;
+	}
+	*major_number = major(sb.st_rdev);
+	*minor_number = minor(sb.st_rdev);
+	return 0;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	const struct bram_map_entry *ea = a;
+	const struct bram_map_entry *eb = b;
+
+	if (ea->uio_number != eb->uio_number) {
+		return (ea->uio_number < eb->uio_number) ? -1 : 1;
+	}
+	if (ea->map_number != eb->map_number) {
+		return (ea->map_number < eb->map_number) ? -1 : 1;
+	}
+	return 0;
+}
+
+/* Add every map belonging to one UIO device to the index */
+static void scan_device(struct bram_index *index, int root_fd, int uio_number)
+{
+	struct bram_map_entry *entry;
+	char path[32];
+	unsigned int major_number;
+	unsigned int minor_number;
+	struct dirent *ent;
+	DIR *maps_dir = NULL;
+	int maps_fd;
+	int map_fd;
+	int map_number;
+	uint32_t dt_size;
+	char extra;
+
+	/* Without a device node the maps could not be opened anyway */
+	if (dev_numbers(uio_number, &major_number, &minor_number)) {
+		return;
+	}
+	snprintf(path, sizeof(path), "uio%d/maps", uio_number);
+	maps_fd = openat(root_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (maps_fd < 0) {
+		return;
+	}
+	/* fdopendir() takes ownership, so hand it a copy */
+	maps_dir = fdopendir(dup(maps_fd));
+	if (!maps_dir) {
+		close(maps_fd);
+		return;
+	}
+
+	while ((ent = readdir(maps_dir))) {
+		if (sscanf(ent->d_name, "map%d%c", &map_number, &extra) != 1) {
+			continue;
+		}
+		if (index->count == BRAM_INDEX_MAX_MAPS) {
+			fprintf(stderr, "Warning: More than %d maps, ignoring the rest\n",
+					BRAM_INDEX_MAX_MAPS);
+			break;
+		}
+		map_fd = openat(maps_fd, ent->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (map_fd < 0) {
+			continue;
+		}
+		entry = &index->entries[index->count];
+		memset(entry, 0, sizeof(*entry));
+		entry->uio_number = uio_number;
+		entry->map_number = map_number;
+		entry->major = major_number;
+		entry->minor = minor_number;
+		if (!read_attr_hex(map_fd, "addr", &entry->map_addr) &&
+				!read_attr_hex(map_fd, "offset", &entry->map_offset) &&
+				!read_attr_hex(map_fd, "size", &entry->map_size) &&
+				!read_attr(map_fd, "name", entry->map_name,
+					sizeof(entry->map_name))) {
+			entry->map_width = BRAM_AXI_CTRL_WIDTH;
+			entry->narrow_burst = 1;
+			dt_size = entry->map_size;
+			bram_read_dt_props(uio_number, map_number, &entry->map_width,
+					&entry->narrow_burst, &dt_size);
+			if (dt_size && (dt_size < entry->map_size)) {
+				entry->map_size = dt_size;
+			}
+			index->count++;
+		}
+		close(map_fd);
+	}
+	closedir(maps_dir);
+	close(maps_fd);
+	return;
+}
+
+int bram_index_scan(struct bram_index *index)
+{
+	struct dirent *ent;
+	DIR *root_dir = NULL;
+	int root_fd;
+	int uio_number;
+	char extra;
+
+	index->count = 0;
+	root_fd = open(bram_sysfs_root(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (root_fd < 0) {
+		fprintf(stderr, "Error: Could not open %s: %s\n", bram_sysfs_root(),
+				strerror(errno));
+		return -1;
+	}
+	root_dir = fdopendir(dup(root_fd));
+	if (!root_dir) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		close(root_fd);
+		return -1;
+	}
+	while ((ent = readdir(root_dir))) {
+		if (sscanf(ent->d_name, "uio%d%c", &uio_number, &extra) != 1) {
+			continue;
+		}
+		scan_device(index, root_fd, uio_number);
+	}
+	closedir(root_dir);
+	close(root_fd);
+
+	/* Directory order is arbitrary, so keep listings stable */
+	qsort(index->entries, index->count, sizeof(index->entries[0]),
+			compare_entries);
+	return 0;
+}
+
+int bram_index_load(struct bram_index *index, const char *path)
+{
+	struct bram_index_header header;
+	unsigned int major_number;
+	unsigned int minor_number;
+	int checked_uio = -1;
+	size_t size;
+	ssize_t result;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	result = read(fd, &header, sizeof(header));
+	if ((result != sizeof(header)) ||
+			memcmp(header.magic, BRAM_INDEX_MAGIC, sizeof(header.magic)) ||
+			(header.entry_size != sizeof(index->entries[0])) ||
+			(header.count > BRAM_INDEX_MAX_MAPS)) {
+		close(fd);
+		return -1;
+	}
+	size = header.count * sizeof(index->entries[0]);
+	result = read(fd, index->entries, size);
+	close(fd);
+	if ((result < 0) || ((size_t) result != size)) {
+		return -1;
+	}
+	index->count = header.count;
+
+	/* Entries are sorted, so each device only needs checking once */
+	for (size_t i = 0; i < index->count; i++) {
+		if (index->entries[i].uio_number == checked_uio) {
+			continue;
+		}
+		checked_uio = index->entries[i].uio_number;
+		if (dev_numbers(checked_uio, &major_number, &minor_number) ||
+				(major_number != index->entries[i].major) ||
+				(minor_number != index->entries[i].minor)) {
+			index->count = 0;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int bram_index_save(const struct bram_index *index, const char *path)
+{
+	struct bram_index_header header;
+	char tmp_path[BRAM_MAP_PATH_SIZE];
+	size_t size;
+	ssize_t result;
+	int fd;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BRAM_INDEX_MAGIC, sizeof(header.magic));
+	header.entry_size = sizeof(index->entries[0]);
+	header.count = index->count;
+	size = index->count * sizeof(index->entries[0]);
+
+	/* Write a private copy and rename it so readers never see a partial file */
+	result = snprintf(tmp_path, sizeof(tmp_path), "%s.%ld", path, (long) getpid());
+	if ((result < 0) || (result >= (ssize_t) sizeof(tmp_path))) {
+		return -1;
+	}
+	fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	if ((write(fd, &header, sizeof(header)) != sizeof(header)) ||
+			(write(fd, index->entries, size) != (ssize_t) size)) {
+		close(fd);
+		unlink(tmp_path);
+		return -1;
+	}
+	if (close(fd) || rename(tmp_path, path)) {
+		unlink(tmp_path);
+		return -1;
+	}
+	return 0;
+}
+
+int bram_index_get(struct bram_index *index, int rescan)
+{
+	if (!rescan && !bram_index_load(index, bram_index_cache_path())) {
+		return 0;
+	}
+	if (bram_index_scan(index)) {
+		return -1;
+	}
+	bram_index_save(index, bram_index_cache_path());
+	return 0;
+}
+
+const struct bram_map_entry *bram_index_find_name(const struct bram_index *index,
+		const char *map_name)
+{
+	for (size_t i = 0; i < index->count; i++) {
+		if (!strcmp(index->entries[i].map_name, map_name)) {
+			return &index->entries[i];
+		}
+	}
+	return NULL;
+}
+
+const struct bram_map_entry *bram_index_find_addr(const struct bram_index *index,
+		uint32_t map_addr)
+{
+	for (size_t i = 0; i < index->count; i++) {
+		if (index->entries[i].map_addr == map_addr) {
+			return &index->entries[i];
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,56 @@
+#ifndef BRAM_DISCOVER_H
+#define BRAM_DISCOVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bram_resource.h"
+
+/* Upper bound on the number of maps across every UIO device on the system */
+#define BRAM_INDEX_MAX_MAPS		64
+
+/* Everything needed to open a map without going back to sysfs */
+struct bram_map_entry {
+	int uio_number;
+	int map_number;
+	/* Device numbers of /dev/uioN when the index was built */
+	unsigned int major;
+	unsigned int minor;
+	uint32_t map_addr;
+	uint32_t map_offset;
+	uint32_t map_size;
+	/* Controller properties from the device tree, see bram_resource.h */
+	uint32_t map_width;
+	int narrow_burst;
+	char map_name[BRAM_MAP_NAME_SIZE];
+};
+
+struct bram_index {
+	size_t count;
+	struct bram_map_entry entries[BRAM_INDEX_MAX_MAPS];
+};
+
+/* Walk the sysfs tree once and record every map of every UIO device */
+int bram_index_scan(struct bram_index *index);
+
+/*
+ * Binary cache of the index so that repeated invocations do not have to walk
+ * sysfs again. A cache is only accepted if the device numbers of every UIO
+ * node it mentions still match, which catches new kernels and device trees.
+ */
+int bram_index_load(struct bram_index *index, const char *path);
+int bram_index_save(const struct bram_index *index, const char *path);
+const char *bram_index_cache_path(void);
+
+/*
+ * Fill the index from the cache if it is still valid, otherwise scan sysfs
+ * and refresh the cache. Failing to write the cache is not an error.
+ */
+int bram_index_get(struct bram_index *index, int rescan);
+
+const struct bram_map_entry *bram_index_find_name(const struct bram_index *index,
+		const char *map_name);
+const struct bram_map_entry *bram_index_find_addr(const struct bram_index *index,
+		uint32_t map_addr);
+
+#endif /* BRAM_DISCOVER_H */
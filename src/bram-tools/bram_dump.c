@@ -1,54 +1,452 @@
+#define _GNU_SOURCE
 #include <assert.h>
 #include <ctype.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <getopt.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_access.h"
+#include "bram_hash.h"
+#include "bram_image.h"
+#include "bram_hexdump.h"
+#include "bram_snapshot.h"
+#include "bram_pipe.h"
+#include "bram_split.h"
+
+/* Dumps are written out in chunks of this size, aligned to the chunk size */
+#define DUMP_CHUNK_SIZE		(64 * 1024)
+
+/* Long options without a short equivalent */
+enum {
+	OPT_XXH64 = 0x100,
+	OPT_BIG_ENDIAN,
+	OPT_STATS,
+	OPT_CHUNK,
+	OPT_DEPTH,
+	OPT_CPUS,
+	OPT_WAIT,
+};
+
+/* Pipelined reads, see bram_pipe.h, with a depth of 0 when not asked for */
+struct dump_pipe {
+	size_t chunk_size;
+	unsigned int depth;
+};
+
+/* Checksums requested on the command line, updated as the data goes out */
+struct dump_hash {
+	bool crc32;
+	bool xxh64;
+	uint32_t crc;
+	struct bram_xxh64_state xxh;
+};
+
+/* Where each chunk of the range goes once it is out of the block RAM */
+struct dump_sink {
+	struct bram_resource *bram;
+	int fd;
+	struct dump_hash *hash;
+	struct bram_hexdump *hexdump;
+};
 
 void print_usage() {
-	printf("Usage: bram_dump [-o OUTFILE] DEVICE MAP\n");
+	printf("Usage: bram_dump [-o OUTFILE] [-c|--crc32] [--xxh64] [-S|--sparse] "
+			"[-x [-g BITS] [--big-endian]] [-P [--chunk SIZE] [--depth N]] "
+			"[-j THREADS] [--cpus LIST] DEVICE MAP [START [LENGTH]]\n");
 	printf("\n");
 	printf("Options:\n");
 	printf("  %-15s%-30s\n", "-h", "display program usage");
 	printf("  %-15s%-30s\n", "-o OUTFILE", "dump to OUTFILE instead of stdout");
+	printf("  %-15s%-30s\n", "-c, --crc32", "print the CRC-32 of the range");
+	printf("  %-15s%-30s\n", "--xxh64", "print the XXH64 of the range");
+	printf("  %-15s%-30s\n", "-S, --sparse", "write a sparse image with zero runs");
+	printf("  %-15s%-30s\n", "", "left out, for bram_load IMAGE");
+	printf("  %-15s%-30s\n", "-x, --hex", "write a hexdump -C style listing");
+	printf("  %-15s%-30s\n", "-g BITS", "group the listing in 8, 16 or 32-bit words");
+	printf("  %-15s%-30s\n", "--big-endian", "show words in memory byte order");
+	printf("  %-15s%-30s\n", "-P, --pipeline", "read the map ahead on a helper thread");
+	printf("  %-15s%-30s\n", "--chunk SIZE", "bytes per pipelined read, in hex "
+			"(default 10000)");
+	printf("  %-15s%-30s\n", "--depth N", "chunks read ahead of the output "
+			"(default 4)");
+	printf("  %-15s%-30s\n", "-j THREADS", "read the range on THREADS threads at once");
+	printf("  %-15s%-30s\n", "--cpus LIST", "pin the threads to the CPUs in LIST,");
+	printf("  %-15s%-30s\n", "", "e.g. 0,1 or 0-1, one thread per CPU");
+	printf("  %-15s%-30s\n", "", "unless -j says otherwise");
+	printf("  %-15s%-30s\n", "--wait MS", "give up on a locked map after MS ms");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase to stderr");
+	printf("\n");
+	printf("With a checksum and no OUTFILE only the checksum is printed, after\n");
+	printf("the listing with -x. Repeated lines of the listing show as `*'.\n");
 	printf("\n");
 	return;
 }
 
-int write_bram_data(struct bram_resource *bram, FILE *stream)
+/* Length of the next chunk such that every chunk after the first is aligned */
+static size_t next_chunk(size_t pos, size_t remaining)
 {
-	uint32_t *map_pos = NULL;
-	uint32_t nchunks = 0;
-	size_t result = 0;
+	size_t len;
 
-	assert(bram && stream && bram->map);
+	len = DUMP_CHUNK_SIZE - (pos % DUMP_CHUNK_SIZE);
+	return (len < remaining) ? len : remaining;
+}
 
-	/* Until there is a compelling reason, bulk block RAM access is 32-bit */
-	if (bram->map_size % 4) {
-		fprintf(stderr, "Block RAM map sizes need to be multiples of 4 bytes.\n");
-		return -1;
+/* Plain write() loop for terminals, sockets and anything else */
+static int dump_to_stream(const uint8_t *src, size_t offset, size_t len, int fd)
+{
+	size_t pos = offset;
+	size_t end = offset + len;
+	ssize_t result;
+
+	while (pos != end) {
+		result = write(fd, src + pos, next_chunk(pos, end - pos));
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			return -1;
+		}
+		pos += result;
 	}
+	return 0;
+}
+
+/*
+ * Pipes get the mapping spliced straight into them with no intermediate copy.
+ * The pipe holds references to the mapped pages, so a reader sees the memory
+ * as it is when the data is consumed, not when it was spliced. Device memory
+ * mapped by the UIO driver has no struct page behind it and the kernel will
+ * refuse to splice it, in which case we quietly fall back to write().
+ */
+static int dump_to_pipe(const uint8_t *src, size_t offset, size_t len, int fd)
+{
+	size_t pos = offset;
+	size_t end = offset + len;
+	struct iovec iov;
+	ssize_t result;
 
-	nchunks = (bram->map_size) >> 2;
-	map_pos = bram->map;
-	/* Again, here we do access in 4-byte chunks */
-	result = fwrite(map_pos, 4, nchunks, stream);
-	if (fflush(stream)) {
-		fprintf(stderr, "Failed to flush stream: %s\n", strerror(errno));
+	while (pos != end) {
+		iov.iov_base = (void *) (src + pos);
+		iov.iov_len = next_chunk(pos, end - pos);
+		result = vmsplice(fd, &iov, 1, 0);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno == EFAULT) || (errno == EINVAL) || (errno == ENOSYS)) {
+				return dump_to_stream(src, pos, end - pos, fd);
+			}
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			return -1;
+		}
+		pos += result;
+	}
+	return 0;
+}
+
+/*
+ * Regular files are preallocated for the whole range and then filled with
+ * pwrite() at explicit offsets relative to wherever the descriptor currently
+ * points, so that redirected stdout is handled the same way as -o.
+ */
+static int dump_to_file(const uint8_t *src, size_t offset, size_t len, int fd)
+{
+	off_t base;
+	size_t pos = offset;
+	size_t end = offset + len;
+	ssize_t result;
+
+	base = lseek(fd, 0, SEEK_CUR);
+	if (base < 0) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
 		return -1;
 	}
-	if (result != nchunks) {
-		fprintf(stderr, "Stream error. Expected %zu transfers, but performed %zu.\n",
-				nchunks, result);
+	/* Not every filesystem supports this, so it is only advisory */
+	posix_fallocate(fd, base, len);
+
+	while (pos != end) {
+		result = pwrite(fd, src + pos, next_chunk(pos, end - pos),
+				base + (pos - offset));
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			return -1;
+		}
+		pos += result;
+	}
+	/* Leave the file offset where a sequential write would have */
+	if (lseek(fd, base + len, SEEK_SET) < 0) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
 		return -1;
 	}
 	return 0;
 }
 
+/* Checksum a chunk and write it out, as hex lines with a hexdump */
+static int dump_chunk(void *arg, const uint8_t *buf, size_t len)
+{
+	struct dump_sink *sink = arg;
+	uint64_t t_file;
+	int result = 0;
+
+	if (sink->hash && sink->hash->crc32) {
+		sink->hash->crc = bram_crc32(sink->hash->crc, buf, len);
+	}
+	if (sink->hash && sink->hash->xxh64) {
+		bram_xxh64_update(&sink->hash->xxh, buf, len);
+	}
+	t_file = bram_perf_start(sink->bram->perf);
+	if (sink->hexdump) {
+		result = bram_hexdump_feed(sink->hexdump, buf, len);
+	} else if (sink->fd >= 0) {
+		result = dump_to_stream(buf, 0, len, sink->fd);
+	}
+	bram_perf_record(sink->bram->perf, BRAM_PHASE_FILE, t_file,
+			(!result && (sink->fd >= 0)) ? len : 0);
+	return result;
+}
+
+static int dump_finish(struct dump_sink *sink)
+{
+	uint64_t t_file;
+	int result;
+
+	if (!sink->hexdump) {
+		return 0;
+	}
+	t_file = bram_perf_start(sink->bram->perf);
+	result = bram_hexdump_finish(sink->hexdump);
+	bram_perf_record(sink->bram->perf, BRAM_PHASE_FILE, t_file, 0);
+	return result;
+}
+
+/*
+ * Checksumming and formatting have to look at the data anyway, so they work
+ * on a snapshot of each chunk rather than letting their loops loose on device
+ * memory
+ */
+static int dump_buffered(struct dump_sink *sink, size_t start, size_t len)
+{
+	struct bram_snapshot snap;
+	size_t pos = start;
+	size_t end = start + len;
+	size_t chunk;
+	int retval = 0;
+
+	bram_snapshot_init(&snap, sink->bram);
+	while (pos != end) {
+		chunk = next_chunk(pos, end - pos);
+		if (bram_snapshot_take(&snap, pos, chunk, NULL) ||
+				dump_chunk(sink, snap.data, chunk)) {
+			retval = -1;
+			break;
+		}
+		pos += chunk;
+	}
+	if (!retval) {
+		retval = dump_finish(sink);
+	}
+	bram_snapshot_free(&snap);
+	return retval;
+}
+
+/* Source of bram_pipe_run(), copying consecutive chunks out of the map */
+struct map_reader {
+	struct bram_resource *bram;
+	size_t pos;
+	size_t end;
+};
+
+static ssize_t read_map_chunk(void *arg, uint8_t *buf, size_t len)
+{
+	struct map_reader *reader = arg;
+
+	len = (len < (reader->end - reader->pos)) ? len : (reader->end - reader->pos);
+	if (len && bram_read_range(reader->bram, reader->pos, buf, len, NULL)) {
+		return -1;
+	}
+	reader->pos += len;
+	return (ssize_t) len;
+}
+
+/*
+ * The helper thread copies the range out of the block RAM chunk by chunk
+ * while the output of the previous chunks is still being written, so a slow
+ * card or pipe does not hold up the bus and the other way round. The ring
+ * takes the place of the snapshot, every path goes through it.
+ */
+static int dump_pipelined(struct dump_sink *sink, size_t start, size_t len,
+		const struct dump_pipe *pipe)
+{
+	struct map_reader reader;
+
+	reader.bram = sink->bram;
+	reader.pos = start;
+	reader.end = start + len;
+	if (bram_pipe_run(pipe->chunk_size, pipe->depth, read_map_chunk, &reader,
+				dump_chunk, sink)) {
+		return -1;
+	}
+	return dump_finish(sink);
+}
+
+/*
+ * Staging buffer the slices of a split dump are read into, with buf standing
+ * for map offset start, which is aligned to BRAM_SPLIT_ALIGN
+ */
+struct dump_stage {
+	uint8_t *buf;
+	size_t start;
+};
+
+static int read_slice(struct bram_split_slice *slice, void *arg)
+{
+	struct dump_stage *stage = arg;
+
+	return bram_read_range(&slice->bram, slice->offset,
+			stage->buf + (slice->offset - stage->start), slice->len,
+			&slice->stats);
+}
+
+/*
+ * The whole range is read into one staging buffer by the threads of split,
+ * each into its own cache line aligned part of it, and only then written out.
+ * How long each thread took goes to stderr, stdout may be carrying the dump.
+ */
+static int dump_split(struct dump_sink *sink, size_t start, size_t len,
+		struct bram_split *split)
+{
+	struct dump_stage stage;
+	size_t pad = start % BRAM_SPLIT_ALIGN;
+	void *buf;
+	int retval = -1;
+
+	/* Padded at the front so that slice boundaries fall on cache lines */
+	if (posix_memalign(&buf, BRAM_SPLIT_ALIGN, pad + (len ? len : 1))) {
+		fprintf(stderr, "Error: Could not allocate %zu bytes\n", len);
+		return -1;
+	}
+	stage.buf = buf;
+	stage.start = start - pad;
+	if (bram_split_run(split, sink->bram, start, len, read_slice, &stage)) {
+		goto out;
+	}
+	bram_split_print(stderr, split);
+	if (len && dump_chunk(sink, stage.buf + pad, len)) {
+		goto out;
+	}
+	retval = dump_finish(sink);
+
+out:
+	free(buf);
+	return retval;
+}
+
+/*
+ * Sparse images have to know their segment count up front, so the range is
+ * snapshotted once and split twice, first to count and then to write
+ */
+static int dump_sparse(struct bram_resource *bram, size_t start, size_t len,
+		int fd)
+{
+	struct bram_snapshot snap;
+	const uint8_t *buf;
+	size_t stored = 0;
+	long count;
+	uint64_t t_file;
+	int retval = -1;
+
+	if ((start > bram->map_size) || (len > (bram->map_size - start))) {
+		fprintf(stderr, "Error: Dump range exceeds map size\n");
+		return -1;
+	}
+	bram_snapshot_init(&snap, bram);
+	if (bram_snapshot_take(&snap, start, len, NULL)) {
+		goto out;
+	}
+	buf = bram_snapshot_ptr(&snap, start, len);
+	count = bram_image_split(buf, len, start, NULL, NULL);
+	t_file = bram_perf_start(bram->perf);
+	if (bram_image_write_header(fd, (uint32_t) count) ||
+			(bram_image_write_range(fd, bram->map_name, buf, len, start,
+						&stored) < 0)) {
+		goto out;
+	}
+	bram_perf_record(bram->perf, BRAM_PHASE_FILE, t_file, stored);
+	/* stdout may be carrying the image itself */
+	fprintf(stderr, "Wrote %ld segments, %zu of %zu bytes stored\n", count,
+			stored, len);
+	retval = 0;
+
+out:
+	bram_snapshot_free(&snap);
+	return retval;
+}
+
+/*
+ * Dump the range to fd, updating any checksums in hash along the way. With a
+ * hash, fd may be -1 to compute the checksums without writing anything. With
+ * a hexdump the range is written out formatted by it instead of raw.
+ */
+int write_bram_data(struct bram_resource *bram, size_t start, size_t len, int fd,
+		struct dump_hash *hash, struct bram_hexdump *hexdump,
+		const struct dump_pipe *pipe, struct bram_split *split)
+{
+	struct dump_sink sink = { bram, fd, hash, hexdump };
+	struct stat sb;
+	int result;
+
+	assert(bram && bram->map && ((fd >= 0) || hash));
+
+	if ((start > bram->map_size) || (len > (bram->map_size - start))) {
+		fprintf(stderr, "Error: Dump range exceeds map size\n");
+		return -1;
+	}
+	if (split) {
+		return dump_split(&sink, start, len, split);
+	}
+	if (pipe->depth) {
+		return dump_pipelined(&sink, start, len, pipe);
+	}
+	/*
+	 * The direct paths below also need the whole range mapped at once, and
+	 * read the block RAM from inside write(), where --stats could not tell
+	 * bus time from file time
+	 */
+	if (hash || hexdump || bram->windowed || bram->perf) {
+		return dump_buffered(&sink, start, len);
+	}
+	if (fstat(fd, &sb)) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+
+	if (S_ISFIFO(sb.st_mode)) {
+		result = dump_to_pipe(bram->map, start, len, fd);
+	} else if (S_ISREG(sb.st_mode)) {
+		result = dump_to_file(bram->map, start, len, fd);
+	} else {
+		result = dump_to_stream(bram->map, start, len, fd);
+	}
+	return result;
+}
+
 int main(int argc, char *argv[])
 {
 	int result;
@@ -56,18 +454,123 @@ int main(int argc, char *argv[])
 
 	char *filename = NULL;
 	bool to_stdout = true;
-	FILE *outfile = NULL;
+	int outfd = -1;
+	struct dump_hash hash;
+	bool hashing;
+	bool sparse = false;
+	bool hex = false;
+	unsigned int group = 8;
+	bool little_endian = true;
+	struct bram_hexdump *hexdump = NULL;
+	char *endptr = NULL;
+	unsigned long value;
+	struct bram_perf perf;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+	struct bram_lock lock;
+	struct dump_pipe pipe = { BRAM_PIPE_DEFAULT_CHUNK, 0 };
+	unsigned int depth = BRAM_PIPE_DEFAULT_DEPTH;
+	bool pipelined = false;
+	struct bram_split split;
+	bool splitting = false;
+
+	static const struct option long_options[] = {
+		{ "crc32", no_argument, NULL, 'c' },
+		{ "xxh64", no_argument, NULL, OPT_XXH64 },
+		{ "sparse", no_argument, NULL, 'S' },
+		{ "hex", no_argument, NULL, 'x' },
+		{ "group", required_argument, NULL, 'g' },
+		{ "big-endian", no_argument, NULL, OPT_BIG_ENDIAN },
+		{ "pipeline", no_argument, NULL, 'P' },
+		{ "chunk", required_argument, NULL, OPT_CHUNK },
+		{ "depth", required_argument, NULL, OPT_DEPTH },
+		{ "cpus", required_argument, NULL, OPT_CPUS },
+		{ "wait", required_argument, NULL, OPT_WAIT },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
 
 	struct bram_resource bram;
 	int uio_number;
 	int map_number;
+	size_t start_addr = 0;
+	size_t length = 0;
+	bool length_given = false;
+	int num_pos_args;
 
 	int opt;
-	while ((opt = getopt(argc, argv, "ho:")) != -1) {
+
+	bram_perf_init(&perf);
+	bram_split_init(&split, 0);
+	memset(&hash, 0, sizeof(hash));
+	bram_xxh64_init(&hash.xxh, 0);
+	bram_lock_init(&lock, BRAM_LOCK_SHARED);
+	while ((opt = getopt_long(argc, argv, "ho:cSxg:Pj:", long_options, NULL)) != -1) {
 		switch (opt) {
 			case 'h':
 				print_usage();
 				return 0;
+			case 'c':
+				hash.crc32 = true;
+				break;
+			case OPT_XXH64:
+				hash.xxh64 = true;
+				break;
+			case 'S':
+				sparse = true;
+				break;
+			case 'x':
+				hex = true;
+				break;
+			case 'g':
+				errno = 0;
+				value = strtoul(optarg, &endptr, 10);
+				if (errno || (endptr == optarg) || *endptr ||
+						((value != 8) && (value != 16) && (value != 32))) {
+					fprintf(stderr, "Error: Group width has to be 8, 16 or 32 bits\n");
+					return 1;
+				}
+				group = (unsigned int) value;
+				break;
+			case OPT_BIG_ENDIAN:
+				little_endian = false;
+				break;
+			case OPT_WAIT:
+				if (bram_lock_parse_wait(&lock.timeout_ms, optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				break;
+			case 'P':
+				pipelined = true;
+				break;
+			case OPT_CHUNK:
+				if (bram_pipe_parse_chunk(&pipe.chunk_size, optarg)) {
+					return 1;
+				}
+				pipelined = true;
+				break;
+			case OPT_DEPTH:
+				if (bram_pipe_parse_depth(&depth, optarg)) {
+					return 1;
+				}
+				pipelined = true;
+				break;
+			case 'j':
+				if (bram_split_parse_threads(&split, optarg)) {
+					return 1;
+				}
+				splitting = true;
+				break;
+			case OPT_CPUS:
+				if (bram_split_parse_cpus(&split, optarg)) {
+					return 1;
+				}
+				splitting = true;
+				break;
 			case 'o':
 				to_stdout = false;
 				/* 
@@ -79,6 +582,10 @@ int main(int argc, char *argv[])
 			case '?':
 				if (optopt == 'o') {
 					fprintf(stderr, "No output file specified\n");
+				} else if (optopt == 'g') {
+					fprintf(stderr, "No group width specified\n");
+				} else if (optopt == 'j') {
+					fprintf(stderr, "No thread count specified\n");
 				} else if (isprint(optopt)) {
 					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
 				} else {
@@ -90,29 +597,92 @@ int main(int argc, char *argv[])
 				return 1;
 		}
 	}
-	/* Require two additional positional arguments */
-	if ((argc - optind) != 2) {
+	/* Every segment of a sparse image already carries its own CRC */
+	if (sparse && (hash.crc32 || hash.xxh64)) {
+		fprintf(stderr, "Error: --sparse cannot be combined with checksums\n");
+		return 1;
+	}
+	if (sparse && hex) {
+		fprintf(stderr, "Error: --sparse cannot be combined with --hex\n");
+		return 1;
+	}
+	/* The image is written in one go once the whole range is split */
+	if (sparse && pipelined) {
+		fprintf(stderr, "Error: --sparse cannot be combined with --pipeline\n");
+		return 1;
+	}
+	if (sparse && splitting) {
+		fprintf(stderr, "Error: --sparse cannot be combined with threads\n");
+		return 1;
+	}
+	if (pipelined && splitting) {
+		fprintf(stderr, "Error: --pipeline cannot be combined with threads\n");
+		return 1;
+	}
+	if (pipelined) {
+		pipe.depth = depth;
+	}
+	/* Require at least 2 and at most 4 positional arguments */
+	num_pos_args = argc - optind;
+	if ((num_pos_args < 2) || (num_pos_args > 4)) {
 		print_usage();
 		return 1;
-	} else {
-		/*
-		 * TODO verify that map and UIO numbers are non-negative and do
-		 * not use atoi() for this
-		 */
-		uio_number = atoi(argv[optind]);
-		map_number = atoi(argv[optind + 1]);
+	}
+	/*
+	 * TODO verify that map and UIO numbers are non-negative and do
+	 * not use atoi() for this
+	 */
+	uio_number = atoi(argv[optind]);
+	map_number = atoi(argv[optind + 1]);
+	if (num_pos_args > 2) {
+		if (str_to_size(&start_addr, argv[optind + 2])) {
+			fprintf(stderr, "Error: Bad starting address\n");
+			return 1;
+		}
+	}
+	if (num_pos_args > 3) {
+		if (str_to_size(&length, argv[optind + 3])) {
+			fprintf(stderr, "Error: Bad length\n");
+			return 1;
+		}
+		length_given = true;
+	}
+	/* Checked again by the formatter, but before anything is mapped here */
+	if (hex && (start_addr % (group / 8))) {
+		fprintf(stderr, "Error: START has to be a multiple of %u bytes with "
+				"-g %u\n", group / 8, group);
+		return 1;
 	}
 
-	result = bram_create(&bram, uio_number, map_number);
+	/* Only the range being read has to stay put */
+	lock.offset = start_addr;
+	lock.len = length_given ? length : 0;
+	result = bram_create_locked(&bram, uio_number, map_number,
+			stats_format ? &perf : NULL, &lock);
+	split.perf = stats_format ? &perf : NULL;
 	if (result) {
 		fprintf(stderr, "Could not create block RAM resource for UIO device %d "
 				"or map number %d\n", uio_number, map_number);
 		return 1;
 	}
 
+	/* Without a length, dump everything from the start address onwards */
+	if (!length_given) {
+		if (start_addr > bram.map_size) {
+			fprintf(stderr, "Error: Start address exceeds map size\n");
+			bram_destroy(&bram);
+			return 1;
+		}
+		length = bram.map_size - start_addr;
+	}
+
 	/* Now that we have access to block RAM resource, we can open files */
-	if (to_stdout) {
-		outfile = stdout;
+	hashing = hash.crc32 || hash.xxh64;
+	if (to_stdout && hashing && !hex) {
+		/* Only the checksum line goes to stdout, the data goes nowhere */
+		outfd = -1;
+	} else if (to_stdout) {
+		outfd = STDOUT_FILENO;
 		/* Write status to stderr so we don't pollute stdout */
 		fprintf(stderr, "Dumping block RAM to stdout\n");
 		/* 
@@ -126,29 +696,64 @@ int main(int argc, char *argv[])
 		fflush(stderr);
 	} else {
 		fprintf(stdout, "Dumping block RAM to %s\n", filename);
-		outfile = fopen(filename, "w+");
+		fflush(stdout);
+		outfd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 	}
-	if (!outfile) {
+	if ((outfd < 0) && !(to_stdout && hashing && !hex)) {
 		fprintf(stderr, "Could not open output for writing\n");
+		bram_destroy(&bram);
 		return 1;
 	}
 
 	/* Can have a non-zero return value for any number of reasons */
 	retval = 0;
-	/* Dump the entire block RAM to the output stream that was indicated */
-	result = write_bram_data(&bram, outfile);
+	/* Dump the requested range to the output that was indicated */
+	if (sparse) {
+		result = dump_sparse(&bram, start_addr, length, outfd);
+	} else if (hex) {
+		/* Too big for the stack with everything else main() holds */
+		hexdump = malloc(sizeof(*hexdump));
+		if (!hexdump) {
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			result = -1;
+		} else {
+			result = bram_hexdump_init(hexdump, outfd, group, little_endian,
+					start_addr);
+			if (!result) {
+				result = write_bram_data(&bram, start_addr, length, outfd,
+						hashing ? &hash : NULL, hexdump, &pipe,
+						splitting ? &split : NULL);
+			}
+			free(hexdump);
+		}
+	} else {
+		result = write_bram_data(&bram, start_addr, length, outfd,
+				hashing ? &hash : NULL, NULL, &pipe,
+				splitting ? &split : NULL);
+	}
 	if (result) {
 		fprintf(stderr, "Could not dump block RAM resource\n");
 		retval = 1;
+	} else {
+		/* One line per checksum so scripts can compare boards directly */
+		if (hash.crc32) {
+			printf("crc32 %08"PRIx32"\n", hash.crc);
+		}
+		if (hash.xxh64) {
+			printf("xxh64 %016"PRIx64"\n", bram_xxh64_digest(&hash.xxh));
+		}
 	}
 	if (bram_destroy(&bram)) {
 		fprintf(stderr, "Could not destroy block RAM resource\n");
 		retval = 1;
 	}
-	if (fclose(outfile)) {
+	if (!to_stdout && close(outfd)) {
 		fprintf(stderr, "%s\n", strerror(errno));
 		retval = 1;
 	}
+	if (stats_format) {
+		bram_perf_print(stderr, "bram_dump", &perf, stats_format);
+	}
 	return retval;
 }
 
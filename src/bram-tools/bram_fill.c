@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bram_resource.h"
+#include "bram_access.h"
+#include "bram_fill.h"
+
+/*
+ * Patterns are generated into a cached block this many words long and then
+ * pushed out with the widest stores bram_write_range() has available
+ */
+#define FILL_BLOCK_WORDS		256
+
+/* Checkerboard patterns begin with this and complement it each byte */
+#define XBOARD_START			0x55U
+/* Taps for x^32 + x^22 + x^2 + x + 1, a maximal length polynomial */
+#define LFSR_TAPS			0x80200003U
+#define LFSR_DEFAULT_SEED		0xace1ace1U
+
+/*
+ * Each generator returns the little-endian word for the aligned word at
+ * word_addr, where start is the first byte of the range being filled
+ */
+typedef uint32_t (*pattern_fn)(const struct bram_fill_spec *spec, size_t start,
+		size_t word_addr, uint32_t *state);
+
+static uint32_t gen_value(const struct bram_fill_spec *spec, size_t start,
+		size_t word_addr, uint32_t *state)
+{
+	(void) start;
+	(void) word_addr;
+	(void) state;
+	return 0x01010101U * spec->value;
+}
+
+static uint32_t gen_xboard(const struct bram_fill_spec *spec, size_t start,
+		size_t word_addr, uint32_t *state)
+{
+	(void) spec;
+	(void) state;
+	/* Bytes alternate, so only the parity relative to the start matters */
+	if ((word_addr - start) & 0x1) {
+		return (0x01010101U * XBOARD_START) ^ 0x00ff00ffU;
+	}
+	return (0x01010101U * XBOARD_START) ^ 0xff00ff00U;
+}
+
+static uint32_t gen_incr(const struct bram_fill_spec *spec, size_t start,
+		size_t word_addr, uint32_t *state)
+{
+	(void) spec;
+	(void) start;
+	(void) state;
+	/* Word aligned, so the low byte never wraps inside a word */
+	return (0x01010101U * (uint32_t) (word_addr & 0xff)) + 0x03020100U;
+}
+
+static uint32_t gen_walking_ones(const struct bram_fill_spec *spec, size_t start,
+		size_t word_addr, uint32_t *state)
+{
+	uint32_t word = 0;
+	unsigned int bit;
+
+	(void) spec;
+	(void) state;
+	bit = (unsigned int) ((word_addr - start) & 0x7);
+	for (int i = 0; i < 4; i++) {
+		word |= (uint32_t) (1U << ((bit + i) & 0x7)) << (8 * i);
+	}
+	return word;
+}
+
+static uint32_t gen_address(const struct bram_fill_spec *spec, size_t start,
+		size_t word_addr, uint32_t *state)
+{
+	(void) spec;
+	(void) start;
+	(void) state;
+	return (uint32_t) word_addr;
+}
+
+static uint32_t gen_lfsr(const struct bram_fill_spec *spec, size_t start,
+		size_t word_addr, uint32_t *state)
+{
+	uint32_t word = *state;
+
+	(void) spec;
+	(void) start;
+	(void) word_addr;
+	*state = (*state >> 1) ^ (-(*state & 0x1U) & LFSR_TAPS);
+	return word;
+}
+
+static const struct {
+	const char *name;
+	pattern_fn gen;
+} patterns[] = {
+	[BRAM_PATTERN_VALUE]		= {"value",		gen_value},
+	[BRAM_PATTERN_XBOARD]		= {"checkerboard",	gen_xboard},
+	[BRAM_PATTERN_INCR]		= {"incrementing",	gen_incr},
+	[BRAM_PATTERN_WALKING_ONES]	= {"walking ones",	gen_walking_ones},
+	[BRAM_PATTERN_ADDRESS]		= {"address in address", gen_address},
+	[BRAM_PATTERN_LFSR]		= {"pseudo-random",	gen_lfsr},
+};
+
+const char *bram_pattern_name(enum bram_pattern pattern)
+{
+	if ((unsigned int) pattern >= (sizeof(patterns) / sizeof(patterns[0]))) {
+		return "unknown";
+	}
+	return patterns[pattern].name;
+}
+
+/*
+ * Generate the pattern of a fill starting at origin for the words covering
+ * len bytes at offset, handing each block to emit along with where its first
+ * byte lands. The LFSR is stepped over the words between origin and offset,
+ * so a piece comes out the same as it would in the middle of the whole fill.
+ */
+static int generate(struct bram_resource *bram, size_t origin, size_t offset,
+		size_t len, const struct bram_fill_spec *spec,
+		int (*emit)(struct bram_resource *bram, size_t offset,
+			const uint8_t *block, size_t len, void *arg),
+		void *arg)
+{
+	uint32_t block[FILL_BLOCK_WORDS];
+	pattern_fn gen;
+	uint32_t state;
+	size_t word_addr;
+	size_t end;
+	size_t nwords;
+	size_t lo;
+	size_t hi;
+
+	if (!bram || !spec) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if ((unsigned int) spec->pattern >= (sizeof(patterns) / sizeof(patterns[0]))) {
+		fprintf(stderr, "Error: Unknown fill pattern %d\n", spec->pattern);
+		return -1;
+	}
+	if ((offset > bram->map_size) || (len > (bram->map_size - offset))) {
+		fprintf(stderr, "Error: Fill of %zu bytes at 0x%zx exceeds map size\n",
+				len, offset);
+		return -1;
+	}
+	if (origin > offset) {
+		fprintf(stderr, "Error: Fill starts at 0x%zx, past 0x%zx\n", origin,
+				offset);
+		return -1;
+	}
+
+	gen = patterns[spec->pattern].gen;
+	state = spec->seed ? spec->seed : LFSR_DEFAULT_SEED;
+	if (spec->pattern == BRAM_PATTERN_LFSR) {
+		for (size_t i = origin & ~(size_t) 0x3; i < (offset & ~(size_t) 0x3);
+				i += 4) {
+			gen(spec, origin, i, &state);
+		}
+	}
+	end = offset + len;
+	/*
+	 * Generation always starts at the word containing the first byte, so
+	 * partial head and tail words take their bytes from the same words a
+	 * full-width fill would have written
+	 */
+	word_addr = offset & ~(size_t) 0x3;
+	while (word_addr < end) {
+		nwords = ((end - word_addr) + 3) / 4;
+		if (nwords > FILL_BLOCK_WORDS) {
+			nwords = FILL_BLOCK_WORDS;
+		}
+		for (size_t i = 0; i < nwords; i++) {
+			block[i] = gen(spec, origin, word_addr + (4 * i), &state);
+		}
+		lo = (word_addr < offset) ? offset : word_addr;
+		hi = word_addr + (4 * nwords);
+		hi = (hi > end) ? end : hi;
+		if (emit(bram, lo, (uint8_t *) block + (lo - word_addr), hi - lo, arg)) {
+			return -1;
+		}
+		word_addr += 4 * nwords;
+	}
+	return 0;
+}
+
+static int emit_write(struct bram_resource *bram, size_t offset,
+		const uint8_t *block, size_t len, void *arg)
+{
+	return bram_write_range(bram, offset, block, len, arg);
+}
+
+struct check_args {
+	size_t *mismatched;
+	struct bram_xfer_stats *stats;
+};
+
+/* Count every differing byte rather than stopping at the first */
+static int emit_check(struct bram_resource *bram, size_t offset,
+		const uint8_t *block, size_t len, void *arg)
+{
+	struct check_args *args = arg;
+	size_t pos = 0;
+	size_t equal;
+
+	while (pos != len) {
+		if (bram_compare_range(bram, offset + pos, block + pos, len - pos,
+					&equal, args->stats)) {
+			return -1;
+		}
+		pos += equal;
+		if (pos != len) {
+			(*args->mismatched)++;
+			pos++;
+		}
+	}
+	return 0;
+}
+
+int bram_fill_pattern(struct bram_resource *bram, size_t offset, size_t len,
+		const struct bram_fill_spec *spec, struct bram_xfer_stats *stats)
+{
+	return generate(bram, offset, offset, len, spec, emit_write, stats);
+}
+
+int bram_fill_slice(struct bram_resource *bram, size_t origin, size_t offset,
+		size_t len, const struct bram_fill_spec *spec,
+		struct bram_xfer_stats *stats)
+{
+	return generate(bram, origin, offset, len, spec, emit_write, stats);
+}
+
+int bram_check_slice(struct bram_resource *bram, size_t origin, size_t offset,
+		size_t len, const struct bram_fill_spec *spec, size_t *mismatched,
+		struct bram_xfer_stats *stats)
+{
+	struct check_args args = { mismatched, stats };
+
+	if (!mismatched) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	return generate(bram, origin, offset, len, spec, emit_check, &args);
+}
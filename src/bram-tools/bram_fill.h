@@ -0,0 +1,61 @@
+#ifndef BRAM_FILL_H
+#define BRAM_FILL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bram_resource.h"
+#include "bram_access.h"
+
+/*
+ * Every pattern is defined in terms of the byte address it lands at, so any
+ * sub-range filled on its own comes out identical to the same bytes of a fill
+ * over the whole map (apart from the ones relative to the start, noted below).
+ */
+enum bram_pattern {
+	/* Every byte is the same value */
+	BRAM_PATTERN_VALUE,
+	/* 0x55 at the start of the range, complemented every byte */
+	BRAM_PATTERN_XBOARD,
+	/* Low byte of each byte's own address */
+	BRAM_PATTERN_INCR,
+	/* A single set bit, moving up one position per byte from the start */
+	BRAM_PATTERN_WALKING_ONES,
+	/* Each 32-bit word holds its own byte offset into the map */
+	BRAM_PATTERN_ADDRESS,
+	/* 32-bit Galois LFSR stepped once per word, starting from the seed */
+	BRAM_PATTERN_LFSR,
+};
+
+struct bram_fill_spec {
+	enum bram_pattern pattern;
+	/* Only used by BRAM_PATTERN_VALUE */
+	uint8_t value;
+	/* Only used by BRAM_PATTERN_LFSR - zero is replaced with a default */
+	uint32_t seed;
+};
+
+const char *bram_pattern_name(enum bram_pattern pattern);
+
+/* Fill len bytes starting at offset with the requested pattern */
+int bram_fill_pattern(struct bram_resource *bram, size_t offset, size_t len,
+		const struct bram_fill_spec *spec, struct bram_xfer_stats *stats);
+
+/*
+ * Fill len bytes at offset as that part of a fill starting at origin, so that
+ * a range filled in pieces, possibly by several threads, comes out the same
+ * as filling it in one go. origin cannot be past offset.
+ */
+int bram_fill_slice(struct bram_resource *bram, size_t origin, size_t offset,
+		size_t len, const struct bram_fill_spec *spec,
+		struct bram_xfer_stats *stats);
+
+/*
+ * Compare len bytes at offset against what bram_fill_slice() would have
+ * written there, adding the number of bytes that differ to mismatched
+ */
+int bram_check_slice(struct bram_resource *bram, size_t origin, size_t offset,
+		size_t len, const struct bram_fill_spec *spec, size_t *mismatched,
+		struct bram_xfer_stats *stats);
+
+#endif /* BRAM_FILL_H */
@@ -0,0 +1,201 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "bram_hash.h"
+
+#define CRC32_POLY			0xedb88320U
+
+#define XXH_PRIME64_1			0x9e3779b185ebca87ULL
+#define XXH_PRIME64_2			0xc2b2ae3d27d4eb4fULL
+#define XXH_PRIME64_3			0x165667b19e3779f9ULL
+#define XXH_PRIME64_4			0x85ebca77c2b2ae63ULL
+#define XXH_PRIME64_5			0x27d4eb2f165667c5ULL
+
+/*
+ * Slice-by-8 tables - table[0] is the classic bytewise table and table[k]
+ * advances a byte through k more zero bytes, so eight input bytes can be
+ * folded in with eight independent lookups
+ */
+static uint32_t crc32_table[8][256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+static void crc32_init_tables(void)
+{
+	uint32_t crc;
+
+	for (uint32_t i = 0; i < 256; i++) {
+		crc = i;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ ((crc & 0x1) ? CRC32_POLY : 0);
+		}
+		crc32_table[0][i] = crc;
+	}
+	for (uint32_t i = 0; i < 256; i++) {
+		crc = crc32_table[0][i];
+		for (int k = 1; k < 8; k++) {
+			crc = (crc >> 8) ^ crc32_table[0][crc & 0xff];
+			crc32_table[k][i] = crc;
+		}
+	}
+	return;
+}
+
+static inline uint32_t read_le32(const uint8_t *p)
+{
+	return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+		((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline uint64_t read_le64(const uint8_t *p)
+{
+	return (uint64_t) read_le32(p) | ((uint64_t) read_le32(p + 4) << 32);
+}
+
+uint32_t bram_crc32(uint32_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	uint32_t lo;
+	uint32_t hi;
+
+	pthread_once(&crc32_once, crc32_init_tables);
+
+	crc = ~crc;
+	/* Byte at a time until the data is aligned for the wide loop */
+	while (len && ((uintptr_t) p & 0x3)) {
+		crc = (crc >> 8) ^ crc32_table[0][(crc ^ *p++) & 0xff];
+		len--;
+	}
+	while (len >= 8) {
+		lo = read_le32(p) ^ crc;
+		hi = read_le32(p + 4);
+		crc = crc32_table[7][lo & 0xff] ^
+			crc32_table[6][(lo >> 8) & 0xff] ^
+			crc32_table[5][(lo >> 16) & 0xff] ^
+			crc32_table[4][lo >> 24] ^
+			crc32_table[3][hi & 0xff] ^
+			crc32_table[2][(hi >> 8) & 0xff] ^
+			crc32_table[1][(hi >> 16) & 0xff] ^
+			crc32_table[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = (crc >> 8) ^ crc32_table[0][(crc ^ *p++) & 0xff];
+	}
+	return ~crc;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh64_round(0, val);
+	return (acc * XXH_PRIME64_1) + XXH_PRIME64_4;
+}
+
+void bram_xxh64_init(struct bram_xxh64_state *state, uint64_t seed)
+{
+	memset(state, 0, sizeof(*state));
+	state->seed = seed;
+	state->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+	state->v[1] = seed + XXH_PRIME64_2;
+	state->v[2] = seed;
+	state->v[3] = seed - XXH_PRIME64_1;
+	return;
+}
+
+/* Consume one 32 byte stripe */
+static void xxh64_stripe(struct bram_xxh64_state *state, const uint8_t *p)
+{
+	for (int i = 0; i < 4; i++) {
+		state->v[i] = xxh64_round(state->v[i], read_le64(p + 8 * i));
+	}
+	return;
+}
+
+void bram_xxh64_update(struct bram_xxh64_state *state, const void *buf,
+		size_t len)
+{
+	const uint8_t *p = buf;
+	size_t fill;
+
+	state->total_len += len;
+
+	/* Top up a partial stripe left over from the previous call first */
+	if (state->mem_size) {
+		fill = sizeof(state->mem) - state->mem_size;
+		if (len < fill) {
+			memcpy(state->mem + state->mem_size, p, len);
+			state->mem_size += len;
+			return;
+		}
+		memcpy(state->mem + state->mem_size, p, fill);
+		xxh64_stripe(state, state->mem);
+		p += fill;
+		len -= fill;
+		state->mem_size = 0;
+	}
+	while (len >= sizeof(state->mem)) {
+		xxh64_stripe(state, p);
+		p += sizeof(state->mem);
+		len -= sizeof(state->mem);
+	}
+	if (len) {
+		memcpy(state->mem, p, len);
+		state->mem_size = len;
+	}
+	return;
+}
+
+uint64_t bram_xxh64_digest(const struct bram_xxh64_state *state)
+{
+	const uint8_t *p = state->mem;
+	size_t len = state->mem_size;
+	uint64_t h;
+
+	if (state->total_len >= sizeof(state->mem)) {
+		h = rotl64(state->v[0], 1) + rotl64(state->v[1], 7) +
+			rotl64(state->v[2], 12) + rotl64(state->v[3], 18);
+		for (int i = 0; i < 4; i++) {
+			h = xxh64_merge_round(h, state->v[i]);
+		}
+	} else {
+		h = state->seed + XXH_PRIME64_5;
+	}
+	h += state->total_len;
+
+	while (len >= 8) {
+		h ^= xxh64_round(0, read_le64(p));
+		h = (rotl64(h, 27) * XXH_PRIME64_1) + XXH_PRIME64_4;
+		p += 8;
+		len -= 8;
+	}
+	if (len >= 4) {
+		h ^= (uint64_t) read_le32(p) * XXH_PRIME64_1;
+		h = (rotl64(h, 23) * XXH_PRIME64_2) + XXH_PRIME64_3;
+		p += 4;
+		len -= 4;
+	}
+	while (len--) {
+		h ^= (*p++) * XXH_PRIME64_5;
+		h = rotl64(h, 11) * XXH_PRIME64_1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,33 @@
+#ifndef BRAM_HASH_H
+#define BRAM_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Checksums for comparing block RAM contents without moving the contents
+ * around. Both are incremental so they can be computed while data streams
+ * through in chunks of any size.
+ */
+
+/*
+ * Standard reflected CRC-32 (as used by zlib, gzip and Ethernet). Start with
+ * a crc of zero and feed the previous result back in for each chunk.
+ */
+uint32_t bram_crc32(uint32_t crc, const void *buf, size_t len);
+
+/* XXH64, which is considerably faster than the CRC on wide machines */
+struct bram_xxh64_state {
+	uint64_t total_len;
+	uint64_t v[4];
+	uint8_t mem[32];
+	size_t mem_size;
+	uint64_t seed;
+};
+
+void bram_xxh64_init(struct bram_xxh64_state *state, uint64_t seed);
+void bram_xxh64_update(struct bram_xxh64_state *state, const void *buf,
+		size_t len);
+uint64_t bram_xxh64_digest(const struct bram_xxh64_state *state);
+
+#endif /* BRAM_HASH_H */
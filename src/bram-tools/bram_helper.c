@@ -1,3 +1,6 @@
+#define _POSIX_C_SOURCE 200809L
+/* For MAP_ANONYMOUS */
+#define _DEFAULT_SOURCE
 #include <ctype.h>
 #include <stdint.h>
 #include <inttypes.h>
@@ -6,8 +9,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -16,11 +21,50 @@
 
 #include "bram_resource.h"
 #include "bram_helper.h"
+#include "bram_kernels.h"
 
-/* Maximum lengths for paths to /dev and /sys entries */
-#define UIO_DEV_PATH_SIZE		16
-#define UIO_MAP_PATH_SIZE		32
-#define UIO_MAX_MAP_NAME_SIZE		64
+/*
+ * Default locations of the UIO device nodes and their sysfs attributes. Both
+ * can be redirected through the environment so that the tools can be run
+ * against a plain file or memfd and a fake sysfs tree off target.
+ */
+#define UIO_DEV_ROOT			"/dev"
+#define UIO_SYSFS_ROOT			"/sys/class/uio"
+#define UIO_DEV_ROOT_ENV		"BRAM_DEV_ROOT"
+#define UIO_SYSFS_ROOT_ENV		"BRAM_SYSFS_ROOT"
+
+/* Windowed maps go through this node under the device root */
+#define MEM_DEV_NAME			"mem"
+#define BRAM_WINDOW_THRESHOLD_ENV	"BRAM_WINDOW_THRESHOLD"
+#define BRAM_WINDOW_SIZE_ENV		"BRAM_WINDOW_SIZE"
+
+/* Device tree properties of the AXI BRAM controller */
+#define DT_PROP_DATA_WIDTH		"xlnx,s-axi-ctrl-data-width"
+#define DT_PROP_NARROW_BURST		"xlnx,s-axi-supports-narrow-burst"
+#define DT_PROP_REG			"reg"
+/* Most cells of a property that are looked at */
+#define DT_PROP_MAX_CELLS		32
+
+const char *bram_env_path(const char *env, const char *fallback)
+{
+	const char *root;
+
+	root = getenv(env);
+	if (!root || !*root) {
+		return fallback;
+	}
+	return root;
+}
+
+const char *bram_dev_root(void)
+{
+	return bram_env_path(UIO_DEV_ROOT_ENV, UIO_DEV_ROOT);
+}
+
+const char *bram_sysfs_root(void)
+{
+	return bram_env_path(UIO_SYSFS_ROOT_ENV, UIO_SYSFS_ROOT);
+}
 
 void print_bram_init_error(int uio_number, int map_number)
 {
@@ -32,10 +76,11 @@ void print_bram_init_error(int uio_number, int map_number)
 int bram_set_dev_info(struct bram_resource *bram)
 {
 	int result;
-	static char dev_path[UIO_DEV_PATH_SIZE];
+	char dev_path[BRAM_DEV_PATH_SIZE];
 	struct stat sb;
 
-	result = snprintf(dev_path, sizeof(dev_path), "/dev/uio%d", bram->uio_number);
+	result = snprintf(dev_path, sizeof(dev_path), "%s/uio%d",
+			bram_dev_root(), bram->uio_number);
 	if (result < 0) {
 		fprintf(stderr, "Output error\n");
 		return -1;
@@ -49,12 +94,14 @@ int bram_set_dev_info(struct bram_resource *bram)
 		fprintf(stderr, "Error: %s\n", strerror(errno));
 		return -1;
 	}
-	if (S_ISCHR(sb.st_mode)) {
-		bram->dev_path = dev_path;
+	/* Regular files are accepted as stand-ins for the device node */
+	if (S_ISCHR(sb.st_mode) || S_ISREG(sb.st_mode)) {
+		memcpy(bram->dev_path, dev_path, sizeof(bram->dev_path));
 		bram->major = (uintmax_t) major(sb.st_rdev);
 		bram->minor = (uintmax_t) minor(sb.st_rdev);
 	} else {
-		fprintf(stderr, "%s is not a special character device\n", dev_path);
+		fprintf(stderr, "%s is not a special character device or file\n",
+				dev_path);
 		return -1;
 	}
 	return 0;
@@ -64,25 +111,26 @@ int bram_set_map_info(struct bram_resource *bram)
 {
 	int result;
 	char *resultp;
-	static char map_path[UIO_MAP_PATH_SIZE];
+	char map_path[BRAM_MAP_PATH_SIZE];
 
-	char filepath[UIO_MAP_PATH_SIZE + 8];
+	char filepath[BRAM_MAP_PATH_SIZE + 8];
 	FILE *fs = NULL;
 
 	uint32_t map_addr;
-	static char map_name[UIO_MAX_MAP_NAME_SIZE];
-	off_t map_offset;
-	size_t map_size;
-	size_t map_width;
+	char map_name[BRAM_MAP_NAME_SIZE];
+	/* Scanned as 32-bit values, since that is how sysfs reports them */
+	uint32_t map_offset;
+	uint32_t map_size;
 
 	/* Get the path to the map file in /sys which we will mmap() later */
 	result = snprintf(map_path, sizeof(map_path),
-			"/sys/class/uio/uio%d/maps/map%d", bram->uio_number, bram->map_number);
+			"%s/uio%d/maps/map%d", bram_sysfs_root(), bram->uio_number,
+			bram->map_number);
 	if (result < 0) {
 		fprintf(stderr, "Output error\n");
 		return -1;
 	}
-	if (result >= (int) sizeof(filepath)) {
+	if (result >= (int) sizeof(map_path)) {
 		fprintf(stderr, "Path name too long\n");
 		return -1;
 	}
@@ -193,16 +241,193 @@ int bram_set_map_info(struct bram_resource *bram)
 		return -1;
 	}
 
-	/* Get map width */
-	map_width = BRAM_AXI_CTRL_WIDTH;
-
 	/* Now that we have all of these, we set the values */
-	bram->map_path = map_path;
+	memcpy(bram->map_path, map_path, sizeof(bram->map_path));
 	bram->map_addr = map_addr;
-	bram->map_name = map_name;
+	memcpy(bram->map_name, map_name, sizeof(bram->map_name));
 	bram->map_offset = map_offset;
 	bram->map_size = map_size;
-	bram->map_width = map_width;
+	return bram_set_dt_info(bram);
+}
+
+/*
+ * Read a property made of 32-bit big-endian cells, returning the number of
+ * cells read or -1 if it does not exist
+ */
+static int read_dt_cells(int uio_number, const char *prop, uint32_t *cells,
+		int max_cells)
+{
+	char path[BRAM_MAP_PATH_SIZE];
+	uint8_t buf[DT_PROP_MAX_CELLS * 4];
+	ssize_t result;
+	int fd;
+
+	result = snprintf(path, sizeof(path), "%s/uio%d/device/of_node/%s",
+			bram_sysfs_root(), uio_number, prop);
+	if ((result < 0) || (result >= (ssize_t) sizeof(path))) {
+		return -1;
+	}
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	result = read(fd, buf, sizeof(buf));
+	close(fd);
+	if (result < 0) {
+		return -1;
+	}
+	result /= 4;
+	if (result > max_cells) {
+		result = max_cells;
+	}
+	for (int i = 0; i < result; i++) {
+		cells[i] = ((uint32_t) buf[4 * i] << 24) |
+			((uint32_t) buf[4 * i + 1] << 16) |
+			((uint32_t) buf[4 * i + 2] << 8) | buf[4 * i + 3];
+	}
+	return (int) result;
+}
+
+int bram_read_dt_props(int uio_number, int map_number, uint32_t *width,
+		int *narrow_burst, uint32_t *size)
+{
+	uint32_t cells[DT_PROP_MAX_CELLS];
+	int ncells;
+
+	if (width && (read_dt_cells(uio_number, DT_PROP_DATA_WIDTH, cells, 1) == 1)) {
+		/* AXI data widths are powers of two from 8 bits up */
+		if ((cells[0] >= 8) && !(cells[0] & (cells[0] - 1))) {
+			*width = cells[0];
+		}
+	}
+	if (narrow_burst &&
+			(read_dt_cells(uio_number, DT_PROP_NARROW_BURST, cells, 1) == 1)) {
+		*narrow_burst = (cells[0] != 0);
+	}
+	/* Zynq-7000 uses one address and one size cell per range */
+	if (size && (map_number >= 0)) {
+		ncells = read_dt_cells(uio_number, DT_PROP_REG, cells, DT_PROP_MAX_CELLS);
+		if ((ncells > 0) && !(ncells % 2) && ((2 * map_number + 1) < ncells)) {
+			*size = cells[2 * map_number + 1];
+		}
+	}
+	return 0;
+}
+
+int bram_set_dt_info(struct bram_resource *bram)
+{
+	uint32_t width = BRAM_AXI_CTRL_WIDTH;
+	uint32_t size = (uint32_t) bram->map_size;
+	int narrow_burst = 1;
+
+	bram_read_dt_props(bram->uio_number, bram->map_number, &width,
+			&narrow_burst, &size);
+	/* UIO will never map more than it reports, whatever the tree says */
+	if (size && (size < bram->map_size)) {
+		bram->map_size = size;
+	}
+	bram->map_width = width;
+	bram->narrow_burst = narrow_burst;
+	bram->kernels = bram_kernels_select(width);
+	return 0;
+}
+
+/* Sizes given in the environment, in decimal or with a 0x prefix in hex */
+static size_t env_size(const char *env, size_t fallback)
+{
+	const char *str;
+	char *endptr = NULL;
+	unsigned long long value;
+
+	str = getenv(env);
+	if (!str || !*str) {
+		return fallback;
+	}
+	errno = 0;
+	value = strtoull(str, &endptr, 0);
+	if (errno || *endptr || (*str == '-') || !value || (value > SIZE_MAX)) {
+		fprintf(stderr, "Warning: Ignoring bad %s `%s'\n", env, str);
+		return fallback;
+	}
+	return (size_t) value;
+}
+
+/* Bytes actually mapped for the current window */
+static size_t window_length(const struct bram_resource *bram)
+{
+	size_t left = bram->map_size - bram->window_offset;
+
+	return (left < bram->window_size) ? left : bram->window_size;
+}
+
+/* Large maps keep /dev/mem open and map the first window straight away */
+static int bram_map_windowed(struct bram_resource *bram)
+{
+	char mem_path[BRAM_DEV_PATH_SIZE];
+	long page_size = sysconf(_SC_PAGE_SIZE);
+	size_t window_size;
+	int result;
+
+	if (bram->map_addr % page_size) {
+		fprintf(stderr, "Error: Windowed maps must start on a page boundary\n");
+		return -1;
+	}
+	window_size = env_size(BRAM_WINDOW_SIZE_ENV, BRAM_WINDOW_SIZE);
+	window_size += (page_size - (window_size % page_size)) % page_size;
+
+	result = snprintf(mem_path, sizeof(mem_path), "%s/" MEM_DEV_NAME,
+			bram_dev_root());
+	if ((result < 0) || (result >= (int) sizeof(mem_path))) {
+		fprintf(stderr, "Path name too long\n");
+		return -1;
+	}
+	bram->mem_fd = open(mem_path, O_RDWR | O_SYNC);
+	if (bram->mem_fd < 0) {
+		fprintf(stderr, "Error: Could not open %s: %s\n", mem_path,
+				strerror(errno));
+		return -1;
+	}
+	bram->map = NULL;
+	bram->windowed = 1;
+	bram->window_offset = 0;
+	bram->window_size = window_size;
+	if (bram_move_window(bram, 0)) {
+		close(bram->mem_fd);
+		bram->mem_fd = -1;
+		bram->windowed = 0;
+		return -1;
+	}
+	return 0;
+}
+
+int bram_move_window(struct bram_resource *bram, size_t offset)
+{
+	void *map;
+	size_t base;
+	size_t length;
+
+	if (!bram->windowed || (offset >= bram->map_size)) {
+		fprintf(stderr, "Error: Cannot move window to 0x%zx\n", offset);
+		return -1;
+	}
+	base = offset - (offset % bram->window_size);
+	length = bram->map_size - base;
+	if (length > bram->window_size) {
+		length = bram->window_size;
+	}
+	map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, bram->mem_fd,
+			(off_t) bram->map_addr + (off_t) base);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	/* Posted writes to the old window have to land before it goes away */
+	if (bram->map) {
+		__sync_synchronize();
+		munmap(bram->map, window_length(bram));
+	}
+	bram->map = map;
+	bram->window_offset = base;
 	return 0;
 }
 
@@ -213,6 +438,13 @@ int bram_map_resource(struct bram_resource *bram)
 	void *map;
 	size_t length;
 
+	bram->windowed = 0;
+	bram->mem_fd = -1;
+	if (bram->map_size > env_size(BRAM_WINDOW_THRESHOLD_ENV,
+				BRAM_WINDOW_THRESHOLD)) {
+		return bram_map_windowed(bram);
+	}
+
 	fd = open(bram->dev_path, O_RDWR);
 	if (fd < 0) {
 		fprintf(stderr, "Error: %s\n", strerror(errno));
@@ -228,15 +460,17 @@ int bram_map_resource(struct bram_resource *bram)
 	 * to not modify the struct that is passed in unless the memory map was
 	 * successful
 	 */
-	length = bram->map_size * bram->map_width;
+	length = bram->map_size;
 	map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED,
 			fd, bram->map_offset);
-	if (!map) {
+	if (map == MAP_FAILED) {
 		fprintf(stderr, "Error: %s\n", strerror(errno));
 		goto err_mmap;
 	}
 	close(fd);
 	bram->map = map;
+	bram->window_offset = 0;
+	bram->window_size = bram->map_size;
 	return 0;
 
 err_mmap:
@@ -245,17 +479,37 @@ err_open:
 	return -1;
 }
 
+int bram_map_standin(struct bram_resource *bram)
+{
+	void *map;
+
+	map = mmap(NULL, bram->map_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	bram->map = map;
+	bram->windowed = 0;
+	bram->window_offset = 0;
+	bram->window_size = bram->map_size;
+	bram->mem_fd = -1;
+	return 0;
+}
+
 int bram_unmap_resource(struct bram_resource *bram)
 {
 	int result;
-	size_t length;
 
 	if (!bram->map) {
 		fprintf(stderr, "No memory to unmap\n");
 		return -1;
 	}
-	length = bram->map_size * bram->map_width;
-	result = munmap(bram->map, length);
+	result = munmap(bram->map, window_length(bram));
+	if (bram->mem_fd >= 0) {
+		close(bram->mem_fd);
+		bram->mem_fd = -1;
+	}
 	if (result) {
 		fprintf(stderr, "Error: %s\n", strerror(errno));
 		return -1;
@@ -263,6 +517,42 @@ int bram_unmap_resource(struct bram_resource *bram)
 	return 0;
 }
 
+int bram_sync_resource(struct bram_resource *bram, size_t offset, size_t len)
+{
+	size_t page_size = (size_t) sysconf(_SC_PAGE_SIZE);
+	size_t window_end = bram->window_offset + window_length(bram);
+	size_t start;
+	size_t end;
+
+	if (!bram->map) {
+		fprintf(stderr, "No memory to sync\n");
+		return -1;
+	}
+	/* Drains the write buffer for device memory */
+	__sync_synchronize();
+
+	/* Only the part of the range in the current window is still mapped */
+	start = (offset > bram->window_offset) ? offset : bram->window_offset;
+	end = ((offset + len) < window_end) ? (offset + len) : window_end;
+	if (start >= end) {
+		return 0;
+	}
+	start -= bram->window_offset;
+	end -= bram->window_offset;
+	start -= start % page_size;
+	/*
+	 * Writes back maps of regular files, as used off target. UIO devices and
+	 * /dev/mem have no fsync and fail it with EINVAL, the barrier is all
+	 * they need.
+	 */
+	if (msync((uint8_t *) bram->map + start, end - start, MS_SYNC) &&
+			(errno != EINVAL)) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
 int str_to_uint8(uint8_t *value, char *str)
 {
 	char *endptr = NULL;
@@ -319,7 +609,91 @@ int str_to_uint16(uint16_t *value, char *str)
 	}
 }
 
-int get_file_size(int fd, uint16_t *size)
+int str_to_uint32(uint32_t *value, char *str)
+{
+	char *endptr = NULL;
+	unsigned long long result;
+	int base = 16;
+	int save_err;
+
+	errno = 0;
+	result = strtoull(str, &endptr, base);
+	save_err = errno;
+	if (str == endptr) {
+		fprintf(stderr, "Error: No conversion occurred\n");
+		return -1;
+	} else if ((save_err) == ERANGE) {
+		fprintf(stderr, "Error: Resulting value out of range\n");
+		return -1;
+	} else if (*endptr) {
+		fprintf(stderr, "Error: Invalid characters detected\n");
+		return -1;
+	} else if ((*str == '-') || (result > UINT32_MAX)) {
+		fprintf(stderr, "Error: Negative value was received or result out of range\n");
+		return -1;
+	} else {
+		*value = (uint32_t) result;
+		return 0;
+	}
+}
+
+int str_to_index(int *value, char *str)
+{
+	char *endptr = NULL;
+	long result;
+	int base = 10;
+	int save_err;
+
+	errno = 0;
+	result = strtol(str, &endptr, base);
+	save_err = errno;
+	if (str == endptr) {
+		fprintf(stderr, "Error: No conversion occurred\n");
+		return -1;
+	} else if ((save_err) == ERANGE) {
+		fprintf(stderr, "Error: Resulting value out of range\n");
+		return -1;
+	} else if (*endptr) {
+		fprintf(stderr, "Error: Invalid characters detected\n");
+		return -1;
+	} else if (result < 0 || result > INT_MAX) {
+		fprintf(stderr, "Error: Negative value was received or result out of range\n");
+		return -1;
+	} else {
+		*value = (int) result;
+		return 0;
+	}
+}
+
+int str_to_size(size_t *value, char *str)
+{
+	char *endptr = NULL;
+	unsigned long long result;
+	int base = 16;
+	int save_err;
+
+	errno = 0;
+	result = strtoull(str, &endptr, base);
+	save_err = errno;
+	if (str == endptr) {
+		fprintf(stderr, "Error: No conversion occurred\n");
+		return -1;
+	} else if ((save_err) == ERANGE) {
+		fprintf(stderr, "Error: Resulting value out of range\n");
+		return -1;
+	} else if (*endptr) {
+		fprintf(stderr, "Error: Invalid characters detected\n");
+		return -1;
+	} else if ((*str == '-') || (result > SIZE_MAX)) {
+		fprintf(stderr, "Error: Negative value was received or result out of range\n");
+		return -1;
+	} else {
+		*value = (size_t) result;
+		return 0;
+	}
+}
+
+int get_file_size(int fd, off_t *size)
 {
 	struct stat sb;
 
@@ -327,8 +701,14 @@ int get_file_size(int fd, uint16_t *size)
 		fprintf(stderr, "%s\n", strerror(errno));
 		return 1;
 	}
-	*size = (uint16_t) sb.st_size;
+	*size = sb.st_size;
 	return 0;
 }
 
+uint64_t bram_clock_ns(void)
+{
+	struct timespec ts;
 
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * UINT64_C(1000000000) + (uint64_t) ts.tv_nsec;
+}
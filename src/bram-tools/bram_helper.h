@@ -3,20 +3,55 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
 
 #include "bram_resource.h"
 
 void print_bram_init_error(int uio_number, int map_number);
 int bram_set_dev_info(struct bram_resource *bram);
 int bram_set_map_info(struct bram_resource *bram);
+int bram_set_dt_info(struct bram_resource *bram);
 int bram_map_resource(struct bram_resource *bram);
 int bram_unmap_resource(struct bram_resource *bram);
+/* Back a resource with map_size bytes of shared anonymous memory instead */
+int bram_map_standin(struct bram_resource *bram);
+/* Range of the map to sync, clipped to the current window */
+int bram_sync_resource(struct bram_resource *bram, size_t offset, size_t len);
+/*
+ * Map the window of a windowed resource that holds offset, see the window
+ * fields of struct bram_resource
+ */
+int bram_move_window(struct bram_resource *bram, size_t offset);
+
+/* Drop any lock bram_lock_range() took on bram and close its lock file */
+void bram_lock_release(struct bram_resource *bram);
+
+/* Locations of the UIO device nodes and sysfs tree, honoring the environment */
+const char *bram_env_path(const char *env, const char *fallback);
+const char *bram_dev_root(void);
+const char *bram_sysfs_root(void);
+
+/*
+ * Controller properties from the device tree node behind a UIO device. Each
+ * output is left untouched if the node or its property is missing, and size
+ * is the length of the map_number'th range in the `reg' property.
+ */
+int bram_read_dt_props(int uio_number, int map_number, uint32_t *width,
+		int *narrow_burst, uint32_t *size);
 
 /* Useful functions for validating input */
 int str_to_uint8(uint8_t *value, char *str);
 int str_to_uint16(uint16_t *value, char *str);
+int str_to_uint32(uint32_t *value, char *str);
+/* UIO device and map numbers, in decimal */
+int str_to_index(int *value, char *str);
+/* Addresses and lengths in hex, up to the size of the address space */
+int str_to_size(size_t *value, char *str);
 
 /* Other common operations */
-int get_file_size(int fd, uint16_t *size);
+int get_file_size(int fd, off_t *size);
+/* CLOCK_MONOTONIC in nanoseconds */
+uint64_t bram_clock_ns(void);
 
 #endif /* BRAM_HELPER_H */
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "bram_hexdump.h"
+
+/* Longest line, with a 64-bit address, the hex and ASCII columns and newline */
+#define LINE_MAX_CHARS		(16 + 2 + 3 * BRAM_HEXDUMP_LINE_BYTES + 1 + \
+				2 + BRAM_HEXDUMP_LINE_BYTES + 2)
+
+/* Byte halfway along a line, where the hex column gets an extra space */
+#define LINE_HALF		(BRAM_HEXDUMP_LINE_BYTES / 2)
+
+#define HEX_ROW(hi)	hi "0" hi "1" hi "2" hi "3" hi "4" hi "5" hi "6" hi "7" \
+			hi "8" hi "9" hi "a" hi "b" hi "c" hi "d" hi "e" hi "f"
+
+/* Both hex digits of every byte value, so a byte costs one lookup */
+static const char hex_pairs[2 * 256] =
+	HEX_ROW("0") HEX_ROW("1") HEX_ROW("2") HEX_ROW("3")
+	HEX_ROW("4") HEX_ROW("5") HEX_ROW("6") HEX_ROW("7")
+	HEX_ROW("8") HEX_ROW("9") HEX_ROW("a") HEX_ROW("b")
+	HEX_ROW("c") HEX_ROW("d") HEX_ROW("e") HEX_ROW("f");
+
+static const char hex_digits[16] = "0123456789abcdef";
+
+int bram_hexdump_init(struct bram_hexdump *hexdump, int fd, unsigned int group,
+		bool little_endian, size_t addr)
+{
+	if ((group != 8) && (group != 16) && (group != 32)) {
+		fprintf(stderr, "Error: Group width has to be 8, 16 or 32 bits\n");
+		return -1;
+	}
+	/* Groups have to line up with the bus words the controller sees */
+	if (addr % (group / 8)) {
+		fprintf(stderr, "Error: Listing grouped in %u-bit words has to start "
+				"on a word boundary\n", group);
+		return -1;
+	}
+	memset(hexdump, 0, sizeof(*hexdump));
+	hexdump->fd = fd;
+	hexdump->group = group / 8;
+	hexdump->little_endian = little_endian;
+	hexdump->addr = addr;
+	return 0;
+}
+
+static int flush_out(struct bram_hexdump *hexdump)
+{
+	size_t pos = 0;
+	ssize_t result;
+
+	while (pos != hexdump->out_len) {
+		result = write(hexdump->fd, hexdump->out + pos, hexdump->out_len - pos);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			return -1;
+		}
+		pos += result;
+	}
+	hexdump->out_len = 0;
+	return 0;
+}
+
+/* Flush first if a line might not fit in what is left of the buffer */
+static int reserve_line(struct bram_hexdump *hexdump)
+{
+	if ((hexdump->out_len + LINE_MAX_CHARS) > BRAM_HEXDUMP_BUF_SIZE) {
+		return flush_out(hexdump);
+	}
+	return 0;
+}
+
+/* At least eight digits like hexdump, more only once the address needs them */
+static char *put_addr(char *dst, size_t addr)
+{
+	unsigned int digits = 8;
+
+	while ((digits < (2 * sizeof(addr))) && (addr >> (4 * digits))) {
+		digits++;
+	}
+	for (unsigned int i = digits; i; i--) {
+		*dst++ = hex_digits[(addr >> (4 * (i - 1))) & 0xf];
+	}
+	return dst;
+}
+
+/* Format the first len bytes of a line, padding the rest of the hex column */
+static void put_line(struct bram_hexdump *hexdump, const uint8_t *bytes,
+		size_t len)
+{
+	char *dst = hexdump->out + hexdump->out_len;
+	unsigned int group = hexdump->group;
+	size_t index;
+
+	dst = put_addr(dst, hexdump->addr);
+	*dst++ = ' ';
+	*dst++ = ' ';
+	for (size_t i = 0; i < BRAM_HEXDUMP_LINE_BYTES; i += group) {
+		if (i == LINE_HALF) {
+			*dst++ = ' ';
+		}
+		for (unsigned int j = 0; j < group; j++) {
+			index = i + (hexdump->little_endian ? (group - 1 - j) : j);
+			if (index < len) {
+				memcpy(dst, hex_pairs + 2 * bytes[index], 2);
+			} else {
+				dst[0] = ' ';
+				dst[1] = ' ';
+			}
+			dst += 2;
+		}
+		*dst++ = ' ';
+	}
+	*dst++ = ' ';
+	*dst++ = '|';
+	for (size_t i = 0; i < len; i++) {
+		*dst++ = ((bytes[i] >= 0x20) && (bytes[i] < 0x7f)) ? (char) bytes[i] : '.';
+	}
+	*dst++ = '|';
+	*dst++ = '\n';
+	hexdump->out_len = dst - hexdump->out;
+	hexdump->addr += len;
+	return;
+}
+
+static int full_line(struct bram_hexdump *hexdump, const uint8_t *bytes)
+{
+	if (reserve_line(hexdump)) {
+		return -1;
+	}
+	if (hexdump->have_prev &&
+			!memcmp(hexdump->prev, bytes, BRAM_HEXDUMP_LINE_BYTES)) {
+		if (!hexdump->collapsed) {
+			hexdump->out[hexdump->out_len++] = '*';
+			hexdump->out[hexdump->out_len++] = '\n';
+			hexdump->collapsed = true;
+		}
+		hexdump->addr += BRAM_HEXDUMP_LINE_BYTES;
+		return 0;
+	}
+	put_line(hexdump, bytes, BRAM_HEXDUMP_LINE_BYTES);
+	memcpy(hexdump->prev, bytes, BRAM_HEXDUMP_LINE_BYTES);
+	hexdump->have_prev = true;
+	hexdump->collapsed = false;
+	return 0;
+}
+
+int bram_hexdump_feed(struct bram_hexdump *hexdump, const uint8_t *buf,
+		size_t len)
+{
+	size_t n;
+
+	if (!buf && len) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	/* Top up a carried over line first */
+	if (hexdump->line_len) {
+		n = BRAM_HEXDUMP_LINE_BYTES - hexdump->line_len;
+		n = (n < len) ? n : len;
+		memcpy(hexdump->line + hexdump->line_len, buf, n);
+		hexdump->line_len += n;
+		buf += n;
+		len -= n;
+		if (hexdump->line_len != BRAM_HEXDUMP_LINE_BYTES) {
+			return 0;
+		}
+		hexdump->line_len = 0;
+		if (full_line(hexdump, hexdump->line)) {
+			return -1;
+		}
+	}
+	/* Whole lines are formatted straight from the caller's buffer */
+	while (len >= BRAM_HEXDUMP_LINE_BYTES) {
+		if (full_line(hexdump, buf)) {
+			return -1;
+		}
+		buf += BRAM_HEXDUMP_LINE_BYTES;
+		len -= BRAM_HEXDUMP_LINE_BYTES;
+	}
+	memcpy(hexdump->line, buf, len);
+	hexdump->line_len = len;
+	return 0;
+}
+
+int bram_hexdump_finish(struct bram_hexdump *hexdump)
+{
+	char *dst;
+
+	/* Nothing at all is printed for an empty range, as with hexdump */
+	if (!hexdump->have_prev && !hexdump->line_len) {
+		return flush_out(hexdump);
+	}
+	if (hexdump->line_len) {
+		if (reserve_line(hexdump)) {
+			return -1;
+		}
+		put_line(hexdump, hexdump->line, hexdump->line_len);
+		hexdump->line_len = 0;
+	}
+	if (reserve_line(hexdump)) {
+		return -1;
+	}
+	dst = put_addr(hexdump->out + hexdump->out_len, hexdump->addr);
+	*dst++ = '\n';
+	hexdump->out_len = dst - hexdump->out;
+	return flush_out(hexdump);
+}
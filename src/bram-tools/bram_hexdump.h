@@ -0,0 +1,51 @@
+#ifndef BRAM_HEXDUMP_H
+#define BRAM_HEXDUMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Canonical hex plus ASCII formatter in the layout of `hexdump -C', with the
+ * hex column optionally grouped into 16 or 32-bit words. Data is fed in any
+ * pieces, lines are assembled straight into an output buffer from lookup
+ * tables, and the buffer goes out with a single write() once it is nearly
+ * full. A line that repeats the one before it is printed as a lone `*', as
+ * is any run of them, and the address just past the end closes the dump.
+ */
+#define BRAM_HEXDUMP_LINE_BYTES		16
+#define BRAM_HEXDUMP_BUF_SIZE		(64 * 1024)
+
+struct bram_hexdump {
+	int fd;
+	/* Bytes per group, 1, 2 or 4 */
+	unsigned int group;
+	/* Groups are shown most significant byte first as the CPU reads them */
+	bool little_endian;
+	/* Address of the next line */
+	size_t addr;
+	/* Partial line carried over between calls */
+	uint8_t line[BRAM_HEXDUMP_LINE_BYTES];
+	size_t line_len;
+	/* Last full line printed, for collapsing repeats */
+	uint8_t prev[BRAM_HEXDUMP_LINE_BYTES];
+	bool have_prev;
+	bool collapsed;
+	size_t out_len;
+	char out[BRAM_HEXDUMP_BUF_SIZE];
+};
+
+/*
+ * Group is the word width in bits, 8, 16 or 32. Little-endian groups are
+ * shown as the value a load of that width returns, big-endian ones in the
+ * order the bytes sit in memory. Addresses start at addr, which has to be a
+ * multiple of the group width so that every group is one aligned word.
+ */
+int bram_hexdump_init(struct bram_hexdump *hexdump, int fd, unsigned int group,
+		bool little_endian, size_t addr);
+int bram_hexdump_feed(struct bram_hexdump *hexdump, const uint8_t *buf,
+		size_t len);
+/* Print any partial line and the closing address and flush the buffer */
+int bram_hexdump_finish(struct bram_hexdump *hexdump);
+
+#endif /* BRAM_HEXDUMP_H */
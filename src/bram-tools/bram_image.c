@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "bram_hash.h"
+#include "bram_image.h"
+
+static void put_le32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = (uint8_t) value;
+	dst[1] = (uint8_t) (value >> 8);
+	dst[2] = (uint8_t) (value >> 16);
+	dst[3] = (uint8_t) (value >> 24);
+	return;
+}
+
+static uint32_t get_le32(const uint8_t *src)
+{
+	return (uint32_t) src[0] | ((uint32_t) src[1] << 8) |
+		((uint32_t) src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	uint8_t *dst = buf;
+	ssize_t result;
+
+	while (len) {
+		result = read(fd, dst, len);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			return -1;
+		} else if (result == 0) {
+			fprintf(stderr, "Error: Image is truncated\n");
+			return -1;
+		}
+		dst += result;
+		len -= result;
+	}
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const uint8_t *src = buf;
+	ssize_t result;
+
+	while (len) {
+		result = write(fd, src, len);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			return -1;
+		}
+		src += result;
+		len -= result;
+	}
+	return 0;
+}
+
+bool bram_image_detect(const void *buf, size_t len)
+{
+	return (len >= BRAM_IMAGE_MAGIC_SIZE) &&
+		!memcmp(buf, BRAM_IMAGE_MAGIC, BRAM_IMAGE_MAGIC_SIZE);
+}
+
+int bram_image_read_header(int fd, uint32_t *count)
+{
+	uint8_t header[BRAM_IMAGE_HEADER_SIZE];
+
+	if (read_full(fd, header, sizeof(header))) {
+		return -1;
+	}
+	if (!bram_image_detect(header, sizeof(header))) {
+		fprintf(stderr, "Error: Not a block RAM image\n");
+		return -1;
+	}
+	*count = get_le32(header + BRAM_IMAGE_MAGIC_SIZE);
+	return 0;
+}
+
+int bram_image_read_segment(int fd, struct bram_image_segment *segment)
+{
+	uint8_t header[BRAM_SEGMENT_HEADER_SIZE];
+	const uint8_t *field = header + BRAM_IMAGE_NAME_SIZE;
+
+	if (read_full(fd, header, sizeof(header))) {
+		return -1;
+	}
+	memcpy(segment->map_name, header, BRAM_IMAGE_NAME_SIZE);
+	segment->map_name[BRAM_IMAGE_NAME_SIZE - 1] = '\0';
+	segment->addr = get_le32(field);
+	segment->len = get_le32(field + 4);
+	segment->crc = get_le32(field + 8);
+	segment->flags = get_le32(field + 12);
+	if (segment->flags & ~(uint32_t) BRAM_SEGMENT_ZERO) {
+		fprintf(stderr, "Error: Segment for %s has unknown flags 0x%x\n",
+				segment->map_name, (unsigned int) segment->flags);
+		return -1;
+	}
+	return 0;
+}
+
+int bram_image_write_header(int fd, uint32_t count)
+{
+	uint8_t header[BRAM_IMAGE_HEADER_SIZE];
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, BRAM_IMAGE_MAGIC, BRAM_IMAGE_MAGIC_SIZE);
+	put_le32(header + BRAM_IMAGE_MAGIC_SIZE, count);
+	return write_full(fd, header, sizeof(header));
+}
+
+int bram_image_read_data(int fd, const struct bram_image_segment *segment,
+		uint8_t *data)
+{
+	if (segment->flags & BRAM_SEGMENT_ZERO) {
+		memset(data, 0, segment->len);
+		return 0;
+	}
+	if (read_full(fd, data, segment->len)) {
+		return -1;
+	}
+	if (bram_crc32(0, data, segment->len) != segment->crc) {
+		fprintf(stderr, "Error: CRC mismatch in segment for %s at 0x%04x\n",
+				segment->map_name, (unsigned int) segment->addr);
+		return -1;
+	}
+	return 0;
+}
+
+int bram_image_write_segment(int fd, struct bram_image_segment *segment,
+		const uint8_t *data)
+{
+	uint8_t header[BRAM_SEGMENT_HEADER_SIZE];
+	uint8_t *field = header + BRAM_IMAGE_NAME_SIZE;
+	bool zero = (segment->flags & BRAM_SEGMENT_ZERO);
+
+	if (!zero && !data && segment->len) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	segment->crc = zero ? 0 : bram_crc32(0, data, segment->len);
+
+	memset(header, 0, sizeof(header));
+	/* The name is cut short rather than left without its terminator */
+	strncpy((char *) header, segment->map_name, BRAM_IMAGE_NAME_SIZE - 1);
+	put_le32(field, segment->addr);
+	put_le32(field + 4, segment->len);
+	put_le32(field + 8, segment->crc);
+	put_le32(field + 12, segment->flags);
+	if (write_full(fd, header, sizeof(header))) {
+		return -1;
+	}
+	return zero ? 0 : write_full(fd, data, segment->len);
+}
+
+long bram_image_split(const uint8_t *buf, size_t len, size_t addr,
+		int (*fn)(const uint8_t *data, size_t addr, size_t len, bool zero,
+			void *arg), void *arg)
+{
+	long count = 0;
+	size_t data_start = 0;
+	size_t pos = 0;
+	size_t zero_start;
+	size_t zero_end;
+
+	while (pos != len) {
+		if (buf[pos]) {
+			pos++;
+			continue;
+		}
+		zero_start = pos;
+		while ((pos != len) && !buf[pos]) {
+			pos++;
+		}
+		/*
+		 * Pull the ends of the zero run in to the alignment so the data
+		 * segments either side of it start and end on whole words, except
+		 * at the ends of the range which stay where they are
+		 */
+		if (zero_start) {
+			zero_start += (BRAM_IMAGE_ALIGN -
+					((addr + zero_start) % BRAM_IMAGE_ALIGN)) % BRAM_IMAGE_ALIGN;
+		}
+		zero_end = pos;
+		if (zero_end != len) {
+			zero_end -= (addr + zero_end) % BRAM_IMAGE_ALIGN;
+		}
+		if ((zero_end <= zero_start) ||
+				((zero_end - zero_start) < BRAM_IMAGE_MIN_GAP)) {
+			continue;
+		}
+		if (zero_start != data_start) {
+			if (fn && fn(buf + data_start, addr + data_start,
+						zero_start - data_start, false, arg)) {
+				return -1;
+			}
+			count++;
+		}
+		if (fn && fn(NULL, addr + zero_start, zero_end - zero_start, true, arg)) {
+			return -1;
+		}
+		count++;
+		data_start = zero_end;
+	}
+	if (data_start != len) {
+		if (fn && fn(buf + data_start, addr + data_start, len - data_start,
+					false, arg)) {
+			return -1;
+		}
+		count++;
+	}
+	return count;
+}
+
+/* State for writing out the segments of one map as they are split off */
+struct range_writer {
+	int fd;
+	const char *map_name;
+	size_t stored;
+};
+
+static int write_range_segment(const uint8_t *data, size_t addr, size_t len,
+		bool zero, void *arg)
+{
+	struct range_writer *writer = arg;
+	struct bram_image_segment segment;
+
+	memset(&segment, 0, sizeof(segment));
+	strncpy(segment.map_name, writer->map_name, BRAM_IMAGE_NAME_SIZE - 1);
+	segment.addr = (uint32_t) addr;
+	segment.len = (uint32_t) len;
+	segment.flags = zero ? BRAM_SEGMENT_ZERO : 0;
+	if (!zero) {
+		writer->stored += len;
+	}
+	return bram_image_write_segment(writer->fd, &segment, data);
+}
+
+long bram_image_write_range(int fd, const char *map_name, const uint8_t *buf,
+		size_t len, size_t addr, size_t *stored)
+{
+	struct range_writer writer;
+	long count;
+
+	writer.fd = fd;
+	writer.map_name = map_name;
+	writer.stored = 0;
+	count = bram_image_split(buf, len, addr, write_range_segment, &writer);
+	if ((count >= 0) && stored) {
+		*stored += writer.stored;
+	}
+	return count;
+}
@@ -0,0 +1,97 @@
+#ifndef BRAM_IMAGE_H
+#define BRAM_IMAGE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A sparse image holds any number of segments, each of which targets a map by
+ * name and covers one contiguous range of it. Everything is little-endian:
+ *
+ *   magic[8]     "BRAMIMG1"
+ *   count        number of segments that follow
+ *   reserved     zero
+ *
+ * followed by count segments of
+ *
+ *   name[64]     name of the target map, NUL padded
+ *   addr         byte offset into the map
+ *   len          number of bytes covered
+ *   crc32        CRC-32 of the data bytes
+ *   flags        BRAM_SEGMENT_* below
+ *   data[len]    absent for BRAM_SEGMENT_ZERO
+ *
+ * Anything not covered by a segment is left untouched when loading.
+ */
+#define BRAM_IMAGE_MAGIC		"BRAMIMG1"
+#define BRAM_IMAGE_MAGIC_SIZE		8
+#define BRAM_IMAGE_HEADER_SIZE		(BRAM_IMAGE_MAGIC_SIZE + 2 * 4)
+#define BRAM_IMAGE_NAME_SIZE		64
+#define BRAM_SEGMENT_HEADER_SIZE	(BRAM_IMAGE_NAME_SIZE + 4 * 4)
+
+/* The range is all zero and no data bytes are stored for it */
+#define BRAM_SEGMENT_ZERO		0x1
+
+/*
+ * Zero runs shorter than this cost more as a segment header than as data, so
+ * they are kept inside the surrounding data segment
+ */
+#define BRAM_IMAGE_MIN_GAP		(2 * BRAM_SEGMENT_HEADER_SIZE)
+
+/* Segment boundaries are kept on this alignment so stores stay wide */
+#define BRAM_IMAGE_ALIGN		8
+
+struct bram_image_segment {
+	char map_name[BRAM_IMAGE_NAME_SIZE];
+	uint32_t addr;
+	uint32_t len;
+	uint32_t crc;
+	uint32_t flags;
+};
+
+/* Whether buf starts with the image magic */
+bool bram_image_detect(const void *buf, size_t len);
+
+/*
+ * Reading and writing are done on plain descriptors so images can be piped.
+ * The readers fail on a short read, a bad magic or unknown flags.
+ */
+int bram_image_read_header(int fd, uint32_t *count);
+int bram_image_read_segment(int fd, struct bram_image_segment *segment);
+int bram_image_write_header(int fd, uint32_t count);
+
+/*
+ * Read the data of a segment whose header has just been read into data, which
+ * must hold segment->len bytes, and check it against the segment's CRC. Zero
+ * segments read nothing and just clear data.
+ */
+int bram_image_read_data(int fd, const struct bram_image_segment *segment,
+		uint8_t *data);
+
+/*
+ * Write a segment header followed by its data, filling in segment->crc from
+ * the data unless the segment is BRAM_SEGMENT_ZERO
+ */
+int bram_image_write_segment(int fd, struct bram_image_segment *segment,
+		const uint8_t *data);
+
+/*
+ * Split len bytes of buf, which sit at addr in the map, into alternating data
+ * and zero segments and call fn for each in order. Zero runs of at least
+ * BRAM_IMAGE_MIN_GAP bytes become zero segments. Returns the number of
+ * segments or -1 if fn failed, so a NULL fn just counts them.
+ */
+long bram_image_split(const uint8_t *buf, size_t len, size_t addr,
+		int (*fn)(const uint8_t *data, size_t addr, size_t len, bool zero,
+			void *arg), void *arg);
+
+/*
+ * Split len bytes of a map's contents at addr as above and write out each
+ * segment, adding the number of data bytes actually stored to stored. The
+ * header has to have been written already with a count that includes these.
+ */
+long bram_image_write_range(int fd, const char *map_name, const uint8_t *buf,
+		size_t len, size_t addr, size_t *stored);
+
+#endif /* BRAM_IMAGE_H */
@@ -9,12 +9,49 @@
 
 #include "bram_helper.h"
 #include "bram_resource.h"
+#include "bram_kernels.h"
+#include "bram_discover.h"
+
+/* Long options without a short equivalent */
+enum {
+	OPT_STATS = 0x100,
+};
 
 void print_usage() {
 	printf("Usage: bram_info DEVICE MAP\n");
+	printf("       bram_info [--rescan] --all\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("  %-15s%-30s\n", "-h", "display program usage");
+	printf("  %-15s%-30s\n", "-a, --all", "list every UIO map on the system");
+	printf("  %-15s%-30s\n", "-r, --rescan", "ignore the cached map index");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase to stderr");
+	printf("\n");
 	return;
 }
 
+/* One line per map straight from the index, without mapping anything */
+int print_all_maps(int rescan)
+{
+	struct bram_index index;
+	const struct bram_map_entry *entry;
+
+	if (bram_index_get(&index, rescan)) {
+		fprintf(stderr, "Error: Could not build UIO map index\n");
+		return -1;
+	}
+	printf("%-5s%-5s%-12s%-12s%-12s%-10s%s\n", "UIO", "MAP", "ADDR", "OFFSET",
+			"SIZE", "DEV", "NAME");
+	for (size_t i = 0; i < index.count; i++) {
+		entry = &index.entries[i];
+		printf("%-5d%-5d0x%08"PRIx32"  0x%08"PRIx32"  0x%08"PRIx32"  %3u:%-5u %s\n",
+				entry->uio_number, entry->map_number, entry->map_addr,
+				entry->map_offset, entry->map_size, entry->major,
+				entry->minor, entry->map_name);
+	}
+	return 0;
+}
+
 int print_bram_summary(struct bram_resource *bram)
 {
 	if (!bram) {
@@ -30,6 +67,16 @@ int print_bram_summary(struct bram_resource *bram)
 	printf("%-16s%s\n", "Map name:", bram->map_name);
 	printf("%-16s0x%08"PRIx32"\n", "Map offset:", (uint32_t) bram->map_offset);
 	printf("%-16s0x%08"PRIx32"\n", "Map size:", (uint32_t) bram->map_size);
+	printf("%-16s%zu bits\n", "Data width:", bram->map_width);
+	printf("%-16s%s\n", "Narrow burst:", bram->narrow_burst ? "yes" : "no");
+	printf("%-16s%s\n", "Access kernels:",
+			bram->kernels ? bram->kernels->name : "none");
+	if (bram->windowed) {
+		printf("%-16s0x%zx bytes through /dev/mem\n", "Map window:",
+				bram->window_size);
+	} else {
+		printf("%-16s%s\n", "Map window:", "whole map");
+	}
 	return 0;
 }
 
@@ -39,16 +86,58 @@ int main(int argc, char *argv[])
 	int map_number;
 
 	struct bram_resource bram;
+	int all = 0;
+	int rescan = 0;
+	struct bram_perf perf;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+	uint64_t start;
+	int result;
+
+	static struct option long_options[] = {
+		{"all",		no_argument,	NULL,	'a'},
+		{"rescan",	no_argument,	NULL,	'r'},
+		{"help",	no_argument,	NULL,	'h'},
+		{"stats",	optional_argument, NULL, OPT_STATS},
+		{NULL,		0,		NULL,	0}
+	};
 
-	/* Do not accept any options */
+	bram_perf_init(&perf);
 	int opt;
-	while ((opt = getopt(argc, argv, "")) != -1) {
+	while ((opt = getopt_long(argc, argv, "ahr", long_options, NULL)) != -1) {
 		switch (opt) {
+			case 'a':
+				all = 1;
+				break;
+			case 'r':
+				rescan = 1;
+				break;
+			case 'h':
+				print_usage();
+				return 0;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				break;
 			default:
 				print_usage();
 				return 1;
 		}
 	}
+	if (all) {
+		if (optind != argc) {
+			print_usage();
+			return 1;
+		}
+		/* Discovery is all there is to time without a map to open */
+		start = bram_perf_start(&perf);
+		result = print_all_maps(rescan);
+		bram_perf_record(&perf, BRAM_PHASE_CREATE, start, 0);
+		if (stats_format) {
+			bram_perf_print(stderr, "bram_info", &perf, stats_format);
+		}
+		return result ? 1 : 0;
+	}
 	/* Require both the UIO device and map numbers to be provided */
 	if ((optind + 2) != argc) {
 		print_usage();
@@ -57,13 +146,13 @@ int main(int argc, char *argv[])
 
 	/* Extract the UIO number and map numbers from positional arguments */
 	for (int arg_cnt = optind; arg_cnt < argc; arg_cnt++) {
-		if (arg_cnt == 1) {
+		if (arg_cnt == optind) {
 			uio_number = atoi(argv[arg_cnt]);
 			if (uio_number < 0) {
 				fprintf(stderr, "Error: Invalid UIO device number %d\n", uio_number);
 				return 1;
 			}
-		} else if (arg_cnt == 2) {
+		} else if (arg_cnt == optind + 1) {
 			map_number = atoi(argv[arg_cnt]);
 			if (map_number < 0) {
 				fprintf(stderr, "Error: Invalid map device number %d\n", map_number);
@@ -75,12 +164,16 @@ int main(int argc, char *argv[])
 		}
 	}
 
-	if (bram_create(&bram, uio_number, map_number)) {
+	if (bram_create_perf(&bram, uio_number, map_number,
+				stats_format ? &perf : NULL)) {
 		print_bram_init_error(uio_number, map_number);
 		return 1;
 	}
 	print_bram_summary(&bram);
 	bram_destroy(&bram);
+	if (stats_format) {
+		bram_perf_print(stderr, "bram_info", &perf, stats_format);
+	}
 
 	return 0;
 }
@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "bram_ingest.h"
+
+/* Longest record in bytes once decoded, count plus up to 255 more */
+#define RECORD_MAX_BYTES	(BRAM_INGEST_LINE_SIZE / 2)
+
+/* Value plus one of every hex digit, so that zero marks anything else */
+static const uint8_t hex_table[256] = {
+	['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+	['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+	['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14, ['E'] = 15, ['F'] = 16,
+	['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15, ['f'] = 16,
+};
+
+static const char *format_names[] = {
+	[BRAM_FORMAT_RAW] = "raw",
+	[BRAM_FORMAT_IHEX] = "ihex",
+	[BRAM_FORMAT_SREC] = "srec",
+	[BRAM_FORMAT_XEX] = "xex",
+};
+
+#define NUM_FORMATS	(sizeof(format_names) / sizeof(format_names[0]))
+
+const char *bram_ingest_format_name(enum bram_ingest_format format)
+{
+	return ((size_t) format < NUM_FORMATS) ? format_names[format] : "unknown";
+}
+
+int bram_ingest_parse_format(enum bram_ingest_format *format, const char *str)
+{
+	for (size_t i = 0; i < NUM_FORMATS; i++) {
+		if (!strcmp(str, format_names[i])) {
+			*format = (enum bram_ingest_format) i;
+			return 0;
+		}
+	}
+	fprintf(stderr, "Error: Unknown format `%s'\n", str);
+	return -1;
+}
+
+enum bram_ingest_format bram_ingest_detect(const uint8_t *buf, size_t len)
+{
+	if ((len >= 2) && (buf[0] == ':') && hex_table[buf[1]]) {
+		return BRAM_FORMAT_IHEX;
+	}
+	if ((len >= 2) && (buf[0] == 'S') && (buf[1] >= '0') && (buf[1] <= '9')) {
+		return BRAM_FORMAT_SREC;
+	}
+	if ((len >= 2) && (buf[0] == 0xff) && (buf[1] == 0xff)) {
+		return BRAM_FORMAT_XEX;
+	}
+	return BRAM_FORMAT_RAW;
+}
+
+void bram_ingest_init(struct bram_ingest *ingest,
+		enum bram_ingest_format format, bram_ingest_fn fn, void *arg)
+{
+	memset(ingest, 0, sizeof(*ingest));
+	ingest->format = format;
+	ingest->fn = fn;
+	ingest->arg = arg;
+	return;
+}
+
+static int flush_run(struct bram_ingest *ingest)
+{
+	int result;
+
+	if (!ingest->run_len) {
+		return 0;
+	}
+	result = ingest->fn(ingest->run_addr, ingest->run, ingest->run_len,
+			ingest->arg);
+	ingest->run_len = 0;
+	ingest->runs++;
+	return result;
+}
+
+/* Append decoded bytes to the current run, starting a new one on any gap */
+static int emit(struct bram_ingest *ingest, uint32_t addr, const uint8_t *data,
+		size_t len)
+{
+	size_t n;
+
+	ingest->bytes += len;
+	while (len) {
+		if (ingest->run_len && ((addr != (ingest->run_addr +
+							(uint32_t) ingest->run_len)) ||
+					(ingest->run_len == BRAM_INGEST_RUN_SIZE))) {
+			if (flush_run(ingest)) {
+				return -1;
+			}
+		}
+		if (!ingest->run_len) {
+			ingest->run_addr = addr;
+		}
+		n = BRAM_INGEST_RUN_SIZE - ingest->run_len;
+		n = (n < len) ? n : len;
+		memcpy(ingest->run + ingest->run_len, data, n);
+		ingest->run_len += n;
+		addr += (uint32_t) n;
+		data += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int decode_hex(uint8_t *dst, const char *src, size_t nbytes)
+{
+	uint8_t hi;
+	uint8_t lo;
+
+	for (size_t i = 0; i < nbytes; i++) {
+		hi = hex_table[(uint8_t) src[2 * i]];
+		lo = hex_table[(uint8_t) src[2 * i + 1]];
+		if (!hi || !lo) {
+			return -1;
+		}
+		dst[i] = (uint8_t) (((hi - 1) << 4) | (lo - 1));
+	}
+	return 0;
+}
+
+/* :LLAAAATT<data>CC where all bytes including the checksum sum to zero */
+static int ihex_record(struct bram_ingest *ingest, const char *line, size_t len)
+{
+	uint8_t bytes[RECORD_MAX_BYTES];
+	uint8_t sum = 0;
+	size_t nbytes;
+	uint32_t addr;
+	uint8_t count;
+
+	if ((line[0] != ':') || (len < 11) || !(len & 0x1)) {
+		fprintf(stderr, "Error: Line %zu is not an Intel HEX record\n",
+				ingest->line_number);
+		return -1;
+	}
+	nbytes = (len - 1) / 2;
+	if (decode_hex(bytes, line + 1, nbytes)) {
+		fprintf(stderr, "Error: Bad hex digit on line %zu\n", ingest->line_number);
+		return -1;
+	}
+	count = bytes[0];
+	if (nbytes != ((size_t) count + 5)) {
+		fprintf(stderr, "Error: Record length mismatch on line %zu\n",
+				ingest->line_number);
+		return -1;
+	}
+	for (size_t i = 0; i < nbytes; i++) {
+		sum += bytes[i];
+	}
+	if (sum) {
+		fprintf(stderr, "Error: Checksum mismatch on line %zu\n",
+				ingest->line_number);
+		return -1;
+	}
+
+	ingest->records++;
+	addr = ((uint32_t) bytes[1] << 8) | bytes[2];
+	switch (bytes[3]) {
+		case 0x00:
+			return emit(ingest, ingest->base_addr + addr, bytes + 4, count);
+		case 0x01:
+			ingest->done = true;
+			return 0;
+		case 0x02:
+		case 0x04:
+			if (count != 2) {
+				break;
+			}
+			ingest->base_addr = ((uint32_t) bytes[4] << 8) | bytes[5];
+			ingest->base_addr <<= (bytes[3] == 0x02) ? 4 : 16;
+			return 0;
+		case 0x03:
+		case 0x05:
+			/* Start addresses mean nothing to a block RAM */
+			return 0;
+		default:
+			break;
+	}
+	fprintf(stderr, "Error: Bad record type %02x on line %zu\n", bytes[3],
+			ingest->line_number);
+	return -1;
+}
+
+/*
+ * STCC<addr><data>KK where the count covers the address, data and checksum,
+ * and the checksum is the ones' complement of the sum of everything before it
+ */
+static int srec_record(struct bram_ingest *ingest, const char *line, size_t len)
+{
+	/* Address bytes for each record type, zero for the ones that are invalid */
+	static const uint8_t addr_bytes[10] = { 2, 2, 3, 4, 0, 2, 3, 4, 3, 2 };
+	uint8_t bytes[RECORD_MAX_BYTES];
+	uint8_t sum = 0;
+	size_t nbytes;
+	uint32_t addr = 0;
+	unsigned int type;
+	uint8_t count;
+
+	if ((line[0] != 'S') || (line[1] < '0') || (line[1] > '9') || (len < 6) ||
+			(len & 0x1)) {
+		fprintf(stderr, "Error: Line %zu is not an S-record\n",
+				ingest->line_number);
+		return -1;
+	}
+	type = line[1] - '0';
+	nbytes = (len - 2) / 2;
+	if (decode_hex(bytes, line + 2, nbytes)) {
+		fprintf(stderr, "Error: Bad hex digit on line %zu\n", ingest->line_number);
+		return -1;
+	}
+	count = bytes[0];
+	if ((nbytes != ((size_t) count + 1)) || !addr_bytes[type] ||
+			(count < (addr_bytes[type] + 1))) {
+		fprintf(stderr, "Error: Record length mismatch on line %zu\n",
+				ingest->line_number);
+		return -1;
+	}
+	for (size_t i = 0; i < nbytes; i++) {
+		sum += bytes[i];
+	}
+	if (sum != 0xff) {
+		fprintf(stderr, "Error: Checksum mismatch on line %zu\n",
+				ingest->line_number);
+		return -1;
+	}
+
+	ingest->records++;
+	for (unsigned int i = 0; i < addr_bytes[type]; i++) {
+		addr = (addr << 8) | bytes[1 + i];
+	}
+	switch (type) {
+		case 1:
+		case 2:
+		case 3:
+			return emit(ingest, addr, bytes + 1 + addr_bytes[type],
+					count - addr_bytes[type] - 1);
+		case 7:
+		case 8:
+		case 9:
+			ingest->done = true;
+			return 0;
+		default:
+			/* Headers and record counts */
+			return 0;
+	}
+}
+
+static int text_line(struct bram_ingest *ingest)
+{
+	char *line = ingest->line;
+	size_t len = ingest->line_len;
+
+	ingest->line_number++;
+	ingest->line_len = 0;
+	while (len && ((line[len - 1] == '\r') || (line[len - 1] == ' ') ||
+				(line[len - 1] == '\t'))) {
+		len--;
+	}
+	/* Blank lines anywhere and anything after the end record are ignored */
+	if (!len || ingest->done) {
+		return 0;
+	}
+	line[len] = '\0';
+	if (ingest->format == BRAM_FORMAT_IHEX) {
+		return ihex_record(ingest, line, len);
+	}
+	return srec_record(ingest, line, len);
+}
+
+static int feed_text(struct bram_ingest *ingest, const uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (buf[i] == '\n') {
+			if (text_line(ingest)) {
+				return -1;
+			}
+			continue;
+		}
+		if (ingest->line_len == (BRAM_INGEST_LINE_SIZE - 1)) {
+			fprintf(stderr, "Error: Line %zu is too long\n",
+					ingest->line_number + 1);
+			return -1;
+		}
+		ingest->line[ingest->line_len++] = (char) buf[i];
+	}
+	return 0;
+}
+
+static int feed_xex(struct bram_ingest *ingest, const uint8_t *buf, size_t len)
+{
+	uint32_t last;
+	size_t n;
+
+	while (len) {
+		if (ingest->seg_left) {
+			n = (ingest->seg_left < len) ? ingest->seg_left : len;
+			if (emit(ingest, ingest->seg_addr, buf, n)) {
+				return -1;
+			}
+			ingest->seg_addr += (uint32_t) n;
+			ingest->seg_left -= n;
+			buf += n;
+			len -= n;
+			continue;
+		}
+		ingest->header[ingest->header_len++] = *buf++;
+		len--;
+		/* The 0xffff marker is optional before every segment but the first */
+		if ((ingest->header_len == 2) && (ingest->header[0] == 0xff) &&
+				(ingest->header[1] == 0xff)) {
+			ingest->header_len = 0;
+			continue;
+		}
+		if (ingest->header_len != 4) {
+			continue;
+		}
+		ingest->header_len = 0;
+		ingest->seg_addr = ingest->header[0] | ((uint32_t) ingest->header[1] << 8);
+		last = ingest->header[2] | ((uint32_t) ingest->header[3] << 8);
+		if (last < ingest->seg_addr) {
+			fprintf(stderr, "Error: Segment ends at 0x%04x before it starts at "
+					"0x%04x\n", (unsigned int) last,
+					(unsigned int) ingest->seg_addr);
+			return -1;
+		}
+		ingest->seg_left = last - ingest->seg_addr + 1;
+		ingest->records++;
+	}
+	return 0;
+}
+
+int bram_ingest_feed(struct bram_ingest *ingest, const uint8_t *buf,
+		size_t len)
+{
+	switch (ingest->format) {
+		case BRAM_FORMAT_IHEX:
+		case BRAM_FORMAT_SREC:
+			return feed_text(ingest, buf, len);
+		case BRAM_FORMAT_XEX:
+			return feed_xex(ingest, buf, len);
+		default:
+			return emit(ingest, (uint32_t) ingest->bytes, buf, len);
+	}
+}
+
+int bram_ingest_finish(struct bram_ingest *ingest)
+{
+	switch (ingest->format) {
+		case BRAM_FORMAT_IHEX:
+		case BRAM_FORMAT_SREC:
+			if (ingest->line_len && text_line(ingest)) {
+				return -1;
+			}
+			if ((ingest->format == BRAM_FORMAT_IHEX) && !ingest->done) {
+				fprintf(stderr, "Error: No end of file record\n");
+				return -1;
+			}
+			break;
+		case BRAM_FORMAT_XEX:
+			if (ingest->header_len || ingest->seg_left) {
+				fprintf(stderr, "Error: Last segment is truncated\n");
+				return -1;
+			}
+			break;
+		default:
+			break;
+	}
+	return flush_run(ingest);
+}
@@ -0,0 +1,77 @@
+#ifndef BRAM_INGEST_H
+#define BRAM_INGEST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Streaming decoders for the object formats our 6502 toolchain produces. Input
+ * is fed in arbitrary pieces as it comes off the file, and decoded bytes are
+ * coalesced into contiguous runs that are handed to a callback as soon as the
+ * next record does not continue them or the run buffer fills up. Record
+ * checksums are checked as each record is decoded.
+ */
+enum bram_ingest_format {
+	BRAM_FORMAT_RAW,
+	/* Intel HEX, including extended segment and linear address records */
+	BRAM_FORMAT_IHEX,
+	/* Motorola S-records with 16, 24 or 32-bit addresses */
+	BRAM_FORMAT_SREC,
+	/*
+	 * Binary with segment headers as ld65 writes for the atari target: an
+	 * optional 0xffff marker followed by the first and last address of the
+	 * segment (both little-endian) and then the data
+	 */
+	BRAM_FORMAT_XEX,
+};
+
+/* Largest run passed to the callback at once */
+#define BRAM_INGEST_RUN_SIZE		4096
+/* Longest text record accepted, enough for 255 data bytes in either format */
+#define BRAM_INGEST_LINE_SIZE		600
+
+typedef int (*bram_ingest_fn)(uint32_t addr, const uint8_t *data, size_t len,
+		void *arg);
+
+struct bram_ingest {
+	enum bram_ingest_format format;
+	bram_ingest_fn fn;
+	void *arg;
+	/* Run being built up */
+	uint32_t run_addr;
+	size_t run_len;
+	uint8_t run[BRAM_INGEST_RUN_SIZE];
+	/* Partial text record carried over between calls */
+	char line[BRAM_INGEST_LINE_SIZE];
+	size_t line_len;
+	size_t line_number;
+	/* Upper address bits from Intel HEX type 02 and 04 records */
+	uint32_t base_addr;
+	/* Segment header bytes collected so far and the current segment */
+	uint8_t header[6];
+	size_t header_len;
+	uint32_t seg_addr;
+	size_t seg_left;
+	/* An end of file record has been seen */
+	bool done;
+	/* Totals for reporting */
+	size_t records;
+	size_t bytes;
+	size_t runs;
+};
+
+const char *bram_ingest_format_name(enum bram_ingest_format format);
+int bram_ingest_parse_format(enum bram_ingest_format *format, const char *str);
+
+/* Guess the format from the first bytes of a file */
+enum bram_ingest_format bram_ingest_detect(const uint8_t *buf, size_t len);
+
+void bram_ingest_init(struct bram_ingest *ingest,
+		enum bram_ingest_format format, bram_ingest_fn fn, void *arg);
+int bram_ingest_feed(struct bram_ingest *ingest, const uint8_t *buf,
+		size_t len);
+/* Decode anything left over and hand over the last run */
+int bram_ingest_finish(struct bram_ingest *ingest);
+
+#endif /* BRAM_INGEST_H */
@@ -0,0 +1,345 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "bram_kernels.h"
+
+/*
+ * Each public kernel below is a thin wrapper that calls one of the generic
+ * loops with a constant width, so the compiler turns the width switches into
+ * straight-line code for that width.
+ */
+
+static inline uint64_t dev_load(const volatile uint8_t *p, unsigned int w)
+{
+	switch (w) {
+		case 1:
+			return *p;
+		case 2:
+			return *(const volatile uint16_t *) p;
+		case 4:
+			return *(const volatile uint32_t *) p;
+		default:
+			return *(const volatile uint64_t *) p;
+	}
+}
+
+static inline void dev_store(volatile uint8_t *p, unsigned int w, uint64_t v)
+{
+	switch (w) {
+		case 1:
+			*p = (uint8_t) v;
+			break;
+		case 2:
+			*(volatile uint16_t *) p = (uint16_t) v;
+			break;
+		case 4:
+			*(volatile uint32_t *) p = (uint32_t) v;
+			break;
+		default:
+			*(volatile uint64_t *) p = v;
+			break;
+	}
+	return;
+}
+
+/* Bytes from p up to the next w byte boundary */
+static inline size_t head_len(const volatile uint8_t *p, unsigned int w,
+		size_t len)
+{
+	size_t mis = (uintptr_t) p & (w - 1);
+	size_t n = mis ? (w - mis) : 0;
+
+	return (n < len) ? n : len;
+}
+
+/*
+ * Write n bytes that all fall inside one bus word, with the widest naturally
+ * aligned stores that fit. Each is a single beat with only its own byte lanes
+ * strobed, which axi_bram_ctrl takes even when it does not support narrow
+ * bursts, so the rest of the word is never read back and rewritten under
+ * whoever else is using it.
+ */
+static inline size_t partial_write(volatile uint8_t *dst, const uint8_t *src,
+		size_t n)
+{
+	uint64_t piece;
+	unsigned int step;
+	size_t ntrans = 0;
+
+	while (n) {
+		step = 4;
+		while ((step > n) || ((uintptr_t) dst & (step - 1))) {
+			step /= 2;
+		}
+		piece = 0;
+		memcpy(&piece, src, step);
+		dev_store(dst, step, piece);
+		dst += step;
+		src += step;
+		n -= step;
+		ntrans++;
+	}
+	return ntrans;
+}
+
+static inline size_t partial_read(uint8_t *dst, const volatile uint8_t *src,
+		size_t n, unsigned int w, int narrow)
+{
+	const volatile uint8_t *base;
+	uint64_t word;
+
+	if (narrow || (w == 1)) {
+		for (size_t i = 0; i < n; i++) {
+			dst[i] = src[i];
+		}
+		return n;
+	}
+	base = (const volatile uint8_t *) ((uintptr_t) src & ~(uintptr_t) (w - 1));
+	word = dev_load(base, w);
+	memcpy(dst, (uint8_t *) &word + (src - base), n);
+	return 1;
+}
+
+static inline size_t generic_write(volatile uint8_t *dst, const uint8_t *src,
+		size_t len, int narrow, unsigned int w, int neon)
+{
+	uint64_t word = 0;
+	size_t ntrans = 0;
+	size_t n;
+
+	/* Partial words are written the same way either way */
+	(void) narrow;
+	n = head_len(dst, w, len);
+	if (n) {
+		ntrans += partial_write(dst, src, n);
+		dst += n;
+		src += n;
+		len -= n;
+	}
+#if defined(__ARM_NEON)
+	/*
+	 * A quad register store to device memory goes out as a single burst of
+	 * full-width beats. The element size has to match the word alignment
+	 * of the destination or the store will fault on device memory.
+	 */
+	if (neon) {
+		while (len >= 16) {
+			vst1q_u32((uint32_t *) dst, vreinterpretq_u32_u8(vld1q_u8(src)));
+			dst += 16;
+			src += 16;
+			len -= 16;
+			ntrans++;
+		}
+	}
+#else
+	(void) neon;
+#endif
+	/* The source has no alignment guarantee, so go through memcpy() */
+	while (len >= w) {
+		memcpy(&word, src, w);
+		dev_store(dst, w, word);
+		dst += w;
+		src += w;
+		len -= w;
+		ntrans++;
+	}
+	if (len) {
+		ntrans += partial_write(dst, src, len);
+	}
+	return ntrans;
+}
+
+static inline size_t generic_read(uint8_t *dst, const volatile uint8_t *src,
+		size_t len, int narrow, unsigned int w, int neon)
+{
+	uint64_t word;
+	size_t ntrans = 0;
+	size_t n;
+
+	n = head_len(src, w, len);
+	if (n) {
+		ntrans += partial_read(dst, src, n, w, narrow);
+		dst += n;
+		src += n;
+		len -= n;
+	}
+#if defined(__ARM_NEON)
+	if (neon) {
+		while (len >= 16) {
+			vst1q_u8(dst, vreinterpretq_u8_u32(vld1q_u32((uint32_t *) src)));
+			dst += 16;
+			src += 16;
+			len -= 16;
+			ntrans++;
+		}
+	}
+#else
+	(void) neon;
+#endif
+	while (len >= w) {
+		word = dev_load(src, w);
+		memcpy(dst, &word, w);
+		dst += w;
+		src += w;
+		len -= w;
+		ntrans++;
+	}
+	if (len) {
+		ntrans += partial_read(dst, src, len, w, narrow);
+	}
+	return ntrans;
+}
+
+static inline size_t generic_fill(volatile uint8_t *dst, uint8_t value,
+		size_t len, int narrow, unsigned int w, int neon)
+{
+	uint8_t pattern[16];
+	uint64_t word;
+	size_t ntrans = 0;
+	size_t n;
+
+	(void) narrow;
+	memset(pattern, value, sizeof(pattern));
+	word = 0x0101010101010101ULL * value;
+
+	n = head_len(dst, w, len);
+	if (n) {
+		ntrans += partial_write(dst, pattern, n);
+		dst += n;
+		len -= n;
+	}
+#if defined(__ARM_NEON)
+	if (neon) {
+		uint32x4_t quad = vreinterpretq_u32_u8(vdupq_n_u8(value));
+
+		while (len >= 16) {
+			vst1q_u32((uint32_t *) dst, quad);
+			dst += 16;
+			len -= 16;
+			ntrans++;
+		}
+	}
+#else
+	(void) neon;
+#endif
+	while (len >= w) {
+		dev_store(dst, w, word);
+		dst += w;
+		len -= w;
+		ntrans++;
+	}
+	if (len) {
+		ntrans += partial_write(dst, pattern, len);
+	}
+	return ntrans;
+}
+
+/* Reads a bus word at a time and stops at the first word that differs */
+static inline size_t generic_compare(const volatile uint8_t *src,
+		const uint8_t *buf, size_t len, int narrow, unsigned int w,
+		size_t *equal)
+{
+	uint8_t word[8];
+	size_t ntrans = 0;
+	size_t pos = 0;
+	size_t n;
+
+	while (pos != len) {
+		n = head_len(src + pos, w, len - pos);
+		if (!n) {
+			n = ((len - pos) < w) ? (len - pos) : w;
+		}
+		if (n == w) {
+			uint64_t value = dev_load(src + pos, w);
+
+			memcpy(word, &value, w);
+			ntrans++;
+		} else {
+			ntrans += partial_read(word, src + pos, n, w, narrow);
+		}
+		if (memcmp(word, buf + pos, n)) {
+			for (size_t i = 0; i < n; i++) {
+				if (word[i] != buf[pos + i]) {
+					pos += i;
+					break;
+				}
+			}
+			break;
+		}
+		pos += n;
+	}
+	*equal = pos;
+	return ntrans;
+}
+
+#define DEFINE_KERNELS(suffix, w, neon)						\
+static size_t write_##suffix(volatile uint8_t *dst, const uint8_t *src,		\
+		size_t len, int narrow)						\
+{										\
+	return generic_write(dst, src, len, narrow, w, neon);			\
+}										\
+static size_t read_##suffix(uint8_t *dst, const volatile uint8_t *src,		\
+		size_t len, int narrow)						\
+{										\
+	return generic_read(dst, src, len, narrow, w, neon);			\
+}										\
+static size_t fill_##suffix(volatile uint8_t *dst, uint8_t value,		\
+		size_t len, int narrow)						\
+{										\
+	return generic_fill(dst, value, len, narrow, w, neon);			\
+}										\
+static size_t compare_##suffix(const volatile uint8_t *src,			\
+		const uint8_t *buf, size_t len, int narrow, size_t *equal)	\
+{										\
+	return generic_compare(src, buf, len, narrow, w, equal);		\
+}
+
+DEFINE_KERNELS(8, 1, 0)
+DEFINE_KERNELS(16, 2, 0)
+DEFINE_KERNELS(32, 4, 0)
+DEFINE_KERNELS(64, 8, 0)
+#if defined(__ARM_NEON)
+DEFINE_KERNELS(32_neon, 4, 1)
+DEFINE_KERNELS(64_neon, 8, 1)
+#endif
+
+/* Ordered by width, with the preferred set for each width first */
+static const struct bram_kernels kernel_table[] = {
+	{ "8-bit", 8, write_8, read_8, fill_8, compare_8 },
+	{ "16-bit", 16, write_16, read_16, fill_16, compare_16 },
+#if defined(__ARM_NEON)
+	{ "32-bit NEON", 32, write_32_neon, read_32_neon, fill_32_neon,
+		compare_32_neon },
+#endif
+	{ "32-bit", 32, write_32, read_32, fill_32, compare_32 },
+#if defined(__ARM_NEON)
+	{ "64-bit NEON", 64, write_64_neon, read_64_neon, fill_64_neon,
+		compare_64_neon },
+#endif
+	{ "64-bit", 64, write_64, read_64, fill_64, compare_64 },
+};
+
+#define NUM_KERNELS	(sizeof(kernel_table) / sizeof(kernel_table[0]))
+
+const struct bram_kernels *bram_kernels_select(unsigned int width)
+{
+	const struct bram_kernels *best = &kernel_table[0];
+
+	/* Take the first set of the widest width that does not exceed the bus */
+	for (size_t i = 0; i < NUM_KERNELS; i++) {
+		if ((kernel_table[i].width <= width) &&
+				(kernel_table[i].width > best->width)) {
+			best = &kernel_table[i];
+		}
+	}
+	return best;
+}
+
+const struct bram_kernels *bram_kernels_get(size_t index)
+{
+	return (index < NUM_KERNELS) ? &kernel_table[index] : NULL;
+}
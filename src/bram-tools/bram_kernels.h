@@ -0,0 +1,49 @@
+#ifndef BRAM_KERNELS_H
+#define BRAM_KERNELS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Bulk access loops specialized for one AXI data width. Every loop moves the
+ * aligned body of a range with accesses of the full bus width (or NEON bursts
+ * of it) and only differs in how the partial words at either end are handled.
+ * Those are always written with single-beat byte, halfword or word stores,
+ * which the controller takes whether or not it supports narrow bursts, as that
+ * property only covers bursts of more than one beat. narrow only decides
+ * whether a partial word is read a byte at a time or as one full word.
+ *
+ * All of them return the number of bus transactions they issued.
+ */
+struct bram_kernels {
+	const char *name;
+	/* Data width in bits this set was written for */
+	unsigned int width;
+	size_t (*write)(volatile uint8_t *dst, const uint8_t *src, size_t len,
+			int narrow);
+	size_t (*read)(uint8_t *dst, const volatile uint8_t *src, size_t len,
+			int narrow);
+	size_t (*fill)(volatile uint8_t *dst, uint8_t value, size_t len,
+			int narrow);
+	/*
+	 * Compare device memory against buf, storing the number of leading
+	 * bytes that are equal in *equal
+	 */
+	size_t (*compare)(const volatile uint8_t *src, const uint8_t *buf,
+			size_t len, int narrow, size_t *equal);
+};
+
+/*
+ * Pick the fastest set of kernels that is legal for a controller of the given
+ * data width in bits. Widths wider than any kernel get the widest one.
+ */
+const struct bram_kernels *bram_kernels_select(unsigned int width);
+
+/*
+ * Every set built into the library in the order they are preferred in, or
+ * NULL once index is past the last one. For benchmarking them against each
+ * other, the rest of the library goes through bram_kernels_select().
+ */
+const struct bram_kernels *bram_kernels_get(size_t index);
+
+#endif /* BRAM_KERNELS_H */
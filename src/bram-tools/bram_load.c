@@ -1,31 +1,249 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <inttypes.h>
 #include <getopt.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include "bram_resource.h"
 #include "bram_helper.h"
+#include "bram_access.h"
+#include "bram_hash.h"
+#include "bram_image.h"
+#include "bram_session.h"
+#include "bram_ingest.h"
+#include "bram_snapshot.h"
+#include "bram_pipe.h"
+#include "bram_decomp.h"
+
+/*
+ * Source files are read in blocks of this size - it needs to stay a multiple
+ * of the widest store so that block boundaries do not disturb alignment
+ */
+#define LOAD_BLOCK_SIZE		(16 * 1024)
+
+/*
+ * How files go to the block RAM. A depth of 0 reads and writes each block in
+ * turn, anything else reads ahead on a helper thread, see bram_pipe.h.
+ */
+struct load_pipe {
+	size_t chunk_size;
+	unsigned int depth;
+};
+
+/* Long options without a short equivalent */
+enum {
+	OPT_STATS = 0x100,
+	OPT_CHUNK,
+	OPT_DEPTH,
+	OPT_WAIT,
+};
 
 void print_usage()
 {
-	fprintf(stderr, "Usage: bram_load UIO MAP LOAD_ADDR FILENAME\n");
+	fprintf(stderr, "Usage: bram_load [-d|--diff] [-v|--verify] [-f FORMAT] [-b BASE] "
+			"[-P [--chunk SIZE] [--depth N]] UIO MAP LOAD_ADDR FILENAME\n");
+	fprintf(stderr, "       bram_load [-d|--diff] [-v|--verify] IMAGE\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  %-15s%-30s\n", "-d, --diff", "only write words that differ");
+	fprintf(stderr, "  %-15s%-30s\n", "-v, --verify", "read back and compare after "
+			"writing");
+	fprintf(stderr, "  %-15s%-30s\n", "-f, --format", "raw, ihex, srec or xex instead of "
+			"guessing");
+	fprintf(stderr, "  %-15s%-30s\n", "-b, --base", "address in the file that lands at "
+			"LOAD_ADDR");
+	fprintf(stderr, "  %-15s%-30s\n", "-P, --pipeline", "read the file ahead on a helper "
+			"thread");
+	fprintf(stderr, "  %-15s%-30s\n", "--chunk SIZE", "bytes per pipelined read, in hex "
+			"(default 10000)");
+	fprintf(stderr, "  %-15s%-30s\n", "--depth N", "chunks read ahead of the bus "
+			"(default 4)");
+	fprintf(stderr, "  %-15s%-30s\n", "--wait MS", "give up on a locked map after "
+			"MS ms");
+	fprintf(stderr, "  %-15s%-30s\n", "--stats[=json]", "print time spent per phase");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Intel HEX, S-record and ld65 atari-style (xex) files are recognized\n");
+	fprintf(stderr, "from their first bytes. Each record is written at LOAD_ADDR plus\n");
+	fprintf(stderr, "its address less BASE, which defaults to 0. Files compressed with\n");
+	fprintf(stderr, "gzip, LZ4 or zstd are decompressed as they are loaded, as far as\n");
+	fprintf(stderr, "this build supports them.\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "An IMAGE written by bram_dump --sparse carries its own map names\n");
+	fprintf(stderr, "and load addresses, and only the ranges it covers are written.\n");
 	return;
 }
 
-int load_file_to_addr(struct bram_resource *bram, FILE *file,
-		uint16_t file_size, uint16_t load_addr)
+/* Outcome of reading each block back as soon as it has been written */
+struct load_verify {
+	size_t mismatched;
+	size_t first_mismatch;
+	uint32_t crc;
+};
+
+/* The block is read back into a snapshot taken of the map it went to */
+static int verify_block(struct bram_snapshot *snap, size_t offset,
+		const uint8_t *expected, size_t len, struct load_verify *verify,
+		struct bram_xfer_stats *stats)
 {
-	/*
-	 * This needs to be an integer so we can properly read from fgetc() but
-	 * will be cast to a uint8_t so we can write to the block RAM properly
-	 */
-	int rd_byte;
-	uint16_t num_written;
+	const uint8_t *readback;
+
+	if (bram_snapshot_take(snap, offset, len, stats)) {
+		return -1;
+	}
+	readback = bram_snapshot_ptr(snap, offset, len);
+	if (memcmp(readback, expected, len)) {
+		for (size_t i = 0; i < len; i++) {
+			if (readback[i] == expected[i]) {
+				continue;
+			}
+			if (!verify->mismatched) {
+				verify->first_mismatch = offset + i;
+			}
+			verify->mismatched++;
+		}
+	}
+	verify->crc = bram_crc32(verify->crc, readback, len);
+	return 0;
+}
+
+/*
+ * Source of bram_pipe_run() for both raw files and object files. With a
+ * size the file has to hold exactly that many bytes, otherwise it is read to
+ * its end. Pipelined reads ask the kernel to start on the chunks the helper
+ * thread will want next, so a cold SD card is kept busy while the bus works.
+ * Compressed files are decompressed straight into the chunk buffers, which
+ * then go to the bus as if they had been read from a raw file.
+ */
+struct file_reader {
+	int fd;
+	struct bram_decomp *decomp;
+	struct bram_perf *perf;
+	bool sized;
+	size_t remaining;
+	off_t pos;
+	/* Bytes to prefetch past each read, 0 to leave readahead to the kernel */
+	size_t ahead;
+};
+
+static void file_reader_init(struct file_reader *reader, int fd,
+		struct bram_decomp *decomp, struct bram_perf *perf,
+		const struct load_pipe *pipe)
+{
+	memset(reader, 0, sizeof(*reader));
+	reader->fd = fd;
+	reader->decomp = decomp;
+	reader->perf = perf;
+	if (pipe->depth) {
+		/* Offsets into the decompressed data say nothing about the file's */
+		reader->ahead = decomp ? 0 : pipe->chunk_size * pipe->depth;
+		/* Fails harmlessly on pipes and the like */
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+	return;
+}
+
+static ssize_t read_file_chunk(void *arg, uint8_t *buf, size_t len)
+{
+	struct file_reader *reader = arg;
+	ssize_t num_read;
+	uint64_t t_file;
+
+	if (reader->sized) {
+		if (!reader->remaining) {
+			return 0;
+		}
+		len = (len < reader->remaining) ? len : reader->remaining;
+	}
+	t_file = bram_perf_start(reader->perf);
+	if (reader->decomp) {
+		num_read = bram_decomp_read(reader->decomp, buf, len);
+	} else {
+		do {
+			num_read = read(reader->fd, buf, len);
+		} while ((num_read < 0) && (errno == EINTR));
+		if (num_read < 0) {
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+		}
+	}
+	bram_perf_record(reader->perf, BRAM_PHASE_FILE, t_file,
+			(num_read > 0) ? (size_t) num_read : 0);
+	if (num_read < 0) {
+		return -1;
+	}
+	/* Treat an EOF short of the size as an aberrant condition */
+	if (!num_read && reader->sized) {
+		fprintf(stderr, "Error: Unexpected EOF\n");
+		return -1;
+	}
+	reader->pos += num_read;
+	reader->remaining -= reader->sized ? (size_t) num_read : 0;
+	if (reader->ahead && num_read) {
+		posix_fadvise(reader->fd, reader->pos, reader->ahead,
+				POSIX_FADV_WILLNEED);
+	}
+	return num_read;
+}
+
+/* Sink of bram_pipe_run() writing consecutive chunks of a raw file */
+struct map_writer {
+	struct bram_resource *bram;
+	size_t offset;
+	/* Only reached by compressed files, whose size is not known up front */
+	size_t end;
+	size_t *changed;
+	struct load_verify *verify;
+	struct bram_xfer_stats *stats;
+	struct bram_snapshot readback;
+};
+
+static int write_map_chunk(void *arg, const uint8_t *buf, size_t len)
+{
+	struct map_writer *writer = arg;
+	int result;
 
-	uint8_t *map_pos = NULL;
+	if (len > (writer->end - writer->offset)) {
+		fprintf(stderr, "Error: Decompressed data does not fit in the block RAM "
+				"at the load address\n");
+		return -1;
+	}
+	if (writer->changed) {
+		result = bram_write_diff(writer->bram, writer->offset, buf, len,
+				writer->changed, writer->stats);
+	} else {
+		result = bram_write_range(writer->bram, writer->offset, buf, len,
+				writer->stats);
+	}
+	if (!result && writer->verify) {
+		result = verify_block(&writer->readback, writer->offset, buf, len,
+				writer->verify, writer->stats);
+	}
+	writer->offset += len;
+	return result;
+}
+
+/*
+ * With changed set, each block is compared against what is already in the
+ * block RAM and only differing words are written, with their count added to
+ * changed. Otherwise every block is written unconditionally. With verify set,
+ * each block is read back straight after it is written and compared. Blocks
+ * are filled completely before they are handed to the bus so that a short
+ * read does not break the store alignment of every block that follows it.
+ * With decomp set, file_size is ignored and the file is decompressed up to
+ * its end, with the amount left in decomp->bytes_out.
+ */
+int load_file_to_addr(struct bram_resource *bram, int fd,
+		struct bram_decomp *decomp, size_t file_size, size_t load_addr,
+		size_t *changed,
+		struct load_verify *verify, struct bram_xfer_stats *stats,
+		const struct load_pipe *pipe)
+{
+	struct file_reader reader;
+	struct map_writer writer;
+	int retval;
 
 	if (!bram) {
 		fprintf(stderr, "Error: Failed NULL pointer check\n");
@@ -36,68 +254,414 @@ int load_file_to_addr(struct bram_resource *bram, FILE *file,
 	 * First, check that the load address and the amount of data to be
 	 * written are not too large
 	 */
-	if (file_size > (bram->map_size - load_addr)) {
+	if ((load_addr > bram->map_size) || (!decomp &&
+				(file_size > (bram->map_size - load_addr)))) {
 		fprintf(stderr, "Error: File size too large or load address too high for "
 				"block RAM\n");
 		return -1;
 	}
+	if (!decomp && !file_size) {
+		return 0;
+	}
 
-	/*View this file as a sequence of bytes since it can be any size */
-	map_pos = (uint8_t *) bram->map;
-	if (!map_pos) {
-		fprintf(stderr, "Error: Failed NULL pointer check\n");
+	file_reader_init(&reader, fd, decomp, bram->perf, pipe);
+	reader.sized = !decomp;
+	reader.remaining = file_size;
+	writer.bram = bram;
+	writer.offset = load_addr;
+	writer.end = bram->map_size;
+	writer.changed = changed;
+	writer.verify = verify;
+	writer.stats = stats;
+	bram_snapshot_init(&writer.readback, bram);
+
+	retval = bram_pipe_run(pipe->chunk_size, pipe->depth, read_file_chunk,
+			&reader, write_map_chunk, &writer);
+	bram_snapshot_free(&writer.readback);
+	return retval;
+}
+
+/* Where decoded runs of an object file are written to */
+struct record_load {
+	struct bram_resource *bram;
+	size_t load_addr;
+	uint32_t base;
+	size_t *changed;
+	struct load_verify *verify;
+	struct bram_xfer_stats *stats;
+	struct bram_snapshot readback;
+};
+
+static int load_run(uint32_t addr, const uint8_t *data, size_t len, void *arg)
+{
+	struct record_load *load = arg;
+	size_t room = load->bram->map_size - load->load_addr;
+	size_t offset;
+
+	if ((addr < load->base) || ((addr - load->base) > room) ||
+			(len > (room - (addr - load->base)))) {
+		fprintf(stderr, "Error: Data at 0x%04x falls outside the block RAM\n",
+				(unsigned int) addr);
 		return -1;
 	}
-	/*
-	 * Addition is safe, because we've already checked the amount of data we're
-	 * going to copy and cast the pointer we are going to start writing to
-	 * as a pointer to bytes
-	 */
-	map_pos = map_pos + load_addr;
-	/* Iterate over the file and treat an EOF as an aberrant condition */
-	num_written = 0;
-	while (num_written != file_size) {
-		/*
-		 * Do not use getc() here because it may be implemented as a
-		 * macro that reads the stream twice and hardware may have a
-		 * desire to count transactions.
-		 */
-		rd_byte = fgetc(file);
-		if (rd_byte == EOF) {
-			fprintf(stderr, "Error: Unexpected EOF\n");
+	offset = load->load_addr + (addr - load->base);
+	if (load->changed) {
+		if (bram_write_diff(load->bram, offset, data, len, load->changed,
+					load->stats)) {
 			return -1;
 		}
-		*map_pos = (uint8_t) rd_byte;
-		map_pos++;
-		num_written++;
+	} else if (bram_write_range(load->bram, offset, data, len, load->stats)) {
+		return -1;
+	}
+	if (load->verify) {
+		return verify_block(&load->readback, offset, data, len, load->verify,
+				load->stats);
 	}
 	return 0;
 }
 
+static int feed_records(void *arg, const uint8_t *buf, size_t len)
+{
+	return bram_ingest_feed(arg, buf, len);
+}
+
+/*
+ * Decode an object file in a single pass, writing each contiguous run to the
+ * block RAM as soon as the decoder has it complete
+ */
+int load_records(struct bram_resource *bram, int fd,
+		struct bram_decomp *decomp, enum bram_ingest_format format,
+		size_t load_addr, uint32_t base,
+		size_t *changed, struct load_verify *verify,
+		struct bram_xfer_stats *stats, struct bram_ingest *ingest,
+		const struct load_pipe *pipe)
+{
+	struct record_load load;
+	struct file_reader reader;
+	int retval;
+
+	if (load_addr > bram->map_size) {
+		fprintf(stderr, "Error: Load address too high for block RAM\n");
+		return -1;
+	}
+	load.bram = bram;
+	load.load_addr = load_addr;
+	load.base = base;
+	load.changed = changed;
+	load.verify = verify;
+	load.stats = stats;
+	bram_snapshot_init(&load.readback, bram);
+	bram_ingest_init(ingest, format, load_run, &load);
+
+	file_reader_init(&reader, fd, decomp, bram->perf, pipe);
+	retval = bram_pipe_run(pipe->chunk_size, pipe->depth, read_file_chunk,
+			&reader, feed_records, ingest);
+	if (!retval) {
+		retval = bram_ingest_finish(ingest);
+	}
+	bram_snapshot_free(&load.readback);
+	return retval;
+}
+
+/*
+ * The format of a compressed file is told from the first bytes it
+ * decompresses to, after which decompression starts over from the top
+ */
+static int start_decomp(struct bram_decomp *decomp, int fd,
+		enum bram_compression compression, uint8_t *magic, size_t magic_size,
+		ssize_t *magic_len)
+{
+	if (bram_decomp_init(decomp, compression, fd)) {
+		return -1;
+	}
+	*magic_len = bram_decomp_read(decomp, magic, magic_size);
+	bram_decomp_free(decomp);
+	if (*magic_len < 0) {
+		return -1;
+	}
+	if (lseek(fd, 0, SEEK_SET) < 0) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	return bram_decomp_init(decomp, compression, fd);
+}
+
+/* Segments name their maps, which are opened the first time they come up */
+static struct bram_resource *image_map(struct bram_session *session,
+		const char *map_name)
+{
+	for (size_t i = 0; i < session->count; i++) {
+		if (!strcmp(session->maps[i].bram.map_name, map_name)) {
+			return &session->maps[i].bram;
+		}
+	}
+	if (bram_session_add_name(session, map_name)) {
+		return NULL;
+	}
+	return &session->maps[session->count - 1].bram;
+}
+
+/*
+ * Each segment is read and checked against its CRC in full before any of it
+ * is written, so a corrupt image never reaches the block RAM
+ */
+int load_image(int fd, bool diff, bool verify, struct bram_perf *perf,
+		const struct bram_lock *lock)
+{
+	struct bram_session session;
+	struct bram_image_segment segment;
+	struct bram_resource *bram;
+	struct bram_xfer_stats stats;
+	struct load_verify verify_result;
+	uint8_t *buf = NULL;
+	struct bram_snapshot readback;
+	uint32_t count;
+	size_t changed = 0;
+	size_t stored = 0;
+	size_t covered = 0;
+	uint64_t t_file;
+	int result;
+	int retval = 0;
+
+	bram_session_init(&session, 1);
+	session.perf = perf;
+	session.lock = lock;
+	bram_snapshot_init(&readback, NULL);
+	bram_xfer_stats_init(&stats);
+	t_file = bram_perf_start(perf);
+	if (bram_image_read_header(fd, &count)) {
+		return -1;
+	}
+	bram_perf_record(perf, BRAM_PHASE_FILE, t_file, BRAM_IMAGE_HEADER_SIZE);
+	for (uint32_t i = 0; i < count; i++) {
+		t_file = bram_perf_start(perf);
+		if (bram_image_read_segment(fd, &segment)) {
+			retval = -1;
+			break;
+		}
+		bram_perf_record(perf, BRAM_PHASE_FILE, t_file, BRAM_SEGMENT_HEADER_SIZE);
+		bram = image_map(&session, segment.map_name);
+		if (!bram) {
+			retval = -1;
+			break;
+		}
+		if ((segment.addr > bram->map_size) ||
+				(segment.len > (bram->map_size - segment.addr))) {
+			fprintf(stderr, "Error: Segment at 0x%04x of %u bytes does not fit "
+					"in %s\n", (unsigned int) segment.addr,
+					(unsigned int) segment.len, segment.map_name);
+			retval = -1;
+			break;
+		}
+		free(buf);
+		buf = malloc(segment.len ? segment.len : 1);
+		if (!buf) {
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			retval = -1;
+			break;
+		}
+		t_file = bram_perf_start(perf);
+		if (bram_image_read_data(fd, &segment, buf)) {
+			retval = -1;
+			break;
+		}
+		bram_perf_record(perf, BRAM_PHASE_FILE, t_file,
+				(segment.flags & BRAM_SEGMENT_ZERO) ? 0 : segment.len);
+
+		if (diff) {
+			result = bram_write_diff(bram, segment.addr, buf, segment.len,
+					&changed, &stats);
+		} else {
+			result = bram_write_range(bram, segment.addr, buf, segment.len,
+					&stats);
+		}
+		if (!result && verify) {
+			memset(&verify_result, 0, sizeof(verify_result));
+			/* Segments can move between maps, the buffer goes with them */
+			readback.bram = bram;
+			result = verify_block(&readback, segment.addr, buf, segment.len,
+					&verify_result, &stats);
+			if (!result && verify_result.mismatched) {
+				fprintf(stderr, "Error: Verify failed in %s, %zu bytes differ, "
+						"first at 0x%04zx\n", segment.map_name,
+						verify_result.mismatched, verify_result.first_mismatch);
+				result = -1;
+			}
+		}
+		if (result) {
+			retval = -1;
+			break;
+		}
+		printf("%-24s 0x%04x %6u bytes%s\n", segment.map_name,
+				(unsigned int) segment.addr, (unsigned int) segment.len,
+				(segment.flags & BRAM_SEGMENT_ZERO) ? " zeroed" : "");
+		covered += segment.len;
+		if (!(segment.flags & BRAM_SEGMENT_ZERO)) {
+			stored += segment.len;
+		}
+	}
+
+	if (!retval) {
+		printf("Loaded %"PRIu32" segments covering %zu bytes from %zu stored, in "
+				"%zu bus transactions", count, covered, stored,
+				stats.transactions);
+		if (diff) {
+			printf(", %zu changed words", changed);
+		}
+		printf("%s\n", verify ? ", verified" : "");
+	}
+	bram_snapshot_free(&readback);
+	free(buf);
+	if (bram_session_close(&session)) {
+		fprintf(stderr, "Error: Could not destroy block RAM resource\n");
+		retval = -1;
+	}
+	return retval;
+}
+
 int main(int argc, char *argv[])
 {
 	int uio_number;
 	int map_number;
-	uint16_t load_addr;
+	size_t load_addr;
 	char *filename;
-	FILE *file;
+	int fd;
 
-	uint16_t file_size;
+	off_t file_size = 0;
+	size_t loaded;
 	struct bram_resource bram;
+	struct bram_xfer_stats stats;
+	bool diff = false;
+	size_t changed = 0;
+	bool verify = false;
+	struct load_verify verify_result;
+	uint8_t magic[BRAM_IMAGE_MAGIC_SIZE];
+	ssize_t magic_len;
+	enum bram_compression compression;
+	struct bram_decomp decomp;
+	struct bram_decomp *decompp = NULL;
+	enum bram_ingest_format format = BRAM_FORMAT_RAW;
+	bool format_given = false;
+	struct bram_ingest ingest;
+	uint32_t base = 0;
+	char *endptr = NULL;
+	unsigned long value;
+	struct bram_perf perf;
+	struct bram_perf *perfp = NULL;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+	struct bram_lock lock;
+	struct load_pipe pipe = { LOAD_BLOCK_SIZE, 0 };
+	size_t chunk_size = BRAM_PIPE_DEFAULT_CHUNK;
+	unsigned int depth = BRAM_PIPE_DEFAULT_DEPTH;
+	bool pipelined = false;
 
+	static const struct option long_options[] = {
+		{ "diff", no_argument, NULL, 'd' },
+		{ "verify", no_argument, NULL, 'v' },
+		{ "format", required_argument, NULL, 'f' },
+		{ "base", required_argument, NULL, 'b' },
+		{ "pipeline", no_argument, NULL, 'P' },
+		{ "chunk", required_argument, NULL, OPT_CHUNK },
+		{ "depth", required_argument, NULL, OPT_DEPTH },
+		{ "wait", required_argument, NULL, OPT_WAIT },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
 	int opt;
 	int result;
 	int retval;
 	int num_pos_args;
-	while ((opt = getopt(argc, argv, "")) != -1) {
+	bram_lock_init(&lock, BRAM_LOCK_EXCLUSIVE);
+	bram_perf_init(&perf);
+	while ((opt = getopt_long(argc, argv, "dvf:b:P", long_options, NULL)) != -1) {
 		switch (opt) {
+			case 'd':
+				diff = true;
+				break;
+			case 'v':
+				verify = true;
+				break;
+			case 'f':
+				if (bram_ingest_parse_format(&format, optarg)) {
+					return 1;
+				}
+				format_given = true;
+				break;
+			case 'b':
+				errno = 0;
+				value = strtoul(optarg, &endptr, 16);
+				if (errno || (endptr == optarg) || *endptr || (*optarg == '-') ||
+						(value > UINT32_MAX)) {
+					fprintf(stderr, "Error: Bad base address\n");
+					return 1;
+				}
+				base = (uint32_t) value;
+				break;
+			case OPT_WAIT:
+				if (bram_lock_parse_wait(&lock.timeout_ms, optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				perfp = &perf;
+				break;
+			case 'P':
+				pipelined = true;
+				break;
+			case OPT_CHUNK:
+				if (bram_pipe_parse_chunk(&chunk_size, optarg)) {
+					return 1;
+				}
+				pipelined = true;
+				break;
+			case OPT_DEPTH:
+				if (bram_pipe_parse_depth(&depth, optarg)) {
+					return 1;
+				}
+				pipelined = true;
+				break;
 			default:
 				print_usage();
 				return 1;
 		}
 	}
 
+	if (pipelined) {
+		pipe.chunk_size = chunk_size;
+		pipe.depth = depth;
+	}
+
 	num_pos_args = argc - optind;
+	if (num_pos_args == 1) {
+		filename = argv[optind];
+		fd = open(filename, O_RDONLY);
+		if (fd < 0) {
+			fprintf(stderr, "Error: Could not open %s: %s\n", filename,
+					strerror(errno));
+			return 1;
+		}
+		magic_len = pread(fd, magic, sizeof(magic), 0);
+		compression = bram_decomp_detect(magic, (magic_len > 0) ? magic_len : 0);
+		if (compression != BRAM_COMPRESSION_NONE) {
+			fprintf(stderr, "Error: %s is %s compressed, images have to be "
+					"decompressed before they are loaded\n", filename,
+					bram_compression_name(compression));
+			retval = 1;
+		} else {
+			retval = load_image(fd, diff, verify, perfp, &lock) ? 1 : 0;
+		}
+		if (close(fd)) {
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			retval = 1;
+		}
+		if (stats_format) {
+			bram_perf_print(stderr, "bram_load", &perf, stats_format);
+		}
+		return retval;
+	}
 	if (num_pos_args != 4) {
 		fprintf(stderr, "Error: Incorrect number of positional arguments\n");
 		print_usage();
@@ -105,7 +669,7 @@ int main(int argc, char *argv[])
 	}
 	uio_number = atoi(argv[optind]);
 	map_number = atoi(argv[optind + 1]);
-	result = str_to_uint16(&load_addr, argv[optind + 2]);
+	result = str_to_size(&load_addr, argv[optind + 2]);
 	if (result) {
 		fprintf(stderr, "Could not obtain load address\n");
 		return 1;
@@ -113,9 +677,10 @@ int main(int argc, char *argv[])
 
 	filename = argv[optind + 3];
 	/* We error out if the file does not exist - do not create one */
-	file = fopen(filename, "r");
-	if (!file) {
-		fprintf(stderr, "Error: Failed NULL pointer check\n");
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Could not open %s: %s\n", filename,
+				strerror(errno));
 		return 1;
 	}
 
@@ -125,26 +690,129 @@ int main(int argc, char *argv[])
 	 * file size, creating / destroying the block RAM resource, etc.).
 	 */
 	retval = 0;
-	result = get_file_size(fileno(file), &file_size);
-	if (result) {
-		fprintf(stderr, "Error: Could not obtain file size\n");
+	/* Loading an image raw would write its headers into the block RAM */
+	magic_len = pread(fd, magic, sizeof(magic), 0);
+	if (magic_len < 0) {
+		magic_len = 0;
+	}
+	compression = bram_decomp_detect(magic, magic_len);
+	if (compression != BRAM_COMPRESSION_NONE) {
+		if (!bram_decomp_supported(compression)) {
+			fprintf(stderr, "Error: %s is %s compressed, which this build of "
+					"bram_load cannot read\n", filename,
+					bram_compression_name(compression));
+			retval = 1;
+			goto exit;
+		}
+		if (start_decomp(&decomp, fd, compression, magic, sizeof(magic),
+					&magic_len)) {
+			retval = 1;
+			goto exit;
+		}
+		decompp = &decomp;
+	}
+	if (bram_image_detect(magic, magic_len)) {
+		if (decompp) {
+			fprintf(stderr, "Error: %s is a compressed block RAM image, it has "
+					"to be decompressed before it is loaded\n", filename);
+		} else {
+			fprintf(stderr, "Error: %s is a block RAM image, load it with "
+					"`bram_load %s'\n", filename, filename);
+		}
 		retval = 1;
-		goto exit;	
+		goto exit;
+	}
+	if (!format_given) {
+		format = bram_ingest_detect(magic, magic_len);
+	}
+	if ((format == BRAM_FORMAT_RAW) && !decompp) {
+		result = get_file_size(fd, &file_size);
+		if (result) {
+			fprintf(stderr, "Error: Could not obtain file size\n");
+			retval = 1;
+			goto exit;
+		}
+		/* Checked against the map once it is open, this only guards the cast */
+		if ((uintmax_t) file_size > SIZE_MAX) {
+			fprintf(stderr, "Error: File size too large for block RAM\n");
+			retval = 1;
+			goto exit;
+		}
 	}
 
-	result = bram_create(&bram, uio_number, map_number);
+	/*
+	 * The extent of an object file is only known once it is decoded, and that
+	 * of a compressed one once it is decompressed
+	 */
+	lock.offset = load_addr;
+	lock.len = ((format == BRAM_FORMAT_RAW) && !decompp) ?
+		(size_t) file_size : 0;
+	result = bram_create_locked(&bram, uio_number, map_number, perfp, &lock);
 	if (result) {
 		fprintf(stderr, "Error: Could not create block RAM resource\n");
 		retval = 1;
 		goto exit;
 	}
 
-	result = load_file_to_addr(&bram, file, file_size, load_addr);
-	if (result) {
-		fprintf(stderr, "Error: Could not load file to block RAM\n");
-		retval = 1;
+	bram_xfer_stats_init(&stats);
+	memset(&verify_result, 0, sizeof(verify_result));
+	if (format != BRAM_FORMAT_RAW) {
+		result = load_records(&bram, fd, decompp, format, load_addr, base,
+				diff ? &changed : NULL, verify ? &verify_result : NULL, &stats,
+				&ingest, &pipe);
+		if (result) {
+			fprintf(stderr, "Error: Could not load file to block RAM\n");
+			retval = 1;
+		} else {
+			printf("Loaded %zu bytes in %zu runs from %zu %s records in %zu bus "
+					"transactions", ingest.bytes, ingest.runs, ingest.records,
+					bram_ingest_format_name(format), stats.transactions);
+			if (diff) {
+				printf(", %zu changed words", changed);
+			}
+			if (decompp) {
+				printf(", decompressed from %zu bytes of %s", decomp.bytes_in,
+						bram_compression_name(compression));
+			}
+			printf("\n");
+		}
+		loaded = ingest.bytes;
+	} else {
+		result = load_file_to_addr(&bram, fd, decompp, (size_t) file_size,
+				load_addr, diff ? &changed : NULL,
+				verify ? &verify_result : NULL, &stats, &pipe);
+		loaded = decompp ? decomp.bytes_out : (size_t) file_size;
+		if (result) {
+			fprintf(stderr, "Error: Could not load file to block RAM\n");
+			retval = 1;
+		} else {
+			if (diff) {
+				printf("Compared %zu bytes at 0x%04zx, wrote %zu changed "
+						"words in %zu bus transactions", loaded, load_addr,
+						changed, stats.transactions);
+			} else {
+				printf("Loaded %zu bytes at 0x%04zx in %zu bus "
+						"transactions", loaded, load_addr, stats.transactions);
+			}
+			if (decompp) {
+				printf(", decompressed from %zu bytes of %s", decomp.bytes_in,
+						bram_compression_name(compression));
+			}
+			printf("\n");
+		}
+	}
+	if (!result && verify) {
+		if (verify_result.mismatched) {
+			fprintf(stderr, "Error: Verify failed, %zu bytes differ, first at "
+					"0x%04zx\n", verify_result.mismatched,
+					verify_result.first_mismatch);
+			retval = 1;
+		} else {
+			printf("Verified %zu bytes, crc32 %08"PRIx32"\n", loaded,
+					verify_result.crc);
+		}
 	}
-	
+
 	result = bram_destroy(&bram);
 	if (result) {
 		fprintf(stderr, "Error: Could not destroy block RAM resource\n");
@@ -153,11 +821,17 @@ int main(int argc, char *argv[])
 	}
 
 exit:
-	result = fclose(file);
+	if (decompp) {
+		bram_decomp_free(decompp);
+	}
+	result = close(fd);
 	if (result) {
 		fprintf(stderr, "Error: %s\n", strerror(errno));
 		retval = 1;
 	}
+	if (stats_format) {
+		bram_perf_print(stderr, "bram_load", &perf, stats_format);
+	}
 
 	return retval;
 
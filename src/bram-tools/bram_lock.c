@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "bram_resource.h"
+#include "bram_helper.h"
+
+#define BRAM_LOCK_DIR			"/run/lock"
+#define BRAM_LOCK_DIR_ENV		"BRAM_LOCK_DIR"
+#define BRAM_LOCK_PATH_SIZE		160
+
+/* How often a lock with a timeout is tried again while it is held elsewhere */
+#define LOCK_POLL_NS			(10 * 1000 * 1000)
+
+void bram_lock_init(struct bram_lock *lock, enum bram_lock_mode mode)
+{
+	memset(lock, 0, sizeof(*lock));
+	lock->mode = mode;
+	lock->timeout_ms = BRAM_LOCK_WAIT_FOREVER;
+	return;
+}
+
+int bram_lock_parse_wait(int *timeout_ms, const char *str)
+{
+	char *endptr = NULL;
+	unsigned long value;
+
+	errno = 0;
+	value = strtoul(str, &endptr, 10);
+	if (errno || (endptr == str) || *endptr || (*str == '-') ||
+			(value > INT_MAX)) {
+		fprintf(stderr, "Error: Bad lock timeout `%s'\n", str);
+		return -1;
+	}
+	*timeout_ms = (int) value;
+	return 0;
+}
+
+/*
+ * Open file description locks belong to the descriptor rather than the
+ * process, so two resources in the same process, say on two threads, conflict
+ * with each other like they would across processes. Kernels that predate them
+ * get the classic per-process locks instead.
+ */
+static int try_lock(int fd, struct flock *fl, int wait)
+{
+	int result;
+
+	result = fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, fl);
+	if (result && (errno == EINVAL)) {
+		result = fcntl(fd, wait ? F_SETLKW : F_SETLK, fl);
+	}
+	return result;
+}
+
+/* A reader that cannot write the file can still take a shared lock */
+static int open_lock_file(struct bram_resource *bram, bool shared)
+{
+	char path[BRAM_LOCK_PATH_SIZE];
+	int result;
+	int fd;
+
+	result = snprintf(path, sizeof(path), "%s/bram-%08"PRIx32".lock",
+			bram_env_path(BRAM_LOCK_DIR_ENV, BRAM_LOCK_DIR), bram->map_addr);
+	if ((result < 0) || (result >= (int) sizeof(path))) {
+		fprintf(stderr, "Path name too long\n");
+		return -1;
+	}
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if ((fd < 0) && shared && (errno == EACCES)) {
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+	}
+	if (fd < 0) {
+		fprintf(stderr, "Error: Could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	return fd;
+}
+
+int bram_lock_range(struct bram_resource *bram, const struct bram_lock *lock)
+{
+	struct timespec pause = { 0, LOCK_POLL_NS };
+	struct flock fl;
+	uint64_t deadline;
+	bool shared;
+	int result;
+	int fd;
+
+	if (!bram || !lock) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	shared = (lock->mode == BRAM_LOCK_SHARED);
+	/* The file stays open between ranges taken on the same resource */
+	fd = bram->lock_fd;
+	if ((fd < 0) && ((fd = open_lock_file(bram, shared)) < 0)) {
+		return -1;
+	}
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = shared ? F_RDLCK : F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = (off_t) lock->offset;
+	fl.l_len = (off_t) lock->len;
+	result = try_lock(fd, &fl, 0);
+	if (result && ((errno == EAGAIN) || (errno == EACCES)) && lock->timeout_ms) {
+		fprintf(stderr, "Waiting for %s to be unlocked\n", bram->map_name);
+		if (lock->timeout_ms == BRAM_LOCK_WAIT_FOREVER) {
+			do {
+				result = try_lock(fd, &fl, 1);
+			} while (result && (errno == EINTR));
+		} else {
+			deadline = bram_clock_ns() + (uint64_t) lock->timeout_ms * 1000000;
+			do {
+				nanosleep(&pause, NULL);
+				result = try_lock(fd, &fl, 0);
+			} while (result && ((errno == EAGAIN) || (errno == EACCES)) &&
+					(bram_clock_ns() < deadline));
+		}
+	}
+	if (result) {
+		if ((errno == EAGAIN) || (errno == EACCES)) {
+			fprintf(stderr, "Error: %s is locked by another user\n",
+					bram->map_name);
+		} else {
+			fprintf(stderr, "Error: Could not lock %s: %s\n", bram->map_name,
+					strerror(errno));
+		}
+		if (fd != bram->lock_fd) {
+			close(fd);
+		}
+		return -1;
+	}
+	bram->lock_fd = fd;
+	return 0;
+}
+
+int bram_unlock_range(struct bram_resource *bram)
+{
+	struct flock fl;
+
+	if (!bram) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if (bram->lock_fd < 0) {
+		return 0;
+	}
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_UNLCK;
+	fl.l_whence = SEEK_SET;
+	if (try_lock(bram->lock_fd, &fl, 0)) {
+		fprintf(stderr, "Error: Could not unlock %s: %s\n", bram->map_name,
+				strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/* Closing the only descriptor for the file drops the lock along with it */
+void bram_lock_release(struct bram_resource *bram)
+{
+	if (bram->lock_fd >= 0) {
+		close(bram->lock_fd);
+		bram->lock_fd = -1;
+	}
+	return;
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "bram_match.h"
+
+/*
+ * Horspool skip for each byte value is the distance from the last position
+ * (excluding the final one) where that byte could match to the end of the
+ * pattern. With masks a byte can match at several positions at once, and a
+ * wildcard matches everything, which caps every skip at its distance.
+ */
+static void build_skip(struct bram_match_pattern *pat)
+{
+	size_t last = pat->len - 1;
+	size_t dist;
+
+	for (int b = 0; b < 256; b++) {
+		pat->skip[b] = pat->len;
+	}
+	for (size_t i = 0; i < last; i++) {
+		dist = last - i;
+		if (!pat->mask[i]) {
+			for (int b = 0; b < 256; b++) {
+				pat->skip[b] = dist;
+			}
+			continue;
+		}
+		for (int b = 0; b < 256; b++) {
+			if (((uint8_t) b & pat->mask[i]) == pat->value[i]) {
+				pat->skip[b] = dist;
+			}
+		}
+	}
+	return;
+}
+
+static int hex_nibble(char c, uint8_t *value, uint8_t *mask)
+{
+	if (c == '?') {
+		*value = 0;
+		*mask = 0;
+		return 0;
+	}
+	if (!isxdigit((unsigned char) c)) {
+		return -1;
+	}
+	*value = (uint8_t) (isdigit((unsigned char) c) ? (c - '0') :
+			(tolower((unsigned char) c) - 'a' + 10));
+	*mask = 0xf;
+	return 0;
+}
+
+int bram_match_compile_hex(struct bram_match_pattern *pat, const char *hex)
+{
+	uint8_t hi_value;
+	uint8_t hi_mask;
+	uint8_t lo_value;
+	uint8_t lo_mask;
+	const char *p = hex;
+
+	if (!pat || !hex) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	pat->len = 0;
+	while (*p) {
+		if (isspace((unsigned char) *p)) {
+			p++;
+			continue;
+		}
+		if (pat->len == BRAM_MATCH_MAX_LEN) {
+			fprintf(stderr, "Error: Pattern longer than %d bytes\n",
+					BRAM_MATCH_MAX_LEN);
+			return -1;
+		}
+		if (hex_nibble(p[0], &hi_value, &hi_mask) || !p[1] ||
+				hex_nibble(p[1], &lo_value, &lo_mask)) {
+			fprintf(stderr, "Error: Bad hex pattern `%s'\n", hex);
+			return -1;
+		}
+		pat->value[pat->len] = (uint8_t) ((hi_value << 4) | lo_value);
+		pat->mask[pat->len] = (uint8_t) ((hi_mask << 4) | lo_mask);
+		pat->len++;
+		p += 2;
+	}
+	if (!pat->len) {
+		fprintf(stderr, "Error: Empty pattern\n");
+		return -1;
+	}
+	build_skip(pat);
+	return 0;
+}
+
+int bram_match_compile_bytes(struct bram_match_pattern *pat, const void *bytes,
+		size_t len)
+{
+	if (!pat || !bytes) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if (!len || (len > BRAM_MATCH_MAX_LEN)) {
+		fprintf(stderr, "Error: Pattern has to be 1 to %d bytes\n",
+				BRAM_MATCH_MAX_LEN);
+		return -1;
+	}
+	pat->len = len;
+	memcpy(pat->value, bytes, len);
+	memset(pat->mask, 0xff, len);
+	build_skip(pat);
+	return 0;
+}
+
+static inline int match_at(const struct bram_match_pattern *pat,
+		const uint8_t *p)
+{
+	/* The last byte was already checked by the caller */
+	for (size_t i = pat->len - 1; i--;) {
+		if ((p[i] & pat->mask[i]) != pat->value[i]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+size_t bram_match_scan(const struct bram_match_pattern *pat, const uint8_t *buf,
+		size_t len, size_t base, bram_match_fn fn, void *arg)
+{
+	size_t last;
+	size_t pos = 0;
+	size_t found = 0;
+	uint8_t tail;
+
+	if (!pat || !buf || !pat->len || (len < pat->len)) {
+		return 0;
+	}
+	last = pat->len - 1;
+	while (pos <= len - pat->len) {
+		tail = buf[pos + last];
+		if (((tail & pat->mask[last]) == pat->value[last]) &&
+				match_at(pat, buf + pos)) {
+			found++;
+			if (fn && fn(base + pos, arg)) {
+				break;
+			}
+		}
+		pos += pat->skip[tail];
+	}
+	return found;
+}
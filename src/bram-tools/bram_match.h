@@ -0,0 +1,47 @@
+#ifndef BRAM_MATCH_H
+#define BRAM_MATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Longest pattern that can be compiled */
+#define BRAM_MATCH_MAX_LEN		256
+
+/*
+ * A byte pattern where each position only has to match under its mask, so
+ * a zero mask is a wildcard byte and a 0xf0 mask leaves the low nibble free.
+ * The skip table is what makes the Boyer-Moore-Horspool scan work.
+ */
+struct bram_match_pattern {
+	size_t len;
+	uint8_t value[BRAM_MATCH_MAX_LEN];
+	uint8_t mask[BRAM_MATCH_MAX_LEN];
+	size_t skip[256];
+};
+
+/*
+ * Compile a pattern from hex text such as "a9 00 8d ?? 2?", where each byte
+ * is two hex digits and any digit may be a `?' wildcard. Whitespace between
+ * bytes is ignored.
+ */
+int bram_match_compile_hex(struct bram_match_pattern *pat, const char *hex);
+
+/* Compile an exact pattern from raw bytes, e.g. an ASCII string */
+int bram_match_compile_bytes(struct bram_match_pattern *pat, const void *bytes,
+		size_t len);
+
+/*
+ * Called for each match with the offset of the match plus the base passed to
+ * bram_match_scan(). Returning non-zero stops the scan.
+ */
+typedef int (*bram_match_fn)(size_t offset, void *arg);
+
+/*
+ * Find every, possibly overlapping, match of the pattern in buf. This works
+ * on ordinary memory only - snapshot device memory with bram_read_range()
+ * first. Returns the number of matches reported.
+ */
+size_t bram_match_scan(const struct bram_match_pattern *pat, const uint8_t *buf,
+		size_t len, size_t base, bram_match_fn fn, void *arg);
+
+#endif /* BRAM_MATCH_H */
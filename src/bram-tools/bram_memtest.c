@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bram_resource.h"
+#include "bram_access.h"
+#include "bram_memtest.h"
+
+/* Solid backgrounds for March C- */
+#define MARCH_BG0			0x00000000U
+#define MARCH_BG1			0xffffffffU
+
+/* Word accessors for a real mapping */
+static uint32_t bram_port_read32(void *ctx, size_t offset)
+{
+	struct bram_resource *bram = ctx;
+	uint32_t value = 0;
+
+	if (bram->windowed) {
+		bram_peek(bram, offset, sizeof(value), &value);
+		return value;
+	}
+	return *(volatile uint32_t *) ((uint8_t *) bram->map + offset);
+}
+
+static void bram_port_write32(void *ctx, size_t offset, uint32_t value)
+{
+	struct bram_resource *bram = ctx;
+
+	if (bram->windowed) {
+		bram_poke(bram, offset, sizeof(value), value);
+		return;
+	}
+	*(volatile uint32_t *) ((uint8_t *) bram->map + offset) = value;
+	return;
+}
+
+int bram_test_port_init(struct bram_test_port *port, struct bram_resource *bram)
+{
+	if (!port || !bram || !bram->map) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	port->read32 = bram_port_read32;
+	port->write32 = bram_port_write32;
+	port->ctx = bram;
+	port->size = bram->map_size;
+	return 0;
+}
+
+int bram_fault_map_create(struct bram_fault_map *fmap, size_t size)
+{
+	if (!fmap || !size || (size % sizeof(uint32_t))) {
+		fprintf(stderr, "Error: Stand-in map size has to be a whole number of words\n");
+		return -1;
+	}
+	fmap->mem = calloc(size / sizeof(uint32_t), sizeof(uint32_t));
+	if (!fmap->mem) {
+		fprintf(stderr, "Error: Could not allocate stand-in map\n");
+		return -1;
+	}
+	fmap->size = size;
+	fmap->fault_count = 0;
+	return 0;
+}
+
+void bram_fault_map_destroy(struct bram_fault_map *fmap)
+{
+	if (fmap) {
+		free(fmap->mem);
+		fmap->mem = NULL;
+		fmap->size = 0;
+		fmap->fault_count = 0;
+	}
+	return;
+}
+
+int bram_fault_map_add(struct bram_fault_map *fmap, const struct bram_fault *fault)
+{
+	int valid;
+
+	if (!fmap || !fault) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if (fmap->fault_count == BRAM_FAULT_MAX) {
+		fprintf(stderr, "Error: At most %d faults can be injected\n", BRAM_FAULT_MAX);
+		return -1;
+	}
+	switch (fault->type) {
+		case BRAM_FAULT_STUCK_BIT:
+			valid = (fault->bit < 32) && (fault->value < 2) &&
+				!(fault->offset % sizeof(uint32_t)) &&
+				(fault->offset < fmap->size);
+			break;
+		case BRAM_FAULT_ADDR_LINE:
+			/* Lines below the word size never reach the block RAM */
+			valid = (fault->bit >= 2) && (fault->bit < 32);
+			break;
+		case BRAM_FAULT_BYTE_LANE:
+			valid = (fault->bit < sizeof(uint32_t));
+			break;
+		default:
+			valid = 0;
+			break;
+	}
+	if (!valid) {
+		fprintf(stderr, "Error: Fault does not fit a %zu byte map\n", fmap->size);
+		return -1;
+	}
+	fmap->faults[fmap->fault_count++] = *fault;
+	return 0;
+}
+
+/* Disconnected address lines mean the access lands somewhere else entirely */
+static size_t fault_translate(const struct bram_fault_map *fmap, size_t offset)
+{
+	for (size_t i = 0; i < fmap->fault_count; i++) {
+		if (fmap->faults[i].type == BRAM_FAULT_ADDR_LINE) {
+			offset &= ~((size_t) 1 << fmap->faults[i].bit);
+		}
+	}
+	return offset;
+}
+
+static uint32_t fault_read32(void *ctx, size_t offset)
+{
+	struct bram_fault_map *fmap = ctx;
+	const struct bram_fault *fault;
+	uint32_t value;
+
+	offset = fault_translate(fmap, offset);
+	value = fmap->mem[offset / sizeof(uint32_t)];
+	for (size_t i = 0; i < fmap->fault_count; i++) {
+		fault = &fmap->faults[i];
+		if (fault->type == BRAM_FAULT_BYTE_LANE) {
+			value |= 0xffU << (8 * fault->bit);
+		} else if ((fault->type == BRAM_FAULT_STUCK_BIT) &&
+				(fault->offset == offset)) {
+			value &= ~(1U << fault->bit);
+			value |= (uint32_t) fault->value << fault->bit;
+		}
+	}
+	return value;
+}
+
+static void fault_write32(void *ctx, size_t offset, uint32_t value)
+{
+	struct bram_fault_map *fmap = ctx;
+	uint32_t keep = 0;
+	uint32_t *word;
+
+	offset = fault_translate(fmap, offset);
+	word = &fmap->mem[offset / sizeof(uint32_t)];
+	for (size_t i = 0; i < fmap->fault_count; i++) {
+		if (fmap->faults[i].type == BRAM_FAULT_BYTE_LANE) {
+			keep |= 0xffU << (8 * fmap->faults[i].bit);
+		}
+	}
+	*word = (value & ~keep) | (*word & keep);
+	return;
+}
+
+int bram_fault_port_init(struct bram_test_port *port, struct bram_fault_map *fmap)
+{
+	if (!port || !fmap || !fmap->mem) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	port->read32 = fault_read32;
+	port->write32 = fault_write32;
+	port->ctx = fmap;
+	port->size = fmap->size;
+	return 0;
+}
+
+int bram_test_result_init(struct bram_test_result *result, size_t start,
+		size_t len)
+{
+	size_t words;
+
+	if (!result) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if (!len || (start % sizeof(uint32_t)) || (len % sizeof(uint32_t))) {
+		fprintf(stderr, "Error: Test range has to be whole, aligned words\n");
+		return -1;
+	}
+	memset(result, 0, sizeof(*result));
+	words = len / sizeof(uint32_t);
+	result->error_map = calloc((words + 7) / 8, 1);
+	if (!result->error_map) {
+		fprintf(stderr, "Error: Could not allocate error map\n");
+		return -1;
+	}
+	result->start = start;
+	result->len = len;
+	return 0;
+}
+
+void bram_test_result_free(struct bram_test_result *result)
+{
+	if (result) {
+		free(result->error_map);
+		result->error_map = NULL;
+	}
+	return;
+}
+
+int bram_test_result_merge(struct bram_test_result *dst,
+		const struct bram_test_result *src)
+{
+	size_t map_bytes;
+
+	if (!dst || !src || !dst->error_map || !src->error_map) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if ((dst->start != src->start) || (dst->len != src->len)) {
+		fprintf(stderr, "Error: Cannot merge results over different ranges\n");
+		return -1;
+	}
+	map_bytes = ((dst->len / sizeof(uint32_t)) + 7) / 8;
+	dst->failed_words = 0;
+	for (size_t i = 0; i < map_bytes; i++) {
+		dst->error_map[i] |= src->error_map[i];
+		dst->failed_words += (size_t) __builtin_popcount(dst->error_map[i]);
+	}
+	dst->errors += src->errors;
+	dst->accesses += src->accesses;
+	dst->stuck_zero |= src->stuck_zero;
+	dst->stuck_one |= src->stuck_one;
+	dst->failing_lanes |= src->failing_lanes;
+	dst->alias_lines |= src->alias_lines;
+	return 0;
+}
+
+int bram_test_word_failed(const struct bram_test_result *result, size_t offset)
+{
+	size_t word = (offset - result->start) / sizeof(uint32_t);
+
+	return (result->error_map[word / 8] >> (word % 8)) & 0x1;
+}
+
+static int check_test_range(const struct bram_test_port *port,
+		const struct bram_test_result *result)
+{
+	if (!port || !result || !result->error_map) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if ((result->start > port->size) ||
+			(result->len > (port->size - result->start))) {
+		fprintf(stderr, "Error: Test of %zu bytes at 0x%zx exceeds map size\n",
+				result->len, result->start);
+		return -1;
+	}
+	return 0;
+}
+
+static void mark_word(struct bram_test_result *result, size_t offset)
+{
+	size_t word = (offset - result->start) / sizeof(uint32_t);
+	uint8_t bit = (uint8_t) (1U << (word % 8));
+
+	if (!(result->error_map[word / 8] & bit)) {
+		result->error_map[word / 8] |= bit;
+		result->failed_words++;
+	}
+	return;
+}
+
+/* Account for a word that read back as actual instead of expected */
+static void record_data_error(struct bram_test_result *result, size_t offset,
+		uint32_t expected, uint32_t actual)
+{
+	uint32_t diff = expected ^ actual;
+
+	if (!diff) {
+		return;
+	}
+	result->errors++;
+	mark_word(result, offset);
+	result->stuck_zero |= diff & expected;
+	result->stuck_one |= diff & ~expected;
+	for (unsigned int lane = 0; lane < sizeof(uint32_t); lane++) {
+		if ((diff >> (8 * lane)) & 0xff) {
+			result->failing_lanes |= 1U << lane;
+		}
+	}
+	return;
+}
+
+static inline uint32_t test_read(const struct bram_test_port *port,
+		struct bram_test_result *result, size_t offset)
+{
+	result->accesses++;
+	return port->read32(port->ctx, offset);
+}
+
+static inline void test_write(const struct bram_test_port *port,
+		struct bram_test_result *result, size_t offset, uint32_t value)
+{
+	result->accesses++;
+	port->write32(port->ctx, offset, value);
+	return;
+}
+
+/* One march element - optionally read and check, then optionally write */
+struct march_element {
+	int descending;
+	int read;
+	uint32_t expect;
+	int write;
+	uint32_t value;
+};
+
+/* {(w0); up(r0,w1); up(r1,w0); down(r0,w1); down(r1,w0); (r0)} */
+static const struct march_element march_c_minus[] = {
+	{ 0, 0, 0,         1, MARCH_BG0 },
+	{ 0, 1, MARCH_BG0, 1, MARCH_BG1 },
+	{ 0, 1, MARCH_BG1, 1, MARCH_BG0 },
+	{ 1, 1, MARCH_BG0, 1, MARCH_BG1 },
+	{ 1, 1, MARCH_BG1, 1, MARCH_BG0 },
+	{ 0, 1, MARCH_BG0, 0, 0 },
+};
+
+int bram_test_march(const struct bram_test_port *port,
+		struct bram_test_result *result)
+{
+	const struct march_element *element;
+	size_t words;
+	size_t offset;
+
+	if (check_test_range(port, result)) {
+		return -1;
+	}
+	words = result->len / sizeof(uint32_t);
+	for (size_t e = 0; e < sizeof(march_c_minus) / sizeof(march_c_minus[0]); e++) {
+		element = &march_c_minus[e];
+		for (size_t i = 0; i < words; i++) {
+			offset = result->start + sizeof(uint32_t) *
+				(element->descending ? (words - 1 - i) : i);
+			if (element->read) {
+				record_data_error(result, offset, element->expect,
+						test_read(port, result, offset));
+			}
+			if (element->write) {
+				test_write(port, result, offset, element->value);
+			}
+		}
+	}
+	return 0;
+}
+
+int bram_test_walking(const struct bram_test_port *port,
+		struct bram_test_result *result)
+{
+	uint32_t pattern;
+	size_t offset;
+
+	if (check_test_range(port, result)) {
+		return -1;
+	}
+	for (offset = result->start; offset < result->start + result->len;
+			offset += sizeof(uint32_t)) {
+		for (unsigned int bit = 0; bit < 32; bit++) {
+			pattern = 1U << bit;
+			test_write(port, result, offset, pattern);
+			record_data_error(result, offset, pattern,
+					test_read(port, result, offset));
+			test_write(port, result, offset, ~pattern);
+			record_data_error(result, offset, ~pattern,
+					test_read(port, result, offset));
+		}
+	}
+	return 0;
+}
+
+/*
+ * An aliased address line makes a word read back as the address of another
+ * word, and the bits that differ are the same whether the address or its
+ * complement was written. Stuck bits and dead byte lanes can mimic an address
+ * in one pass but never flip the same bit in both, so only bits that differ
+ * in both passes are taken as aliasing and the rest count as data errors.
+ */
+int bram_test_address(const struct bram_test_port *port,
+		struct bram_test_result *result)
+{
+	uint32_t *first_diff = NULL;
+	uint32_t addr_mask;
+	uint32_t expected;
+	uint32_t actual;
+	uint32_t diff;
+	uint32_t alias;
+	size_t words;
+	size_t offset;
+	size_t i;
+
+	if (check_test_range(port, result)) {
+		return -1;
+	}
+	words = result->len / sizeof(uint32_t);
+	first_diff = malloc(words * sizeof(*first_diff));
+	if (!first_diff) {
+		fprintf(stderr, "Error: Could not allocate address test buffer\n");
+		return -1;
+	}
+
+	/* Every word address line that can change inside the range */
+	addr_mask = 0;
+	while (addr_mask < (uint32_t) (result->start + result->len - 1)) {
+		addr_mask = (addr_mask << 1) | 0x1;
+	}
+	addr_mask &= ~0x3U;
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (i = 0, offset = result->start; i < words;
+				i++, offset += sizeof(uint32_t)) {
+			expected = pass ? ~(uint32_t) offset : (uint32_t) offset;
+			test_write(port, result, offset, expected);
+		}
+		for (i = 0, offset = result->start; i < words;
+				i++, offset += sizeof(uint32_t)) {
+			expected = pass ? ~(uint32_t) offset : (uint32_t) offset;
+			actual = test_read(port, result, offset);
+			diff = expected ^ actual;
+			if (!pass) {
+				first_diff[i] = diff;
+				continue;
+			}
+			alias = diff & first_diff[i] & addr_mask;
+			if (alias) {
+				result->errors++;
+				result->alias_lines |= alias;
+				mark_word(result, offset);
+			}
+			record_data_error(result, offset, (uint32_t) offset,
+					(uint32_t) offset ^ (first_diff[i] & ~alias));
+			record_data_error(result, offset, expected, actual ^ alias);
+		}
+	}
+	free(first_diff);
+	return 0;
+}
@@ -0,0 +1,107 @@
+#ifndef BRAM_MEMTEST_H
+#define BRAM_MEMTEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bram_resource.h"
+
+/*
+ * Word accessor the tests run through, so they can be pointed at either a
+ * mapped block RAM or a stand-in. Offsets are in bytes from the start of the
+ * map and are always word aligned.
+ */
+struct bram_test_port {
+	uint32_t (*read32)(void *ctx, size_t offset);
+	void (*write32)(void *ctx, size_t offset, uint32_t value);
+	void *ctx;
+	/* Number of bytes addressable through the port */
+	size_t size;
+};
+
+int bram_test_port_init(struct bram_test_port *port, struct bram_resource *bram);
+
+/* Faults the stand-in map knows how to emulate */
+enum bram_fault_type {
+	/* One data bit of one word always reads back as a fixed value */
+	BRAM_FAULT_STUCK_BIT,
+	/* A byte address line is not connected and always drives zero */
+	BRAM_FAULT_ADDR_LINE,
+	/* A byte lane drops every write and floats high on reads */
+	BRAM_FAULT_BYTE_LANE,
+};
+
+struct bram_fault {
+	enum bram_fault_type type;
+	/* Byte offset of the affected word, only used by stuck bits */
+	size_t offset;
+	/* Data bit, address line or byte lane number */
+	unsigned int bit;
+	/* Level a stuck bit reads back as */
+	unsigned int value;
+};
+
+#define BRAM_FAULT_MAX			16
+
+/*
+ * Memory-backed stand-in for a block RAM. The faults are applied on every
+ * access, so the tests see the same symptoms a miswired PL design would give.
+ */
+struct bram_fault_map {
+	uint32_t *mem;
+	size_t size;
+	size_t fault_count;
+	struct bram_fault faults[BRAM_FAULT_MAX];
+};
+
+int bram_fault_map_create(struct bram_fault_map *fmap, size_t size);
+void bram_fault_map_destroy(struct bram_fault_map *fmap);
+int bram_fault_map_add(struct bram_fault_map *fmap, const struct bram_fault *fault);
+int bram_fault_port_init(struct bram_test_port *port, struct bram_fault_map *fmap);
+
+/*
+ * Outcome of one or more tests over a range. The range has to be word aligned
+ * at both ends.
+ */
+struct bram_test_result {
+	size_t start;
+	size_t len;
+	/* One bit per word of the range, set if the word ever read back wrong */
+	uint8_t *error_map;
+	size_t failed_words;
+	/* Individual mismatching reads and total word accesses made */
+	size_t errors;
+	size_t accesses;
+	/* Data bits that read back as 0 when 1 was written, and the reverse */
+	uint32_t stuck_zero;
+	uint32_t stuck_one;
+	/* Bit n set if byte lane n returned bad data */
+	unsigned int failing_lanes;
+	/* Byte address lines found to alias onto another address */
+	uint32_t alias_lines;
+};
+
+int bram_test_result_init(struct bram_test_result *result, size_t start,
+		size_t len);
+void bram_test_result_free(struct bram_test_result *result);
+/* Fold src into dst, which has to cover the same range */
+int bram_test_result_merge(struct bram_test_result *dst,
+		const struct bram_test_result *src);
+int bram_test_word_failed(const struct bram_test_result *result, size_t offset);
+
+/*
+ * The tests themselves, all of which destroy the contents of the range. They
+ * return -1 only if the test could not be run; failures end up in result.
+ */
+
+/* March C- with solid backgrounds, 10 accesses per word */
+int bram_test_march(const struct bram_test_port *port,
+		struct bram_test_result *result);
+/* Walk a one and then a zero through every bit of every word */
+int bram_test_walking(const struct bram_test_port *port,
+		struct bram_test_result *result);
+/* Write every word with its own address and its complement and read back */
+int bram_test_address(const struct bram_test_port *port,
+		struct bram_test_result *result);
+
+#endif /* BRAM_MEMTEST_H */
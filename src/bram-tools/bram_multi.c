@@ -0,0 +1,460 @@
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_access.h"
+#include "bram_session.h"
+#include "bram_image.h"
+
+/* Long options without a short equivalent */
+enum {
+	OPT_STATS = 0x100,
+	OPT_WAIT,
+};
+
+void print_usage()
+{
+	printf("Usage: bram_multi [-j JOBS] [-a] [-S] -o OUTFILE [MAP]...\n");
+	printf("       bram_multi [-j JOBS] [-a] [-d] [-v] [-s START] -l INFILE [MAP]...\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("  %-15s%-30s\n", "-h", "display program usage");
+	printf("  %-15s%-30s\n", "-o OUTFILE", "dump every map into OUTFILE, one");
+	printf("  %-15s%-30s\n", "", "section per map");
+	printf("  %-15s%-30s\n", "-S", "dump as one sparse image for bram_load");
+	printf("  %-15s%-30s\n", "-l INFILE", "load INFILE into every map");
+	printf("  %-15s%-30s\n", "-s START", "load at START instead of 0");
+	printf("  %-15s%-30s\n", "-d", "only write words that differ");
+	printf("  %-15s%-30s\n", "-v", "read back and compare after loading");
+	printf("  %-15s%-30s\n", "-a", "use every UIO map on the system");
+	printf("  %-15s%-30s\n", "-j JOBS", "use at most JOBS threads, default is");
+	printf("  %-15s%-30s\n", "", "one per CPU");
+	printf("  %-15s%-30s\n", "--wait MS", "give up on a locked map after MS ms");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase to stderr");
+	printf("\n");
+	printf("Each MAP is either UIO:MAP, e.g. 0:1, or the name of a map. A dump\n");
+	printf("without any MAP covers every map on the system.\n");
+	return;
+}
+
+static double elapsed_since(const struct timespec *t_start)
+{
+	struct timespec t_stop;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_stop);
+	return (double) (t_stop.tv_sec - t_start->tv_sec) +
+		((double) (t_stop.tv_nsec - t_start->tv_nsec) / 1e9);
+}
+
+static int add_map_spec(struct bram_session *session, const char *spec)
+{
+	int uio_number;
+	int map_number;
+	int consumed = 0;
+
+	if ((sscanf(spec, "%d:%d%n", &uio_number, &map_number, &consumed) == 2) &&
+			!spec[consumed]) {
+		if ((uio_number < 0) || (map_number < 0)) {
+			fprintf(stderr, "Error: Invalid map `%s'\n", spec);
+			return -1;
+		}
+		return bram_session_add(session, uio_number, map_number);
+	}
+	return bram_session_add_name(session, spec);
+}
+
+static void print_map_label(const struct bram_resource *bram)
+{
+	printf("uio%d:%d  %-24s", bram->uio_number, bram->map_number, bram->map_name);
+	return;
+}
+
+/* One image covering every map, with the zero runs of each left out */
+static int write_image(struct bram_session *session, const char *filename)
+{
+	struct bram_resource *bram;
+	long count = 0;
+	size_t stored = 0;
+	size_t total = 0;
+	int retval = 0;
+	int fd;
+
+	for (size_t i = 0; i < session->count; i++) {
+		count += bram_image_split(session->maps[i].snap.data,
+				session->maps[i].bram.map_size, 0, NULL, NULL);
+	}
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Could not open %s: %s\n", filename,
+				strerror(errno));
+		return -1;
+	}
+	if (bram_image_write_header(fd, (uint32_t) count)) {
+		retval = -1;
+	}
+	for (size_t i = 0; !retval && (i < session->count); i++) {
+		bram = &session->maps[i].bram;
+		if (bram_image_write_range(fd, bram->map_name, session->maps[i].snap.data,
+					bram->map_size, 0, &stored) < 0) {
+			retval = -1;
+		}
+		total += bram->map_size;
+	}
+	if (close(fd)) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		retval = -1;
+	}
+	if (!retval) {
+		printf("Wrote %ld segments, %zu of %zu bytes stored\n", count, stored,
+				total);
+	}
+	return retval;
+}
+
+/*
+ * Snapshot all maps concurrently first and only then write the sections out
+ * in order, so the file is never written from two threads
+ */
+int dump_session(struct bram_session *session, const char *filename,
+		bool sparse)
+{
+	struct timespec t_start;
+	double elapsed;
+	size_t total = 0;
+	uint32_t crc;
+	FILE *stream = NULL;
+	uint64_t t_file;
+	int retval = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	if (bram_session_snapshot(session)) {
+		fprintf(stderr, "Error: Could not read every map\n");
+		retval = -1;
+		goto out;
+	}
+	elapsed = elapsed_since(&t_start);
+
+	t_file = bram_perf_start(session->perf);
+	if (sparse) {
+		for (size_t i = 0; i < session->count; i++) {
+			total += session->maps[i].bram.map_size;
+		}
+		if (write_image(session, filename)) {
+			retval = -1;
+			goto out;
+		}
+		bram_perf_record(session->perf, BRAM_PHASE_FILE, t_file, total);
+		goto report;
+	}
+	stream = fopen(filename, "wb");
+	if (!stream) {
+		fprintf(stderr, "Error: Could not open %s: %s\n", filename,
+				strerror(errno));
+		retval = -1;
+		goto out;
+	}
+	for (size_t i = 0; i < session->count; i++) {
+		if (bram_session_write_section(stream, &session->maps[i].bram,
+					session->maps[i].snap.data, &crc)) {
+			retval = -1;
+			goto out;
+		}
+		print_map_label(&session->maps[i].bram);
+		printf("%6zu bytes  crc32 %08x\n", session->maps[i].bram.map_size,
+				(unsigned int) crc);
+		total += session->maps[i].bram.map_size;
+	}
+	bram_perf_record(session->perf, BRAM_PHASE_FILE, t_file, total);
+
+report:
+	printf("Read %zu bytes from %zu maps in %.3f ms (%.2f MB/s)\n", total,
+			session->count, elapsed * 1e3,
+			(elapsed > 0) ? ((double) total / elapsed / 1e6) : 0.0);
+
+out:
+	if (stream && fclose(stream)) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		retval = -1;
+	}
+	return retval;
+}
+
+/* The whole image is read into memory once and shared by every map */
+static uint8_t *read_image(const char *filename, size_t *size)
+{
+	struct stat st;
+	uint8_t *buf = NULL;
+	size_t num_buffered = 0;
+	ssize_t num_read;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Could not open %s: %s\n", filename,
+				strerror(errno));
+		return NULL;
+	}
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "Error: %s is not a regular file\n", filename);
+		goto err_exit;
+	}
+	buf = malloc(st.st_size ? (size_t) st.st_size : 1);
+	if (!buf) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		goto err_exit;
+	}
+	while (num_buffered != (size_t) st.st_size) {
+		num_read = read(fd, buf + num_buffered, st.st_size - num_buffered);
+		if (num_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			goto err_exit;
+		} else if (num_read == 0) {
+			fprintf(stderr, "Error: Unexpected EOF\n");
+			goto err_exit;
+		}
+		num_buffered += num_read;
+	}
+	close(fd);
+	*size = num_buffered;
+	return buf;
+
+err_exit:
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+int load_session(struct bram_session *session, const char *filename,
+		size_t load_addr, unsigned int flags)
+{
+	struct bram_resource *bram;
+	struct timespec t_start;
+	double elapsed;
+	uint8_t *image;
+	size_t image_size;
+	size_t total = 0;
+	uint64_t t_file;
+	int result;
+
+	t_file = bram_perf_start(session->perf);
+	image = read_image(filename, &image_size);
+	if (!image) {
+		return -1;
+	}
+	bram_perf_record(session->perf, BRAM_PHASE_FILE, t_file, image_size);
+	for (size_t i = 0; i < session->count; i++) {
+		bram = &session->maps[i].bram;
+		if ((load_addr > bram->map_size) ||
+				(image_size > (bram->map_size - load_addr))) {
+			fprintf(stderr, "Error: File size too large or load address too "
+					"high for %s\n", bram->map_name);
+			free(image);
+			return -1;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	result = bram_session_broadcast(session, load_addr, image, image_size,
+			flags);
+	elapsed = elapsed_since(&t_start);
+
+	for (size_t i = 0; i < session->count; i++) {
+		print_map_label(&session->maps[i].bram);
+		if (session->maps[i].result && !session->maps[i].mismatched) {
+			printf("failed\n");
+			continue;
+		}
+		printf("%zu bus transactions", session->maps[i].stats.transactions);
+		if (flags & BRAM_SESSION_DIFF) {
+			printf(", %zu changed words", session->maps[i].changed);
+		}
+		if (flags & BRAM_SESSION_VERIFY) {
+			if (session->maps[i].mismatched) {
+				printf(", %zu bytes did not verify", session->maps[i].mismatched);
+			} else {
+				printf(", verified");
+			}
+		}
+		printf("\n");
+		if (!session->maps[i].result) {
+			total += image_size;
+		}
+	}
+	printf("Loaded %zu bytes into %zu maps at 0x%04zx in %.3f ms (%.2f MB/s)\n",
+			image_size, session->count, load_addr, elapsed * 1e3,
+			(elapsed > 0) ? ((double) total / elapsed / 1e6) : 0.0);
+	free(image);
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bram_session session;
+	const char *dump_file = NULL;
+	const char *load_file = NULL;
+	unsigned int flags = 0;
+	unsigned int jobs = 0;
+	size_t load_addr = 0;
+	bool all = false;
+	bool sparse = false;
+	char *endptr = NULL;
+	unsigned long value;
+	int retval = 0;
+
+	int opt;
+	static const struct option long_options[] = {
+		{ "wait", required_argument, NULL, OPT_WAIT },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct bram_perf perf;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+	struct bram_lock lock;
+
+	bram_lock_init(&lock, BRAM_LOCK_SHARED);
+	bram_perf_init(&perf);
+	while ((opt = getopt_long(argc, argv, "ho:l:s:dvaj:S", long_options,
+					NULL)) != -1) {
+		switch (opt) {
+			case 'h':
+				print_usage();
+				return 0;
+			case 'o':
+				dump_file = optarg;
+				break;
+			case 'l':
+				load_file = optarg;
+				break;
+			case 's':
+				if (str_to_size(&load_addr, optarg)) {
+					fprintf(stderr, "Error: Bad load address\n");
+					return 1;
+				}
+				break;
+			case 'd':
+				flags |= BRAM_SESSION_DIFF;
+				break;
+			case 'v':
+				flags |= BRAM_SESSION_VERIFY;
+				break;
+			case 'a':
+				all = true;
+				break;
+			case 'S':
+				sparse = true;
+				break;
+			case 'j':
+				errno = 0;
+				value = strtoul(optarg, &endptr, 10);
+				if (errno || (endptr == optarg) || *endptr || !value ||
+						(value > BRAM_SESSION_MAX_MAPS)) {
+					fprintf(stderr, "Error: JOBS must be from 1 to %d\n",
+							BRAM_SESSION_MAX_MAPS);
+					return 1;
+				}
+				jobs = (unsigned int) value;
+				break;
+			case OPT_WAIT:
+				if (bram_lock_parse_wait(&lock.timeout_ms, optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				break;
+			case '?':
+				if ((optopt == 'o') || (optopt == 'l') || (optopt == 's') ||
+						(optopt == 'j')) {
+					fprintf(stderr, "Error: Option -%c requires an argument\n", optopt);
+				} else if (isprint(optopt)) {
+					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+				} else {
+					fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+				}
+				return 1;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+	/* Exactly one of dump or load */
+	if (!dump_file == !load_file) {
+		print_usage();
+		return 1;
+	}
+	/* Loading into every map on the system has to be asked for explicitly */
+	if (load_file && !all && (optind == argc)) {
+		fprintf(stderr, "Error: No maps to load, give some or use -a\n");
+		return 1;
+	}
+	if (sparse && !dump_file) {
+		fprintf(stderr, "Error: -S only applies to dumps\n");
+		return 1;
+	}
+	if (all && (optind != argc)) {
+		fprintf(stderr, "Error: Maps cannot be given along with -a\n");
+		return 1;
+	}
+
+	bram_session_init(&session, jobs);
+	if (stats_format) {
+		session.perf = &perf;
+	}
+	/* Dumps can share the maps with other readers, loads cannot */
+	lock.mode = load_file ? BRAM_LOCK_EXCLUSIVE : BRAM_LOCK_SHARED;
+	session.lock = &lock;
+	if (optind == argc) {
+		if (bram_session_add_all(&session, 0)) {
+			fprintf(stderr, "Error: Could not open every UIO map\n");
+			retval = 1;
+			goto out;
+		}
+	}
+	for (int i = optind; i < argc; i++) {
+		if (add_map_spec(&session, argv[i])) {
+			fprintf(stderr, "Error: Could not open map `%s'\n", argv[i]);
+			retval = 1;
+			goto out;
+		}
+	}
+	if (!session.count) {
+		fprintf(stderr, "Error: No UIO maps found\n");
+		retval = 1;
+		goto out;
+	}
+
+	if (dump_file) {
+		retval = dump_session(&session, dump_file, sparse) ? 1 : 0;
+	} else {
+		retval = load_session(&session, load_file, load_addr, flags) ? 1 : 0;
+	}
+
+out:
+	if (bram_session_close(&session)) {
+		fprintf(stderr, "Could not destroy block RAM resources\n");
+		retval = 1;
+	}
+	if (stats_format) {
+		bram_perf_print(stderr, "bram_multi", &perf, stats_format);
+	}
+	return retval;
+}
@@ -1 +1,142 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <getopt.h>
+
 #include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_batch.h"
+
+/* Long options without a short equivalent */
+enum {
+	OPT_STATS = 0x100,
+	OPT_WAIT,
+};
+
+void print_usage()
+{
+	printf("Usage: bram_peek [-w WIDTH] DEVICE MAP [ADDR]\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("  %-15s%-30s\n", "-h", "display program usage");
+	printf("  %-15s%-30s\n", "-w WIDTH", "access width of 8, 16 or 32 bits");
+	printf("  %-15s%-30s\n", "--wait MS", "give up on a locked map after MS ms");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase to stderr");
+	printf("\n");
+	printf("Without ADDR, reads are taken one per line from stdin as\n");
+	printf("ADDR [WIDTH] and all run against the same mapping. Each result is\n");
+	printf("printed as ADDR VALUE in the order given, or as ADDR ERR if the\n");
+	printf("read fails. Numbers are hexadecimal.\n");
+	return;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bram_resource bram;
+	struct bram_batch_op op;
+	unsigned int width = 4;
+	int uio_number;
+	int map_number;
+	int num_pos_args;
+	int result;
+	int retval;
+
+	int opt;
+	static const struct option long_options[] = {
+		{ "wait", required_argument, NULL, OPT_WAIT },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct bram_perf perf;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+	struct bram_lock lock;
+
+	bram_lock_init(&lock, BRAM_LOCK_SHARED);
+	bram_perf_init(&perf);
+	while ((opt = getopt_long(argc, argv, "hw:", long_options,
+					NULL)) != -1) {
+		switch (opt) {
+			case 'h':
+				print_usage();
+				return 0;
+			case 'w':
+				if (bram_batch_parse_width(&width, optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_WAIT:
+				if (bram_lock_parse_wait(&lock.timeout_ms, optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				break;
+			case '?':
+				if (optopt == 'w') {
+					fprintf(stderr, "Error: No width specified\n");
+				} else if (isprint(optopt)) {
+					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+				} else {
+					fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+				}
+				return 1;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+
+	num_pos_args = argc - optind;
+	if ((num_pos_args < 2) || (num_pos_args > 3)) {
+		fprintf(stderr, "Error: Incorrect number of positional arguments\n");
+		print_usage();
+		return 1;
+	}
+	if (str_to_index(&uio_number, argv[optind])) {
+		fprintf(stderr, "Error: Bad UIO device number\n");
+		return 1;
+	}
+	if (str_to_index(&map_number, argv[optind + 1])) {
+		fprintf(stderr, "Error: Bad map number\n");
+		return 1;
+	}
+
+	/* Check a single access before paying for the mapping */
+	if ((num_pos_args == 3) &&
+			bram_batch_parse(&op, 1, &argv[optind + 2], false, width)) {
+		return 1;
+	}
+
+	result = bram_create_locked(&bram, uio_number, map_number,
+			stats_format ? &perf : NULL, &lock);
+	if (result) {
+		fprintf(stderr, "Could not create block RAM resource for UIO device %d "
+				"or map number %d\n", uio_number, map_number);
+		return 1;
+	}
+
+	retval = 0;
+	if (num_pos_args == 3) {
+		if (bram_batch_run(&bram, &op, false)) {
+			retval = 1;
+		} else {
+			bram_batch_print(stdout, &op);
+		}
+	} else if (bram_batch_stream(&bram, stdin, false, width, false, true)) {
+		retval = 1;
+	}
+
+	if (bram_destroy(&bram)) {
+		fprintf(stderr, "Could not destroy block RAM resource\n");
+		retval = 1;
+	}
+	if (stats_format) {
+		bram_perf_print(stderr, "bram_peek", &perf, stats_format);
+	}
+	return retval;
+}
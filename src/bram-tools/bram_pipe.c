@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "bram_helper.h"
+#include "bram_pipe.h"
+
+struct pipe_slot {
+	uint8_t *data;
+	size_t len;
+};
+
+/* Ring of filled slots, head being the next one to drain */
+struct pipe_state {
+	size_t chunk_size;
+	unsigned int depth;
+	bram_pipe_fill_fn fill;
+	void *fill_arg;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct pipe_slot slots[BRAM_PIPE_MAX_DEPTH];
+	unsigned int head;
+	unsigned int count;
+	/* Set by the filler once it has run out or failed */
+	bool done;
+	int fill_result;
+	/* Set by the drainer to make the filler give up */
+	bool cancel;
+};
+
+/* Keep calling fill until the chunk is full or there is nothing left */
+static ssize_t fill_chunk(bram_pipe_fill_fn fill, void *arg, uint8_t *buf,
+		size_t len)
+{
+	size_t filled = 0;
+	ssize_t result;
+
+	while (filled != len) {
+		result = fill(arg, buf + filled, len - filled);
+		if (result < 0) {
+			return -1;
+		}
+		if (!result) {
+			break;
+		}
+		filled += result;
+	}
+	return filled;
+}
+
+static void *pipe_filler(void *arg)
+{
+	struct pipe_state *state = arg;
+	struct pipe_slot *slot;
+	ssize_t len;
+
+	for (;;) {
+		pthread_mutex_lock(&state->lock);
+		while ((state->count == state->depth) && !state->cancel) {
+			pthread_cond_wait(&state->cond, &state->lock);
+		}
+		if (state->cancel) {
+			pthread_mutex_unlock(&state->lock);
+			break;
+		}
+		/* Nothing drains this slot until count says it is there */
+		slot = &state->slots[(state->head + state->count) % state->depth];
+		pthread_mutex_unlock(&state->lock);
+
+		len = fill_chunk(state->fill, state->fill_arg, slot->data,
+				state->chunk_size);
+
+		pthread_mutex_lock(&state->lock);
+		if (len > 0) {
+			slot->len = len;
+			state->count++;
+		}
+		if (len < (ssize_t) state->chunk_size) {
+			state->done = true;
+			state->fill_result = (len < 0) ? -1 : 0;
+		}
+		pthread_cond_broadcast(&state->cond);
+		pthread_mutex_unlock(&state->lock);
+		if (len < (ssize_t) state->chunk_size) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+static int run_sequential(size_t chunk_size, bram_pipe_fill_fn fill,
+		void *fill_arg, bram_pipe_drain_fn drain, void *drain_arg)
+{
+	uint8_t *buf;
+	ssize_t len;
+	int retval = 0;
+
+	buf = malloc(chunk_size);
+	if (!buf) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	do {
+		len = fill_chunk(fill, fill_arg, buf, chunk_size);
+		if (len < 0) {
+			retval = -1;
+		} else if (len && drain(drain_arg, buf, len)) {
+			retval = -1;
+		}
+	} while (!retval && (len == (ssize_t) chunk_size));
+	free(buf);
+	return retval;
+}
+
+int bram_pipe_run(size_t chunk_size, unsigned int depth,
+		bram_pipe_fill_fn fill, void *fill_arg,
+		bram_pipe_drain_fn drain, void *drain_arg)
+{
+	struct pipe_state *state;
+	struct pipe_slot *slot;
+	pthread_t thread;
+	int result;
+	int retval = 0;
+
+	if (!fill || !drain || !chunk_size || (depth > BRAM_PIPE_MAX_DEPTH)) {
+		fprintf(stderr, "Error: Bad pipeline parameters\n");
+		return -1;
+	}
+	if (!depth) {
+		return run_sequential(chunk_size, fill, fill_arg, drain, drain_arg);
+	}
+
+	state = calloc(1, sizeof(*state));
+	if (!state) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	state->chunk_size = chunk_size;
+	state->depth = depth;
+	state->fill = fill;
+	state->fill_arg = fill_arg;
+	for (unsigned int i = 0; i < depth; i++) {
+		state->slots[i].data = malloc(chunk_size);
+		if (!state->slots[i].data) {
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			retval = -1;
+			goto out;
+		}
+	}
+	pthread_mutex_init(&state->lock, NULL);
+	pthread_cond_init(&state->cond, NULL);
+	result = pthread_create(&thread, NULL, pipe_filler, state);
+	if (result) {
+		fprintf(stderr, "Error: %s\n", strerror(result));
+		retval = -1;
+		goto out_sync;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&state->lock);
+		while (!state->count && !state->done) {
+			pthread_cond_wait(&state->cond, &state->lock);
+		}
+		if (!state->count) {
+			pthread_mutex_unlock(&state->lock);
+			break;
+		}
+		slot = &state->slots[state->head];
+		pthread_mutex_unlock(&state->lock);
+
+		result = drain(drain_arg, slot->data, slot->len);
+
+		pthread_mutex_lock(&state->lock);
+		state->head = (state->head + 1) % state->depth;
+		state->count--;
+		if (result) {
+			state->cancel = true;
+		}
+		pthread_cond_broadcast(&state->cond);
+		pthread_mutex_unlock(&state->lock);
+		if (result) {
+			retval = -1;
+			break;
+		}
+	}
+	pthread_join(thread, NULL);
+	if (state->fill_result) {
+		retval = -1;
+	}
+
+out_sync:
+	pthread_cond_destroy(&state->cond);
+	pthread_mutex_destroy(&state->lock);
+out:
+	for (unsigned int i = 0; i < depth; i++) {
+		free(state->slots[i].data);
+	}
+	free(state);
+	return retval;
+}
+
+int bram_pipe_parse_chunk(size_t *chunk_size, char *str)
+{
+	if (str_to_size(chunk_size, str) || !*chunk_size ||
+			(*chunk_size % BRAM_PIPE_CHUNK_ALIGN)) {
+		fprintf(stderr, "Error: Chunk size has to be a non-zero multiple of "
+				"%d\n", BRAM_PIPE_CHUNK_ALIGN);
+		return -1;
+	}
+	return 0;
+}
+
+int bram_pipe_parse_depth(unsigned int *depth, const char *str)
+{
+	char *endptr = NULL;
+	unsigned long value;
+
+	errno = 0;
+	value = strtoul(str, &endptr, 10);
+	if (errno || (endptr == str) || *endptr || (*str == '-') || !value ||
+			(value > BRAM_PIPE_MAX_DEPTH)) {
+		fprintf(stderr, "Error: Depth has to be from 1 to %d\n",
+				BRAM_PIPE_MAX_DEPTH);
+		return -1;
+	}
+	*depth = (unsigned int) value;
+	return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef BRAM_PIPE_H
+#define BRAM_PIPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Two-stage pipeline for moving data between a file and the block RAM, so
+ * that storage latency and bus time overlap instead of adding up. The fill
+ * stage runs on a helper thread and produces chunks into a ring of depth
+ * buffers, while the drain stage consumes them in order on the calling
+ * thread. Loads fill from the file and drain to the map, dumps the other way
+ * round. Each stage only ever runs on one thread, so a resource used by just
+ * one of them keeps to the locking rules in bram_resource.h.
+ */
+
+/* Largest ring allowed, beyond which more buffering stops helping */
+#define BRAM_PIPE_MAX_DEPTH		64
+
+/* What the tools use with their pipelined mode unless told otherwise */
+#define BRAM_PIPE_DEFAULT_CHUNK		(64 * 1024)
+#define BRAM_PIPE_DEFAULT_DEPTH		4
+
+/*
+ * Chunks have to be a multiple of the widest store, so that where one chunk
+ * ends does not disturb the alignment of the next
+ */
+#define BRAM_PIPE_CHUNK_ALIGN		8
+
+/*
+ * Put up to len bytes into buf, returning how many, 0 once there is nothing
+ * more or -1 on an error. Every chunk is filled completely before it is
+ * drained, apart from the last one.
+ */
+typedef ssize_t (*bram_pipe_fill_fn)(void *arg, uint8_t *buf, size_t len);
+/* Consume one chunk, returning -1 to stop the pipeline */
+typedef int (*bram_pipe_drain_fn)(void *arg, const uint8_t *buf, size_t len);
+
+/*
+ * Run fill and drain over chunks of chunk_size bytes until fill runs out.
+ * With a depth of 0 there is no helper thread and the two stages take turns
+ * on a single buffer, as a plain sequential transfer would.
+ */
+int bram_pipe_run(size_t chunk_size, unsigned int depth,
+		bram_pipe_fill_fn fill, void *fill_arg,
+		bram_pipe_drain_fn drain, void *drain_arg);
+
+/* Arguments to --chunk, in hex like other sizes, and --depth, in decimal */
+int bram_pipe_parse_chunk(size_t *chunk_size, char *str);
+int bram_pipe_parse_depth(unsigned int *depth, const char *str);
+
+#endif /* BRAM_PIPE_H */
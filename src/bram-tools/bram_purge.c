@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <assert.h>
 #include <ctype.h>
 #include <stdio.h>
@@ -11,145 +12,167 @@
 
 #include "bram_resource.h"
 #include "bram_helper.h"
+#include "bram_access.h"
+#include "bram_fill.h"
+#include "bram_split.h"
 
-/* Checkerboard patterns begin with this and complement it each write */
-#define XBOARD_START		0x55
+/* Long options without a short equivalent */
+enum {
+	OPT_STATS = 0x100,
+	OPT_CPUS,
+	OPT_VERIFY,
+	OPT_WAIT,
+};
 
-int purge_bram_by_value(struct bram_resource *bram, uint16_t start_addr,
-		uint16_t stop_addr, uint8_t purge_val)
-{
-	uint8_t *map_pos = NULL;
-	uint16_t num_to_write = 0;
-	uint16_t num_written = 0;
+/* Shared by every slice of a split fill or verify */
+struct purge_args {
+	struct bram_split *split;
+	size_t origin;
+	const struct bram_fill_spec *spec;
+	size_t mismatched[BRAM_SPLIT_MAX_THREADS];
+};
 
-	map_pos = bram->map;
-	if (!map_pos) {
-		fprintf(stderr, "Error: NULL memory map\n");
-		return -1;
-	}
-	printf("Purging 0x%04"PRIx16" to 0x%04"PRIx16" with value 0x%02"PRIx8"\n",
-			start_addr, stop_addr, purge_val);
-	num_to_write = 1 + (stop_addr - start_addr);
-	for (int i = 0; i < num_to_write; i++) {
-		*map_pos = purge_val;
-		map_pos++;
-		num_written++;
-	}
-	return (num_to_write - num_written);
+static void print_rate(const char *verb, size_t bytes, size_t transactions,
+		uint64_t ns)
+{
+	printf("%s %zu bytes in %zu bus transactions in %.3f ms (%.2f MB/s)\n",
+			verb, bytes, transactions, (double) ns / 1e6,
+			ns ? ((double) bytes * 1e3 / (double) ns) : 0.0);
+	return;
 }
 
-int purge_bram_by_xboard(struct bram_resource *bram, uint16_t start_addr,
-		uint16_t stop_addr)
+static int fill_slice(struct bram_split_slice *slice, void *arg)
 {
-	uint8_t purge_val = XBOARD_START;
-	uint8_t *map_pos = NULL;
-	uint16_t num_to_write = 0;
-	uint16_t num_written = 0;
+	struct purge_args *args = arg;
 
-	map_pos = bram->map;
-	if (!map_pos) {
-		fprintf(stderr, "Error: NULL memory map\n");
+	if (bram_fill_slice(&slice->bram, args->origin, slice->offset, slice->len,
+				args->spec, &slice->stats)) {
 		return -1;
 	}
-	printf("Purging 0x%04"PRIx16" to 0x%04"PRIx16" with checkerboard pattern\n",
-			start_addr, stop_addr);
-	num_to_write = 1 + (stop_addr - start_addr);
-	for (int i = 0; i < num_to_write; i++) {
-		*map_pos = purge_val;
-		map_pos++;
-		purge_val = ~purge_val;
-		num_written++;
-	}
-	return (num_to_write - num_written);
+	return bram_sync_range(&slice->bram, slice->offset, slice->len);
 }
 
-int purge_bram_by_incr(struct bram_resource *bram, uint16_t start_addr,
-		uint16_t stop_addr)
+static int check_slice(struct bram_split_slice *slice, void *arg)
 {
-	/*
-	 * We are going to pull the 8-bits from the address we start with and
-	 * then increment from there, relying on the fact that unsigned overflow
-	 * is defined so that the pattern we see in hardware wraps around as
-	 * expected.
-	 */
-	uint8_t purge_val;
-	uint8_t *map_pos = NULL;
-	uint16_t num_to_write = 0;
-	uint16_t num_written = 0;
+	struct purge_args *args = arg;
 
-	map_pos = bram->map;
-	if (!map_pos) {
-		fprintf(stderr, "Error: NULL memory map\n");
-		return -1;
-	}
-	printf("Purging 0x%04"PRIx16" to 0x%04"PRIx16" with incrementing pattern\n",
-			start_addr, stop_addr);
+	return bram_check_slice(&slice->bram, args->origin, slice->offset,
+			slice->len, args->spec,
+			&args->mismatched[slice - args->split->slices], &slice->stats);
+}
 
-	num_to_write = 1 + (stop_addr - start_addr);
-	purge_val = (start_addr & 0x00ffU) >> 8;
-	for (int i = 0; i < num_to_write; i++) {
-		*map_pos = purge_val;
-		map_pos++;
-		purge_val++;
-		num_written++;
+/* Run fn over the range on every thread of split, totalling the traffic */
+static int purge_split(struct bram_resource *bram, size_t start_addr,
+		size_t len, struct bram_split *split, bram_split_fn fn,
+		struct purge_args *args, struct bram_xfer_stats *stats)
+{
+	int result;
+
+	result = bram_split_run(split, bram, start_addr, len, fn, args);
+	for (size_t i = 0; i < split->count; i++) {
+		stats->bytes += split->slices[i].stats.bytes;
+		stats->transactions += split->slices[i].stats.transactions;
 	}
-	return (num_to_write - num_written);
+	return result;
 }
 
 /*
-int purge_by_val(struct bram_resource *bram, size_t start_addr,
-		size_t stop_addr, uint8_t val)
+ * Fill the range with the requested pattern and report how long it took. The
+ * stop address is inclusive, as it always has been on the command line. With
+ * split, the range is divided between its threads and each of them reports
+ * on its own slice as well. With verify the range is read back afterwards,
+ * divided the same way.
+ */
+int purge_bram(struct bram_resource *bram, size_t start_addr,
+		size_t stop_addr, const struct bram_fill_spec *spec,
+		struct bram_split *split, bool verify)
 {
-	uint8_t *map_pos = NULL;
-	size_t num_to_write = 0;
-	int num_written = 0;
-	size_t last_addr = 0;
+	struct bram_xfer_stats stats;
+	struct purge_args args;
+	size_t num_to_write;
+	size_t mismatched = 0;
+	uint64_t t_start;
+	int result;
 
 	if (!bram || !bram->map) {
-		fprintf(stderr, "Failed NULL pointer checks\n");
+		fprintf(stderr, "Error: NULL memory map\n");
 		return -1;
 	}
+	printf("Purging 0x%04zx to 0x%04zx with %s pattern\n",
+			start_addr, stop_addr, bram_pattern_name(spec->pattern));
 
-	if ((stop_addr > MAX_BRAM_ADDR) || (start_addr > MAX_BRAM_ADDR)) {
-		fprintf(stderr, "Stop or start addresses are beyond the maximum allowed\n");
-		return -1;
+	num_to_write = 1 + (stop_addr - start_addr);
+	memset(&args, 0, sizeof(args));
+	args.split = split;
+	args.origin = start_addr;
+	args.spec = spec;
+	bram_xfer_stats_init(&stats);
+	t_start = bram_clock_ns();
+	if (split) {
+		result = purge_split(bram, start_addr, num_to_write, split, fill_slice,
+				&args, &stats);
+	} else {
+		result = bram_fill_pattern(bram, start_addr, num_to_write, spec, &stats);
 	}
-	if (stop_addr < start_addr) {
-		fprintf(stderr, "Ending address must be greater than or equal to the "
-				"starting address\n");
+	if (result) {
 		return -1;
 	}
-	last_addr = bram->map_size - 1;
-	if (stop_addr > last_addr) {
-		fprintf(stderr, "Ending address must not exceed memory upper bound\n");
-		return -1;
+	print_rate("Wrote", stats.bytes, stats.transactions,
+			bram_clock_ns() - t_start);
+	if (split) {
+		bram_split_print(stdout, split);
+	}
+	if (!verify) {
+		return 0;
 	}
 
-	map_pos = (uint8_t *) bram->map;
-	if (!map_pos) {
-		fprintf(stderr, "Failed a NULL pointer check\n");
+	bram_xfer_stats_init(&stats);
+	t_start = bram_clock_ns();
+	if (split) {
+		result = purge_split(bram, start_addr, num_to_write, split, check_slice,
+				&args, &stats);
+		for (size_t i = 0; i < split->count; i++) {
+			mismatched += args.mismatched[i];
+		}
+	} else {
+		result = bram_check_slice(bram, start_addr, start_addr, num_to_write,
+				spec, &mismatched, &stats);
+	}
+	if (result) {
 		return -1;
 	}
-
-	num_to_write = 1 + (stop_addr - start_addr);
-	for (size_t i = 0; i < num_to_write; i++) {
-		*map_pos = val;
-		map_pos++;
-		num_written++;
+	print_rate("Verified", stats.bytes, stats.transactions,
+			bram_clock_ns() - t_start);
+	if (split) {
+		bram_split_print(stdout, split);
 	}
-	return (int) num_written;
+	if (mismatched) {
+		fprintf(stderr, "Error: Verify failed, %zu bytes differ\n", mismatched);
+		return -1;
+	}
+	return 0;
 }
-*/
 
 void print_usage()
 {
-	printf("Usage: bram_purge [-x] [-i] [-v VALUE] DEVICE MAP [START [END]]\n");
+	printf("Usage: bram_purge [-x] [-i] [-w] [-a] [-l SEED] [-v VALUE] [--verify] "
+			"[-j THREADS] [--cpus LIST] DEVICE MAP [START [END]]\n");
 	printf("\n");
 	printf("Options:\n");
 	printf("  %-15s%-30s\n", "-h", "display program usage");
 	printf("  %-15s%-30s\n", "-x", "purge with checkerboard pattern");
 	printf("  %-15s%-30s\n", "-i", "purge with incrementing pattern");
+	printf("  %-15s%-30s\n", "-w", "purge with walking ones pattern");
+	printf("  %-15s%-30s\n", "-a", "purge with each word's own address");
+	printf("  %-15s%-30s\n", "-l SEED", "purge with LFSR pattern from SEED");
 	printf("  %-15s%-30s\n", "-v VALUE", "purge with value");
+	printf("  %-15s%-30s\n", "--verify", "read the range back and compare");
+	printf("  %-15s%-30s\n", "-j THREADS", "split the range between THREADS threads");
+	printf("  %-15s%-30s\n", "--cpus LIST", "pin the threads to the CPUs in LIST,");
+	printf("  %-15s%-30s\n", "", "e.g. 0,1 or 0-1, one thread per CPU");
+	printf("  %-15s%-30s\n", "", "unless -j says otherwise");
+	printf("  %-15s%-30s\n", "--wait MS", "give up on a locked map after MS ms");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase to stderr");
 	printf("\n");
 
 	return;
@@ -160,8 +183,8 @@ int main(int argc, char *argv[])
 	int uio_number;
 	int map_number;
 	uint8_t purge_val;
-	uint16_t start_addr;
-	uint16_t stop_addr;
+	size_t start_addr;
+	size_t stop_addr;
 
 	bool start_given;
 	bool stop_given;
@@ -169,14 +192,37 @@ int main(int argc, char *argv[])
 	bool by_incr = false;
 	bool by_xboard = false;
 	bool by_value = false;
+	bool by_walking = false;
+	bool by_address = false;
+	bool by_lfsr = false;
+	uint32_t lfsr_seed;
+	struct bram_fill_spec spec;
 
 	int result;
 	int retval;
 	struct bram_resource bram;
 	int num_pos_args;
+	struct bram_perf perf;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+	struct bram_lock lock;
+	struct bram_split split;
+	bool splitting = false;
+	bool verify = false;
 
+	static const struct option long_options[] = {
+		{ "cpus", required_argument, NULL, OPT_CPUS },
+		{ "verify", no_argument, NULL, OPT_VERIFY },
+		{ "wait", required_argument, NULL, OPT_WAIT },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
 	int opt;
-	while ((opt = getopt(argc, argv, "hixv:")) != -1) {
+
+	bram_perf_init(&perf);
+	bram_split_init(&split, 0);
+	bram_lock_init(&lock, BRAM_LOCK_EXCLUSIVE);
+	while ((opt = getopt_long(argc, argv, "hixwal:v:j:", long_options,
+					NULL)) != -1) {
 		switch (opt) {
 			case 'h':
 				print_usage();
@@ -187,6 +233,24 @@ int main(int argc, char *argv[])
 			case 'x':
 				by_xboard = true;
 				break;
+			case 'w':
+				by_walking = true;
+				break;
+			case 'a':
+				by_address = true;
+				break;
+			case 'l':
+				by_lfsr = true;
+				if (str_to_uint32(&lfsr_seed, optarg)) {
+					fprintf(stderr, "Error: Bad LFSR seed\n");
+					return 1;
+				}
+				/* The register would never leave the all-zero state */
+				if (!lfsr_seed) {
+					fprintf(stderr, "Error: LFSR seed cannot be 0\n");
+					return 1;
+				}
+				break;
 			case 'v':
 				by_value = true;
 				if (str_to_uint8(&purge_val, optarg)) {
@@ -194,9 +258,39 @@ int main(int argc, char *argv[])
 					return 1;
 				}
 				break;
+			case 'j':
+				if (bram_split_parse_threads(&split, optarg)) {
+					return 1;
+				}
+				splitting = true;
+				break;
+			case OPT_CPUS:
+				if (bram_split_parse_cpus(&split, optarg)) {
+					return 1;
+				}
+				splitting = true;
+				break;
+			case OPT_VERIFY:
+				verify = true;
+				break;
+			case OPT_WAIT:
+				if (bram_lock_parse_wait(&lock.timeout_ms, optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				split.perf = &perf;
+				break;
 			case '?':
 				if (optopt == 'v') {
 					fprintf(stderr, "Error: No purge value specified\n");
+				} else if (optopt == 'l') {
+					fprintf(stderr, "Error: No LFSR seed specified\n");
+				} else if (optopt == 'j') {
+					fprintf(stderr, "Error: No thread count specified\n");
 				} else if (isprint(optopt)) {
 					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
 				} else {
@@ -229,7 +323,7 @@ int main(int argc, char *argv[])
 			break;
 		/* Only given starting address */
 		case 3:
-			if (str_to_uint16(&start_addr, argv[optind + 2])) {
+			if (str_to_size(&start_addr, argv[optind + 2])) {
 				fprintf(stderr, "Error: Bad starting address\n");
 				return -1;
 			}
@@ -238,11 +332,11 @@ int main(int argc, char *argv[])
 			break;
 		/* Start and end addresses given */
 		case 4:
-			if (str_to_uint16(&start_addr, argv[optind + 2])) {
+			if (str_to_size(&start_addr, argv[optind + 2])) {
 				fprintf(stderr, "Error: Bad starting address\n");
 				return -1;
 			}
-			if (str_to_uint16(&stop_addr, argv[optind + 3])) {
+			if (str_to_size(&stop_addr, argv[optind + 3])) {
 				fprintf(stderr, "Error: Bad ending address\n");
 				return -1;
 			}
@@ -256,7 +350,15 @@ int main(int argc, char *argv[])
 			print_usage();
 			return 1;
 	}
-	result = bram_create(&bram, uio_number, map_number);
+	/* Writers elsewhere in the map can carry on */
+	if (start_given) {
+		lock.offset = start_addr;
+	}
+	if (stop_given && (stop_addr >= lock.offset)) {
+		lock.len = 1 + (stop_addr - lock.offset);
+	}
+	result = bram_create_locked(&bram, uio_number, map_number,
+			stats_format ? &perf : NULL, &lock);
 	if (result) {
 		fprintf(stderr, "Could not create block RAM resource for UIO device %d "
 				"or map number %d\n", uio_number, map_number);
@@ -288,22 +390,37 @@ int main(int argc, char *argv[])
 	 * checked for here. If the user hasn't selected one, then we just fall
 	 * out the bottom with nothing to do.
 	 */
+	memset(&spec, 0, sizeof(spec));
 	if (by_value) {
-		retval = purge_bram_by_value(&bram, start_addr, stop_addr, purge_val);
+		spec.pattern = BRAM_PATTERN_VALUE;
+		spec.value = purge_val;
 	} else if (by_xboard) {
-		retval = purge_bram_by_xboard(&bram, start_addr, stop_addr);
+		spec.pattern = BRAM_PATTERN_XBOARD;
 	} else if (by_incr) {
-		retval = purge_bram_by_incr(&bram, start_addr, stop_addr);
+		spec.pattern = BRAM_PATTERN_INCR;
+	} else if (by_walking) {
+		spec.pattern = BRAM_PATTERN_WALKING_ONES;
+	} else if (by_address) {
+		spec.pattern = BRAM_PATTERN_ADDRESS;
+	} else if (by_lfsr) {
+		spec.pattern = BRAM_PATTERN_LFSR;
+		spec.seed = lfsr_seed;
 	} else {
 		printf("No purge pattern selected. Exiting\n");
 		retval = 1;
+		goto err_exit;
 	}
+	retval = purge_bram(&bram, start_addr, stop_addr, &spec,
+			splitting ? &split : NULL, verify) ? 1 : 0;
 
 err_exit:
 	if (bram_destroy(&bram)) {
 		fprintf(stderr, "Could not destroy block RAM resource\n");
 		retval = 1;
 	}
+	if (stats_format) {
+		bram_perf_print(stderr, "bram_purge", &perf, stats_format);
+	}
 	/* Either we failed a bounds check or purging was unsuccessful */
 	return retval;
 
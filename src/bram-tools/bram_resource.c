@@ -1,10 +1,136 @@
 #include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
 
 #include "bram_resource.h"
 #include "bram_helper.h"
+#include "bram_discover.h"
+#include "bram_kernels.h"
+
+static const char *phase_names[BRAM_NUM_PHASES] = {
+	[BRAM_PHASE_CREATE] = "create",
+	[BRAM_PHASE_MAP] = "map",
+	[BRAM_PHASE_TRANSFER] = "transfer",
+	[BRAM_PHASE_FILE] = "file",
+	[BRAM_PHASE_UNMAP] = "unmap",
+};
+
+void bram_perf_init(struct bram_perf *perf)
+{
+	memset(perf, 0, sizeof(*perf));
+	perf->start_ns = bram_clock_ns();
+	return;
+}
+
+uint64_t bram_perf_start(const struct bram_perf *perf)
+{
+	return perf ? bram_clock_ns() : 0;
+}
+
+void bram_perf_record(struct bram_perf *perf, enum bram_phase phase,
+		uint64_t start_ns, size_t bytes)
+{
+	if (perf) {
+		perf->ns[phase] += bram_clock_ns() - start_ns;
+		perf->bytes[phase] += bytes;
+	}
+	return;
+}
+
+void bram_perf_add(struct bram_perf *total, const struct bram_perf *perf)
+{
+	if (perf->start_ns < total->start_ns) {
+		total->start_ns = perf->start_ns;
+	}
+	for (int i = 0; i < BRAM_NUM_PHASES; i++) {
+		total->ns[i] += perf->ns[i];
+		total->bytes[i] += perf->bytes[i];
+	}
+	total->transactions += perf->transactions;
+	return;
+}
+
+int bram_perf_parse_format(enum bram_perf_format *format, const char *str)
+{
+	if (!str || !strcmp(str, "text")) {
+		*format = BRAM_PERF_TEXT;
+	} else if (!strcmp(str, "json")) {
+		*format = BRAM_PERF_JSON;
+	} else {
+		fprintf(stderr, "Error: Unknown stats format `%s'\n", str);
+		return -1;
+	}
+	return 0;
+}
+
+void bram_perf_print(FILE *stream, const char *tool,
+		const struct bram_perf *perf, enum bram_perf_format format)
+{
+	uint64_t total = bram_clock_ns() - perf->start_ns;
+	uint64_t ns;
+
+	if (format == BRAM_PERF_JSON) {
+		fprintf(stream, "{\"tool\":\"%s\",\"total_ns\":%"PRIu64, tool, total);
+		for (int i = 0; i < BRAM_NUM_PHASES; i++) {
+			fprintf(stream, ",\"%s_ns\":%"PRIu64",\"%s_bytes\":%zu",
+					phase_names[i], perf->ns[i], phase_names[i], perf->bytes[i]);
+		}
+		fprintf(stream, ",\"transactions\":%zu}\n", perf->transactions);
+		return;
+	}
+	if (format != BRAM_PERF_TEXT) {
+		return;
+	}
+	fprintf(stream, "%s: total %.3f ms", tool, (double) total / 1e6);
+	for (int i = 0; i < BRAM_NUM_PHASES; i++) {
+		ns = perf->ns[i];
+		fprintf(stream, ", %s %.3f ms", phase_names[i], (double) ns / 1e6);
+		if (perf->bytes[i]) {
+			fprintf(stream, " %zu B", perf->bytes[i]);
+			if (i == BRAM_PHASE_TRANSFER) {
+				fprintf(stream, " %zu tx", perf->transactions);
+			}
+			fprintf(stream, " %.2f MB/s",
+					ns ? ((double) perf->bytes[i] * 1e3 / (double) ns) : 0.0);
+		}
+	}
+	fprintf(stream, "\n");
+	return;
+}
 
 int bram_create(struct bram_resource *bram, int uio_number, int map_number)
 {
+	return bram_create_perf(bram, uio_number, map_number, NULL);
+}
+
+int bram_create_perf(struct bram_resource *bram, int uio_number, int map_number,
+		struct bram_perf *perf)
+{
+	return bram_create_locked(bram, uio_number, map_number, perf, NULL);
+}
+
+/*
+ * Locks are taken once the map is known and before it is mapped. Failing to
+ * get one has already been reported, so it returns 1 rather than -1 to tell
+ * the caller not to blame the mapping.
+ */
+static int lock_and_map(struct bram_resource *bram, const struct bram_lock *lock)
+{
+	if (lock && (lock->mode != BRAM_LOCK_NONE) && bram_lock_range(bram, lock)) {
+		return 1;
+	}
+	if (bram_map_resource(bram)) {
+		bram_lock_release(bram);
+		return -1;
+	}
+	return 0;
+}
+
+int bram_create_locked(struct bram_resource *bram, int uio_number,
+		int map_number, struct bram_perf *perf, const struct bram_lock *lock)
+{
+	uint64_t start = bram_perf_start(perf);
 	int result;
 
 	if ((uio_number < 0) || (map_number < 0)) {
@@ -19,6 +145,8 @@ int bram_create(struct bram_resource *bram, int uio_number, int map_number)
 	bram->map_number = map_number;
 	/* Also null the memory map pointer here so it has to be set by mmap() */
 	bram->map = NULL;
+	bram->perf = perf;
+	bram->lock_fd = -1;
 
 	/* Set path of device file to open later and device IDs */
 	result = bram_set_dev_info(bram);
@@ -36,30 +164,169 @@ int bram_create(struct bram_resource *bram, int uio_number, int map_number)
 		return -1;
 	}
 
+	bram_perf_record(perf, BRAM_PHASE_CREATE, start, 0);
+
 	/* Now we actually create the memory map to read and write this device */
-	result = bram_map_resource(bram);
-	if (result) {
+	start = bram_perf_start(perf);
+	result = lock_and_map(bram, lock);
+	if (result < 0) {
 		fprintf(stderr, "Could not create memory map for device %d and map %d\n",
 				bram->uio_number, bram->map_number);
+	}
+	if (result) {
 		return -1;
 	}
+	bram_perf_record(perf, BRAM_PHASE_MAP, start, 0);
 
 	return 0;
 }
 
 int bram_destroy(struct bram_resource *bram)
 {
+	uint64_t start;
 	int result;
 	if (!bram) {
 		fprintf(stderr, "No block RAM resource to destroy\n");
 		return -1;
 	}
+	start = bram_perf_start(bram->perf);
 	result = bram_unmap_resource(bram);
 	if (result) {
 		fprintf(stderr, "Could not unmap resource\n");
 		return -1;
 	}
+	bram_perf_record(bram->perf, BRAM_PHASE_UNMAP, start, 0);
+	bram_lock_release(bram);
 
 	return 0;
 }
 
+/*
+ * Everything the sysfs parsing in bram_create() would have produced is already
+ * in the index entry, so the only system calls left are open() and mmap()
+ */
+int bram_open(struct bram_resource *bram, const char *map_name)
+{
+	return bram_open_perf(bram, map_name, NULL);
+}
+
+int bram_open_perf(struct bram_resource *bram, const char *map_name,
+		struct bram_perf *perf)
+{
+	return bram_open_locked(bram, map_name, perf, NULL);
+}
+
+int bram_open_locked(struct bram_resource *bram, const char *map_name,
+		struct bram_perf *perf, const struct bram_lock *lock)
+{
+	struct bram_index index;
+	const struct bram_map_entry *entry = NULL;
+	uint64_t start = bram_perf_start(perf);
+	int result;
+
+	if (!bram || !map_name) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if (bram_index_get(&index, 0)) {
+		return -1;
+	}
+	entry = bram_index_find_name(&index, map_name);
+	/* A map that was added since the cache was written forces a rescan */
+	if (!entry) {
+		if (bram_index_get(&index, 1)) {
+			return -1;
+		}
+		entry = bram_index_find_name(&index, map_name);
+	}
+	if (!entry) {
+		fprintf(stderr, "Error: No UIO map named %s\n", map_name);
+		return -1;
+	}
+
+	bram->uio_number = entry->uio_number;
+	bram->map_number = entry->map_number;
+	bram->map = NULL;
+	bram->perf = perf;
+	bram->lock_fd = -1;
+	result = snprintf(bram->dev_path, sizeof(bram->dev_path), "%s/uio%d",
+			bram_dev_root(), entry->uio_number);
+	if ((result < 0) || (result >= (int) sizeof(bram->dev_path))) {
+		fprintf(stderr, "Path name too long\n");
+		return -1;
+	}
+	result = snprintf(bram->map_path, sizeof(bram->map_path),
+			"%s/uio%d/maps/map%d", bram_sysfs_root(), entry->uio_number,
+			entry->map_number);
+	if ((result < 0) || (result >= (int) sizeof(bram->map_path))) {
+		fprintf(stderr, "Path name too long\n");
+		return -1;
+	}
+	bram->major = entry->major;
+	bram->minor = entry->minor;
+	bram->map_addr = entry->map_addr;
+	memcpy(bram->map_name, entry->map_name, sizeof(bram->map_name));
+	bram->map_offset = entry->map_offset;
+	bram->map_size = entry->map_size;
+	bram->map_width = entry->map_width;
+	bram->narrow_burst = entry->narrow_burst;
+	bram->kernels = bram_kernels_select(entry->map_width);
+	bram_perf_record(perf, BRAM_PHASE_CREATE, start, 0);
+
+	start = bram_perf_start(perf);
+	result = lock_and_map(bram, lock);
+	if (result < 0) {
+		fprintf(stderr, "Could not create memory map for %s\n", map_name);
+	}
+	if (result) {
+		return -1;
+	}
+	bram_perf_record(perf, BRAM_PHASE_MAP, start, 0);
+	return 0;
+}
+
+int bram_create_standin(struct bram_resource *bram, size_t size,
+		unsigned int width)
+{
+	if (!bram) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if (!size) {
+		fprintf(stderr, "Error: Stand-in map cannot be empty\n");
+		return -1;
+	}
+	memset(bram, 0, sizeof(*bram));
+	bram->uio_number = -1;
+	bram->map_number = -1;
+	snprintf(bram->map_name, sizeof(bram->map_name), "stand-in");
+	bram->map_size = size;
+	bram->map_width = width;
+	/* Plain memory takes any access width */
+	bram->narrow_burst = 1;
+	bram->kernels = bram_kernels_select(width);
+	bram->lock_fd = -1;
+	return bram_map_standin(bram);
+}
+
+int bram_sync(struct bram_resource *bram)
+{
+	if (!bram) {
+		fprintf(stderr, "No block RAM resource to sync\n");
+		return -1;
+	}
+	return bram_sync_resource(bram, 0, bram->map_size);
+}
+
+int bram_sync_range(struct bram_resource *bram, size_t offset, size_t len)
+{
+	if (!bram) {
+		fprintf(stderr, "No block RAM resource to sync\n");
+		return -1;
+	}
+	if ((offset > bram->map_size) || (len > (bram->map_size - offset))) {
+		fprintf(stderr, "Error: Sync range exceeds map size\n");
+		return -1;
+	}
+	return bram_sync_resource(bram, offset, len);
+}
@@ -5,24 +5,50 @@
 #include <stdint.h>
 #include <sys/types.h>
 
-/* This will typically be determined by the PS configuration within Vivado */
+struct bram_kernels;
+struct bram_perf;
+struct bram_lock;
+
+/*
+ * Data width assumed when the device tree does not say - this will typically
+ * be determined by the PS configuration within Vivado
+ */
 #define BRAM_AXI_CTRL_WIDTH			32
 
+/*
+ * Maps larger than BRAM_WINDOW_THRESHOLD bytes are accessed through a sliding
+ * window of BRAM_WINDOW_SIZE bytes rather than mapped whole. Both can be
+ * overridden through the environment variables of the same name.
+ */
+#define BRAM_WINDOW_THRESHOLD			(1024 * 1024)
+#define BRAM_WINDOW_SIZE			(256 * 1024)
+
+/* Maximum lengths for paths to /dev and /sys entries */
+#define BRAM_DEV_PATH_SIZE			128
+#define BRAM_MAP_PATH_SIZE			160
+#define BRAM_MAP_NAME_SIZE			64
+
+/*
+ * Every resource owns all of its storage and the library keeps no global
+ * state, so separate resources can be used concurrently from separate
+ * threads. A single resource is not locked internally and must not be used
+ * from more than one thread at a time without the caller serializing access.
+ */
 struct bram_resource {
 	/* User provides the UIO device and map numbers at creation */
 	int uio_number;
 	int map_number;
 	/* Path to the node created in /dev */
-	char *dev_path;
+	char dev_path[BRAM_DEV_PATH_SIZE];
 	/* Device major and minor numbers */
 	unsigned int major;
 	unsigned int minor;
 	/* Path to memory map in /sys */
-	char *map_path;
+	char map_path[BRAM_MAP_PATH_SIZE];
 	/* Physical address of the block RAM */
 	uint32_t map_addr;
 	/* String identifier for the mapping */
-	char *map_name;
+	char map_name[BRAM_MAP_NAME_SIZE];
 	/* 
 	 * Location where UIO device has been mapped in memory - this is the
 	 * location returned by call to mmap() that has to be unmapped when the
@@ -42,16 +68,171 @@ struct bram_resource {
 	 */
 	size_t map_size;
 	/*
-	 * The device node for the block RAM controller has the property
-	 * `xlnx,s-axi-ctrl-data-width` which specifies the AXI bus width, but
-	 * this may not presently be exported by the UIO driver. For now, we
-	 * will set it at compile time and then carry it around with the BRAM
-	 * resource structure.
+	 * AXI data width in bits, read from the `xlnx,s-axi-ctrl-data-width`
+	 * property of the controller's device tree node when the UIO device has
+	 * one and BRAM_AXI_CTRL_WIDTH otherwise
 	 */
 	size_t map_width;
+	/*
+	 * Whether the controller accepts bursts of beats narrower than
+	 * map_width, from `xlnx,s-axi-supports-narrow-burst`. Single narrow
+	 * beats are taken either way, so partial words never depend on it.
+	 */
+	int narrow_burst;
+	/* Access loops picked for map_width and used by bram_access.h */
+	const struct bram_kernels *kernels;
+	/*
+	 * The UIO driver can only map a region from its start, so a windowed
+	 * map is mapped through /dev/mem at map_addr instead and map points
+	 * at window_offset bytes into the map. Windows are window_size bytes
+	 * and aligned to it, apart from a shorter last one. Maps that are not
+	 * windowed have a single window covering the whole map.
+	 */
+	int windowed;
+	size_t window_offset;
+	size_t window_size;
+	/* Kept open to move the window, -1 when not windowed */
+	int mem_fd;
+	/*
+	 * Where to account time spent on this resource, or NULL with the
+	 * instrumentation off, in which case it costs a single test per call
+	 */
+	struct bram_perf *perf;
+	/* Open lock file holding the lock in struct bram_lock, -1 without one */
+	int lock_fd;
+};
+
+/* Phases timed by struct bram_perf */
+enum bram_phase {
+	/* Finding the device and reading its attributes from sysfs or the index */
+	BRAM_PHASE_CREATE,
+	BRAM_PHASE_MAP,
+	/* Block RAM reads and writes through bram_access.h */
+	BRAM_PHASE_TRANSFER,
+	/* Reading and writing files, recorded by the tools themselves */
+	BRAM_PHASE_FILE,
+	BRAM_PHASE_UNMAP,
+	BRAM_NUM_PHASES
+};
+
+/*
+ * Monotonic time spent in each phase along with the bytes moved in it. One
+ * of these can be shared by several resources as long as they are used from
+ * a single thread.
+ */
+struct bram_perf {
+	uint64_t start_ns;
+	uint64_t ns[BRAM_NUM_PHASES];
+	size_t bytes[BRAM_NUM_PHASES];
+	size_t transactions;
+};
+
+enum bram_perf_format {
+	BRAM_PERF_OFF,
+	BRAM_PERF_TEXT,
+	BRAM_PERF_JSON,
 };
 
+/* Zero everything and start the clock for the total */
+void bram_perf_init(struct bram_perf *perf);
+/* Zero with perf NULL, so callers need not check it themselves */
+uint64_t bram_perf_start(const struct bram_perf *perf);
+/* Add the time since start_ns and bytes to a phase, if perf is not NULL */
+void bram_perf_record(struct bram_perf *perf, enum bram_phase phase,
+		uint64_t start_ns, size_t bytes);
+/* Fold the phases of perf into total, keeping the earliest start */
+void bram_perf_add(struct bram_perf *total, const struct bram_perf *perf);
+/* Argument to --stats, `text' when str is NULL or `json' */
+int bram_perf_parse_format(enum bram_perf_format *format, const char *str);
+/* A single line summary, either human readable or as a JSON object */
+void bram_perf_print(FILE *stream, const char *tool,
+		const struct bram_perf *perf, enum bram_perf_format format);
+
+/*
+ * Advisory locks on a map, so that tools sharing a board do not write over
+ * each other. Readers take shared locks and writers exclusive ones, each over
+ * just the bytes they touch, so concurrent readers and writers of disjoint
+ * ranges all go ahead. The controller honours byte strobes, so the only
+ * read-modify-write is a masked poke, and that stays within its own access.
+ * The lock is on a file named after the physical address of the map in
+ * BRAM_LOCK_DIR (/run/lock unless the environment says otherwise), so it
+ * covers every UIO map and /dev/mem window onto the same memory, and it is
+ * dropped when the resource is destroyed or the process exits. Nothing stops
+ * a tool that does not ask for a lock.
+ */
+enum bram_lock_mode {
+	BRAM_LOCK_NONE,
+	BRAM_LOCK_SHARED,
+	BRAM_LOCK_EXCLUSIVE,
+};
+
+/* Timeout that waits for as long as it takes */
+#define BRAM_LOCK_WAIT_FOREVER			(-1)
+
+struct bram_lock {
+	enum bram_lock_mode mode;
+	size_t offset;
+	/* Bytes covered from offset, with 0 meaning up to the end of the map */
+	size_t len;
+	/*
+	 * Milliseconds to wait for conflicting locks to be released, 0 to fail
+	 * straight away or BRAM_LOCK_WAIT_FOREVER
+	 */
+	int timeout_ms;
+};
+
+/* The whole map in mode, waiting for as long as it takes */
+void bram_lock_init(struct bram_lock *lock, enum bram_lock_mode mode);
+/* Argument to --wait, in decimal milliseconds */
+int bram_lock_parse_wait(int *timeout_ms, const char *str);
+
+/*
+ * Lock a range of a resource that is already open, and unlock it again, for
+ * tools that keep a map open for long but only need it locked while they
+ * access it. The lock file stays open in between and is closed by
+ * bram_destroy(). Locking a resource that already holds a range adds to it
+ * rather than replacing it, so unlock one range before taking the next.
+ */
+int bram_lock_range(struct bram_resource *bram, const struct bram_lock *lock);
+int bram_unlock_range(struct bram_resource *bram);
+
 int bram_create(struct bram_resource *bram, int uio_number, int map_number);
 int bram_destroy(struct bram_resource *bram);
+
+/* Same as bram_create() but locates the map by the name it has in sysfs */
+int bram_open(struct bram_resource *bram, const char *map_name);
+
+/*
+ * A resource backed by shared anonymous memory of size bytes rather than a
+ * UIO map, with kernels picked for a bus of width bits, so that the tools and
+ * benchmarks can be run off target. It has no UIO device or map number and
+ * is released with bram_destroy() like any other.
+ */
+int bram_create_standin(struct bram_resource *bram, size_t size,
+		unsigned int width);
+
+/* Variants of the above that account everything done with bram in perf */
+int bram_create_perf(struct bram_resource *bram, int uio_number, int map_number,
+		struct bram_perf *perf);
+int bram_open_perf(struct bram_resource *bram, const char *map_name,
+		struct bram_perf *perf);
+
+/*
+ * Variants that also take lock before mapping, failing if it cannot be had
+ * within its timeout. A NULL lock or BRAM_LOCK_NONE takes no lock at all.
+ */
+int bram_create_locked(struct bram_resource *bram, int uio_number,
+		int map_number, struct bram_perf *perf, const struct bram_lock *lock);
+int bram_open_locked(struct bram_resource *bram, const char *map_name,
+		struct bram_perf *perf, const struct bram_lock *lock);
+
+/*
+ * Wait for all outstanding writes to the block RAM to complete. Stores to
+ * device memory can be posted, so this should be called before anything else
+ * in the system is told the memory contents are ready.
+ */
+int bram_sync(struct bram_resource *bram);
+/* Same for len bytes at offset only, for writers of part of a map */
+int bram_sync_range(struct bram_resource *bram, size_t offset, size_t len);
 #endif /* BRAM_CTRL_H */
 
@@ -1 +1,273 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <getopt.h>
+#include <errno.h>
+
 #include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_access.h"
+#include "bram_match.h"
+#include "bram_snapshot.h"
+
+/* Long options without a short equivalent */
+enum {
+	OPT_STATS = 0x100,
+	OPT_WAIT,
+};
+
+/* Number of -x and -s patterns that can be given at once */
+#define MAX_PATTERNS		16
+
+struct search_pattern {
+	const char *text;
+	bool is_string;
+	struct bram_match_pattern pat;
+};
+
+/* Per pattern state for reporting matches as they are found */
+struct search_report {
+	const struct search_pattern *pattern;
+	bool count_only;
+	size_t max_matches;
+	size_t matches;
+};
+
+void print_usage()
+{
+	printf("Usage: bram_search [-x HEX]... [-s STRING]... [-c] [-n MAX] DEVICE MAP "
+			"[START [LENGTH]]\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("  %-15s%-30s\n", "-h", "display program usage");
+	printf("  %-15s%-30s\n", "-x HEX", "search for hex bytes, `?' is a wildcard");
+	printf("  %-15s%-30s\n", "", "nibble, e.g. \"a9 ?? 8d 0?\"");
+	printf("  %-15s%-30s\n", "-s STRING", "search for an ASCII string");
+	printf("  %-15s%-30s\n", "-c", "only print the number of matches");
+	printf("  %-15s%-30s\n", "-n MAX", "stop after MAX matches of each pattern");
+	printf("  %-15s%-30s\n", "--wait MS", "give up on a locked map after MS ms");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase to stderr");
+	printf("\n");
+	return;
+}
+
+static int report_match(size_t offset, void *arg)
+{
+	struct search_report *report = arg;
+
+	report->matches++;
+	if (!report->count_only) {
+		if (report->pattern->is_string) {
+			printf("0x%04zx  \"%s\"\n", offset, report->pattern->text);
+		} else {
+			printf("0x%04zx  %s\n", offset, report->pattern->text);
+		}
+	}
+	return (report->max_matches && (report->matches == report->max_matches));
+}
+
+/*
+ * Take a single snapshot of the range and run every pattern over the copy, so
+ * device memory is only ever read once per word
+ */
+int search_bram(struct bram_resource *bram, size_t start, size_t len,
+		const struct search_pattern *patterns, size_t num_patterns,
+		bool count_only, size_t max_matches)
+{
+	struct search_report report;
+	struct bram_snapshot snap;
+	const uint8_t *data;
+	size_t total = 0;
+
+	if ((start > bram->map_size) || (len > (bram->map_size - start))) {
+		fprintf(stderr, "Error: Search range exceeds map size\n");
+		return -1;
+	}
+	bram_snapshot_init(&snap, bram);
+	if (bram_snapshot_take(&snap, start, len, NULL)) {
+		bram_snapshot_free(&snap);
+		return -1;
+	}
+	data = bram_snapshot_ptr(&snap, start, len);
+
+	for (size_t i = 0; i < num_patterns; i++) {
+		report.pattern = &patterns[i];
+		report.count_only = count_only;
+		report.max_matches = max_matches;
+		report.matches = 0;
+		bram_match_scan(&patterns[i].pat, data, len, start, report_match,
+				&report);
+		if (count_only) {
+			printf("%zu  %s%s%s\n", report.matches,
+					patterns[i].is_string ? "\"" : "", patterns[i].text,
+					patterns[i].is_string ? "\"" : "");
+		}
+		total += report.matches;
+	}
+	bram_snapshot_free(&snap);
+	return (total != 0) ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	int result;
+	int retval;
+
+	struct search_pattern patterns[MAX_PATTERNS];
+	size_t num_patterns = 0;
+	bool count_only = false;
+	size_t max_matches = 0;
+	char *endptr = NULL;
+
+	struct bram_resource bram;
+	int uio_number;
+	int map_number;
+	size_t start_addr = 0;
+	size_t length = 0;
+	bool length_given = false;
+	int num_pos_args;
+
+	int opt;
+	static const struct option long_options[] = {
+		{ "wait", required_argument, NULL, OPT_WAIT },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct bram_perf perf;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+	struct bram_lock lock;
+
+	bram_lock_init(&lock, BRAM_LOCK_SHARED);
+	bram_perf_init(&perf);
+	while ((opt = getopt_long(argc, argv, "hx:s:cn:", long_options,
+					NULL)) != -1) {
+		switch (opt) {
+			case 'h':
+				print_usage();
+				return 0;
+			case 'x':
+			case 's':
+				if (num_patterns == MAX_PATTERNS) {
+					fprintf(stderr, "Error: At most %d patterns can be given\n",
+							MAX_PATTERNS);
+					return 2;
+				}
+				patterns[num_patterns].text = optarg;
+				patterns[num_patterns].is_string = (opt == 's');
+				if (opt == 'x') {
+					result = bram_match_compile_hex(&patterns[num_patterns].pat,
+							optarg);
+				} else {
+					result = bram_match_compile_bytes(&patterns[num_patterns].pat,
+							optarg, strlen(optarg));
+				}
+				if (result) {
+					return 2;
+				}
+				num_patterns++;
+				break;
+			case 'c':
+				count_only = true;
+				break;
+			case 'n':
+				errno = 0;
+				max_matches = strtoul(optarg, &endptr, 10);
+				if (errno || (endptr == optarg) || *endptr) {
+					fprintf(stderr, "Error: Bad match limit\n");
+					return 2;
+				}
+				break;
+			case OPT_WAIT:
+				if (bram_lock_parse_wait(&lock.timeout_ms, optarg)) {
+					return 2;
+				}
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 2;
+				}
+				break;
+			case '?':
+				if ((optopt == 'x') || (optopt == 's') || (optopt == 'n')) {
+					fprintf(stderr, "Error: Option -%c requires an argument\n", optopt);
+				} else if (isprint(optopt)) {
+					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+				} else {
+					fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+				}
+				return 2;
+			default:
+				print_usage();
+				return 2;
+		}
+	}
+	if (!num_patterns) {
+		fprintf(stderr, "Error: No search pattern given\n");
+		print_usage();
+		return 2;
+	}
+	/* Require at least 2 and at most 4 positional arguments */
+	num_pos_args = argc - optind;
+	if ((num_pos_args < 2) || (num_pos_args > 4)) {
+		print_usage();
+		return 2;
+	}
+	if (str_to_index(&uio_number, argv[optind])) {
+		fprintf(stderr, "Error: Bad UIO device number\n");
+		return 2;
+	}
+	if (str_to_index(&map_number, argv[optind + 1])) {
+		fprintf(stderr, "Error: Bad map number\n");
+		return 2;
+	}
+	if (num_pos_args > 2) {
+		if (str_to_size(&start_addr, argv[optind + 2])) {
+			fprintf(stderr, "Error: Bad starting address\n");
+			return 2;
+		}
+	}
+	if (num_pos_args > 3) {
+		if (str_to_size(&length, argv[optind + 3])) {
+			fprintf(stderr, "Error: Bad length\n");
+			return 2;
+		}
+		length_given = true;
+	}
+
+	/* Only the range being read has to stay put */
+	lock.offset = start_addr;
+	lock.len = length_given ? length : 0;
+	result = bram_create_locked(&bram, uio_number, map_number,
+			stats_format ? &perf : NULL, &lock);
+	if (result) {
+		fprintf(stderr, "Could not create block RAM resource for UIO device %d "
+				"or map number %d\n", uio_number, map_number);
+		return 2;
+	}
+
+	/* Without a length, search everything from the start address onwards */
+	if (!length_given) {
+		if (start_addr > bram.map_size) {
+			fprintf(stderr, "Error: Start address exceeds map size\n");
+			bram_destroy(&bram);
+			return 2;
+		}
+		length = bram.map_size - start_addr;
+	}
+
+	/* Like grep, exit with 1 when nothing matched and 2 on errors */
+	result = search_bram(&bram, start_addr, length, patterns, num_patterns,
+			count_only, max_matches);
+	retval = (result < 0) ? 2 : result;
+	if (bram_destroy(&bram)) {
+		fprintf(stderr, "Could not destroy block RAM resource\n");
+		retval = 2;
+	}
+	if (stats_format) {
+		bram_perf_print(stderr, "bram_search", &perf, stats_format);
+	}
+	return retval;
+}
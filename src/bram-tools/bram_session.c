@@ -0,0 +1,319 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "bram_resource.h"
+#include "bram_access.h"
+#include "bram_discover.h"
+#include "bram_hash.h"
+#include "bram_session.h"
+
+/*
+ * Work handed out to the worker threads. Maps are claimed one at a time from
+ * next, so a slow map does not hold up the others queued behind it.
+ */
+struct session_work {
+	struct bram_session *session;
+	int (*run)(struct bram_session_map *map, size_t index, void *arg);
+	void *arg;
+	pthread_mutex_t lock;
+	size_t next;
+};
+
+struct broadcast_args {
+	size_t offset;
+	const uint8_t *src;
+	size_t len;
+	unsigned int flags;
+};
+
+void bram_session_init(struct bram_session *session, unsigned int threads)
+{
+	memset(session, 0, sizeof(*session));
+	session->threads = threads;
+	return;
+}
+
+static struct bram_session_map *session_next_slot(struct bram_session *session)
+{
+	struct bram_session_map *map;
+
+	if (session->count == BRAM_SESSION_MAX_MAPS) {
+		fprintf(stderr, "Error: At most %d maps can be open in a session\n",
+				BRAM_SESSION_MAX_MAPS);
+		return NULL;
+	}
+	map = &session->maps[session->count];
+	memset(map, 0, sizeof(*map));
+	bram_snapshot_init(&map->snap, &map->bram);
+	if (session->perf) {
+		bram_perf_init(&map->perf);
+	}
+	return map;
+}
+
+int bram_session_add(struct bram_session *session, int uio_number,
+		int map_number)
+{
+	struct bram_session_map *map;
+
+	if (!session) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	map = session_next_slot(session);
+	if (!map || bram_create_locked(&map->bram, uio_number, map_number,
+				session->perf ? &map->perf : NULL, session->lock)) {
+		return -1;
+	}
+	session->count++;
+	return 0;
+}
+
+int bram_session_add_name(struct bram_session *session, const char *map_name)
+{
+	struct bram_session_map *map;
+
+	if (!session || !map_name) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	map = session_next_slot(session);
+	if (!map || bram_open_locked(&map->bram, map_name,
+				session->perf ? &map->perf : NULL, session->lock)) {
+		return -1;
+	}
+	session->count++;
+	return 0;
+}
+
+int bram_session_add_all(struct bram_session *session, int rescan)
+{
+	struct bram_index index;
+
+	if (!session) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if (bram_index_get(&index, rescan)) {
+		return -1;
+	}
+	for (size_t i = 0; i < index.count; i++) {
+		if (bram_session_add(session, index.entries[i].uio_number,
+					index.entries[i].map_number)) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int bram_session_close(struct bram_session *session)
+{
+	int retval = 0;
+
+	if (!session) {
+		return -1;
+	}
+	for (size_t i = 0; i < session->count; i++) {
+		bram_snapshot_free(&session->maps[i].snap);
+		if (bram_destroy(&session->maps[i].bram)) {
+			retval = -1;
+		}
+		if (session->perf) {
+			bram_perf_add(session->perf, &session->maps[i].perf);
+		}
+	}
+	session->count = 0;
+	return retval;
+}
+
+static void *session_worker(void *arg)
+{
+	struct session_work *work = arg;
+	struct bram_session_map *map;
+	size_t index;
+
+	for (;;) {
+		pthread_mutex_lock(&work->lock);
+		index = work->next++;
+		pthread_mutex_unlock(&work->lock);
+		if (index >= work->session->count) {
+			break;
+		}
+		map = &work->session->maps[index];
+		bram_xfer_stats_init(&map->stats);
+		map->changed = 0;
+		map->mismatched = 0;
+		map->result = work->run(map, index, work->arg);
+	}
+	return NULL;
+}
+
+/*
+ * Run fn on every map of the session with up to one thread per CPU. The
+ * calling thread is one of the workers, so a single CPU or a single map never
+ * pays for creating a thread, and failing to create more just means fewer.
+ */
+static int session_run(struct bram_session *session,
+		int (*run)(struct bram_session_map *map, size_t index, void *arg),
+		void *arg)
+{
+	struct session_work work;
+	pthread_t threads[BRAM_SESSION_MAX_MAPS];
+	size_t num_threads;
+	size_t num_started = 0;
+	long ncpus;
+	int retval = 0;
+
+	if (!session) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	num_threads = session->threads;
+	if (!num_threads) {
+		ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = (ncpus > 0) ? (size_t) ncpus : 1;
+	}
+	if (num_threads > session->count) {
+		num_threads = session->count;
+	}
+
+	work.session = session;
+	work.run = run;
+	work.arg = arg;
+	work.next = 0;
+	if (pthread_mutex_init(&work.lock, NULL)) {
+		fprintf(stderr, "Error: Could not create session lock\n");
+		return -1;
+	}
+	while ((num_started + 1) < num_threads) {
+		if (pthread_create(&threads[num_started], NULL, session_worker, &work)) {
+			break;
+		}
+		num_started++;
+	}
+	session_worker(&work);
+	for (size_t i = 0; i < num_started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&work.lock);
+
+	for (size_t i = 0; i < session->count; i++) {
+		if (session->maps[i].result) {
+			retval = -1;
+		}
+	}
+	return retval;
+}
+
+static int snapshot_map(struct bram_session_map *map, size_t index, void *arg)
+{
+	(void) index;
+	(void) arg;
+	return bram_snapshot_take(&map->snap, 0, map->bram.map_size, &map->stats);
+}
+
+int bram_session_snapshot(struct bram_session *session)
+{
+	return session_run(session, snapshot_map, NULL);
+}
+
+static int broadcast_map(struct bram_session_map *map, size_t index, void *arg)
+{
+	const struct broadcast_args *args = arg;
+	size_t pos = 0;
+	size_t equal;
+	int result;
+
+	(void) index;
+	if (args->flags & BRAM_SESSION_DIFF) {
+		result = bram_write_diff(&map->bram, args->offset, args->src,
+				args->len, &map->changed, &map->stats);
+	} else {
+		result = bram_write_range(&map->bram, args->offset, args->src,
+				args->len, &map->stats);
+	}
+	if (result || bram_sync_range(&map->bram, args->offset, args->len)) {
+		return -1;
+	}
+	if (!(args->flags & BRAM_SESSION_VERIFY)) {
+		return 0;
+	}
+	/* Count every differing byte rather than stopping at the first */
+	while (pos != args->len) {
+		if (bram_compare_range(&map->bram, args->offset + pos, args->src + pos,
+					args->len - pos, &equal, &map->stats)) {
+			return -1;
+		}
+		pos += equal;
+		if (pos != args->len) {
+			map->mismatched++;
+			pos++;
+		}
+	}
+	return map->mismatched ? -1 : 0;
+}
+
+int bram_session_broadcast(struct bram_session *session, size_t offset,
+		const void *src, size_t len, unsigned int flags)
+{
+	struct broadcast_args args;
+
+	if (!src && len) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	args.offset = offset;
+	args.src = src;
+	args.len = len;
+	args.flags = flags;
+	return session_run(session, broadcast_map, &args);
+}
+
+static void put_le32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = (uint8_t) value;
+	dst[1] = (uint8_t) (value >> 8);
+	dst[2] = (uint8_t) (value >> 16);
+	dst[3] = (uint8_t) (value >> 24);
+	return;
+}
+
+int bram_session_write_section(FILE *stream, const struct bram_resource *bram,
+		const uint8_t *data, uint32_t *crc)
+{
+	uint8_t header[BRAM_SECTION_HEADER_SIZE];
+	uint8_t *field = header + BRAM_SECTION_MAGIC_SIZE;
+	uint32_t data_crc;
+
+	if (!stream || !bram || (!data && bram->map_size)) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	data_crc = bram_crc32(0, data, bram->map_size);
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, BRAM_SECTION_MAGIC, BRAM_SECTION_MAGIC_SIZE);
+	put_le32(field, (uint32_t) bram->uio_number);
+	put_le32(field + 4, (uint32_t) bram->map_number);
+	put_le32(field + 8, bram->map_addr);
+	put_le32(field + 12, (uint32_t) bram->map_size);
+	put_le32(field + 16, data_crc);
+	/* The name is cut short rather than left without its terminator */
+	strncpy((char *) field + 24, bram->map_name, BRAM_SECTION_NAME_SIZE - 1);
+
+	if ((fwrite(header, 1, sizeof(header), stream) != sizeof(header)) ||
+			(fwrite(data, 1, bram->map_size, stream) != bram->map_size)) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	if (crc) {
+		*crc = data_crc;
+	}
+	return 0;
+}
@@ -0,0 +1,108 @@
+#ifndef BRAM_SESSION_H
+#define BRAM_SESSION_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bram_resource.h"
+#include "bram_access.h"
+#include "bram_snapshot.h"
+
+/* Number of maps a single session can have open at once */
+#define BRAM_SESSION_MAX_MAPS		16
+
+/* Flags for bram_session_broadcast() */
+#define BRAM_SESSION_DIFF		0x1
+#define BRAM_SESSION_VERIFY		0x2
+
+/*
+ * Magic at the start of each section of a session dump, see
+ * bram_session_write_section() for the layout
+ */
+#define BRAM_SECTION_MAGIC		"BRAMSECT"
+#define BRAM_SECTION_MAGIC_SIZE		8
+#define BRAM_SECTION_NAME_SIZE		64
+#define BRAM_SECTION_HEADER_SIZE	(BRAM_SECTION_MAGIC_SIZE + 6 * 4 + \
+		BRAM_SECTION_NAME_SIZE)
+
+/* One open map along with the outcome of the last operation run on it */
+struct bram_session_map {
+	struct bram_resource bram;
+	struct bram_xfer_stats stats;
+	/* Words written by the last differential broadcast */
+	size_t changed;
+	/* Bytes that did not read back as written, with BRAM_SESSION_VERIFY */
+	size_t mismatched;
+	int result;
+	/* Instrumentation for this map alone, since maps run on separate threads */
+	struct bram_perf perf;
+	/* Filled by bram_session_snapshot() and freed when the map is closed */
+	struct bram_snapshot snap;
+};
+
+/*
+ * Several block RAM resources opened together so that whole-board operations
+ * can run on all of them at once. Each map is only ever handled by a single
+ * worker thread per operation, so the locking rules in bram_resource.h hold.
+ */
+struct bram_session {
+	size_t count;
+	/* Upper bound on worker threads, zero means one per online CPU */
+	unsigned int threads;
+	/*
+	 * Set after bram_session_init() to instrument every map added from then
+	 * on. Each map is folded into it as it is closed.
+	 */
+	struct bram_perf *perf;
+	/* Likewise, set to lock every map added from then on */
+	const struct bram_lock *lock;
+	struct bram_session_map maps[BRAM_SESSION_MAX_MAPS];
+};
+
+void bram_session_init(struct bram_session *session, unsigned int threads);
+
+/* Open another map and add it to the session */
+int bram_session_add(struct bram_session *session, int uio_number,
+		int map_number);
+int bram_session_add_name(struct bram_session *session, const char *map_name);
+/* Open every map found by bram_index_get() */
+int bram_session_add_all(struct bram_session *session, int rescan);
+
+/* Close every map, carrying on past failures */
+int bram_session_close(struct bram_session *session);
+
+/*
+ * Take a snapshot of every map in full into its snap. Maps are read
+ * concurrently. Returns -1 if any of them failed, with the individual results
+ * left in each map's result.
+ */
+int bram_session_snapshot(struct bram_session *session);
+
+/*
+ * Write the same len bytes from src to offset in every map concurrently, so
+ * that the source only has to be read once however many maps there are.
+ * BRAM_SESSION_DIFF only writes words that differ and BRAM_SESSION_VERIFY
+ * compares each map against src afterwards.
+ */
+int bram_session_broadcast(struct bram_session *session, size_t offset,
+		const void *src, size_t len, unsigned int flags);
+
+/*
+ * Sections are a fixed little-endian header followed by the raw contents of
+ * the map:
+ *
+ *   magic[8]   "BRAMSECT"
+ *   uio        UIO device number
+ *   map        map number
+ *   addr       physical address of the map
+ *   size       number of data bytes following the header
+ *   crc32      CRC-32 of the data bytes
+ *   reserved   zero
+ *   name[64]   map name, NUL padded
+ */
+int bram_session_write_section(FILE *stream, const struct bram_resource *bram,
+		const uint8_t *data, uint32_t *crc);
+
+#endif /* BRAM_SESSION_H */
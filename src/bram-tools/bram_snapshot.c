@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_access.h"
+#include "bram_snapshot.h"
+
+void bram_snapshot_init(struct bram_snapshot *snap, struct bram_resource *bram)
+{
+	memset(snap, 0, sizeof(*snap));
+	snap->bram = bram;
+	return;
+}
+
+void bram_snapshot_free(struct bram_snapshot *snap)
+{
+	if (!snap) {
+		return;
+	}
+	free(snap->data);
+	snap->data = NULL;
+	snap->capacity = 0;
+	snap->len = 0;
+	return;
+}
+
+int bram_snapshot_take(struct bram_snapshot *snap, size_t offset, size_t len,
+		struct bram_xfer_stats *stats)
+{
+	struct bram_resource *bram;
+	uint8_t *data;
+
+	if (!snap || !snap->bram) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	bram = snap->bram;
+	if ((offset > bram->map_size) || (len > (bram->map_size - offset))) {
+		fprintf(stderr, "Error: Snapshot range exceeds map size\n");
+		return -1;
+	}
+	if (len > snap->capacity) {
+		data = realloc(snap->data, len);
+		if (!data) {
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			return -1;
+		}
+		snap->data = data;
+		snap->capacity = len;
+	}
+	snap->offset = offset;
+	snap->len = 0;
+	snap->taken_ns = bram_clock_ns();
+	if (bram_read_range(bram, offset, snap->data, len, stats)) {
+		return -1;
+	}
+	snap->len = len;
+	snap->generation++;
+	return 0;
+}
+
+int bram_snapshot_refresh(struct bram_snapshot *snap,
+		struct bram_xfer_stats *stats)
+{
+	if (!snap) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	return bram_snapshot_take(snap, snap->offset, snap->len, stats);
+}
+
+const uint8_t *bram_snapshot_ptr(const struct bram_snapshot *snap,
+		size_t offset, size_t len)
+{
+	if (!snap || !snap->generation || (offset < snap->offset) ||
+			((offset - snap->offset) > snap->len) ||
+			(len > (snap->len - (offset - snap->offset)))) {
+		return NULL;
+	}
+	/* An empty range still gets a pointer that can be handed to memcmp() */
+	return snap->data ? (snap->data + (offset - snap->offset)) :
+		(const uint8_t *) "";
+}
@@ -0,0 +1,57 @@
+#ifndef BRAM_SNAPSHOT_H
+#define BRAM_SNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bram_resource.h"
+#include "bram_access.h"
+
+/*
+ * Copy of a range of block RAM in ordinary cached memory. Taking one reads the
+ * range with the widest aligned accesses the controller allows, the same as
+ * bram_read_range(), after which any number of read-only consumers can search,
+ * compare, hash or format the copy without going near the bus. Reads of the
+ * mapping itself are uncached, so a consumer that walked it byte by byte would
+ * turn every byte into a bus transaction of its own.
+ *
+ * The buffer is kept between takes and only grows, so a consumer that walks a
+ * large range in chunks can reuse one snapshot for all of them. Nothing keeps
+ * a snapshot in step with the block RAM - the logic on the other port can
+ * change it at any time - so generation and taken_ns say how old it is.
+ */
+struct bram_snapshot {
+	struct bram_resource *bram;
+	/* Range of the map covered by data */
+	size_t offset;
+	size_t len;
+	uint8_t *data;
+	size_t capacity;
+	/* Number of times the snapshot has been taken, zero while it is empty */
+	uint64_t generation;
+	/* CLOCK_MONOTONIC in nanoseconds when the last take started reading */
+	uint64_t taken_ns;
+};
+
+void bram_snapshot_init(struct bram_snapshot *snap, struct bram_resource *bram);
+void bram_snapshot_free(struct bram_snapshot *snap);
+
+/*
+ * Replace the contents with a fresh copy of len bytes at offset, counting the
+ * bus traffic in stats if it is not NULL. On failure the snapshot is left
+ * empty rather than holding a partial copy.
+ */
+int bram_snapshot_take(struct bram_snapshot *snap, size_t offset, size_t len,
+		struct bram_xfer_stats *stats);
+/* Take the same range again */
+int bram_snapshot_refresh(struct bram_snapshot *snap,
+		struct bram_xfer_stats *stats);
+
+/*
+ * The cached copy of len bytes at offset in the map, or NULL if the snapshot
+ * does not cover all of them. Good until the next take.
+ */
+const uint8_t *bram_snapshot_ptr(const struct bram_snapshot *snap,
+		size_t offset, size_t len);
+
+#endif /* BRAM_SNAPSHOT_H */
@@ -0,0 +1,306 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_access.h"
+#include "bram_split.h"
+
+/* What each thread is handed, along with when it started and finished */
+struct split_thread {
+	struct bram_split *split;
+	struct bram_split_slice *slice;
+	const struct bram_resource *bram;
+	bram_split_fn fn;
+	void *arg;
+	uint64_t start_ns;
+	uint64_t end_ns;
+};
+
+void bram_split_init(struct bram_split *split, unsigned int threads)
+{
+	memset(split, 0, sizeof(*split));
+	split->threads = threads;
+	return;
+}
+
+int bram_split_parse_threads(struct bram_split *split, const char *str)
+{
+	char *endptr = NULL;
+	unsigned long value;
+
+	errno = 0;
+	value = strtoul(str, &endptr, 10);
+	if (errno || (endptr == str) || *endptr || (*str == '-') || !value ||
+			(value > BRAM_SPLIT_MAX_THREADS)) {
+		fprintf(stderr, "Error: Thread count has to be from 1 to %d\n",
+				BRAM_SPLIT_MAX_THREADS);
+		return -1;
+	}
+	split->threads = (unsigned int) value;
+	return 0;
+}
+
+int bram_split_parse_cpus(struct bram_split *split, const char *str)
+{
+	const char *pos = str;
+	char *endptr = NULL;
+	unsigned long first;
+	unsigned long last;
+
+	split->num_cpus = 0;
+	for (;;) {
+		errno = 0;
+		first = strtoul(pos, &endptr, 10);
+		if (errno || (endptr == pos) || (*pos == '-')) {
+			goto bad;
+		}
+		last = first;
+		pos = endptr;
+		if (*pos == '-') {
+			pos++;
+			last = strtoul(pos, &endptr, 10);
+			if (errno || (endptr == pos) || (*pos == '-') || (last < first)) {
+				goto bad;
+			}
+			pos = endptr;
+		}
+		if (last >= CPU_SETSIZE) {
+			goto bad;
+		}
+		for (unsigned long cpu = first; cpu <= last; cpu++) {
+			if (split->num_cpus == BRAM_SPLIT_MAX_THREADS) {
+				fprintf(stderr, "Error: At most %d CPUs can be listed\n",
+						BRAM_SPLIT_MAX_THREADS);
+				return -1;
+			}
+			split->cpus[split->num_cpus++] = (int) cpu;
+		}
+		if (!*pos) {
+			return 0;
+		}
+		if (*pos++ != ',') {
+			goto bad;
+		}
+	}
+
+bad:
+	fprintf(stderr, "Error: Bad CPU list `%s'\n", str);
+	return -1;
+}
+
+/*
+ * Slices work through the parent's own mapping, which is only ever read from
+ * here, as they are disjoint and nothing in the resource changes with an
+ * access. The exception is a windowed map, whose window moves with every
+ * access, so each slice maps windows of its own through a duplicate of the
+ * parent's /dev/mem descriptor. Either way nothing is discovered again, so
+ * stand-ins work the same as UIO maps.
+ */
+static int borrow_map(struct bram_split_slice *slice,
+		const struct bram_resource *bram, struct bram_perf *perf)
+{
+	struct bram_resource *own = &slice->bram;
+	uint64_t start = bram_perf_start(perf);
+
+	*own = *bram;
+	own->perf = perf;
+	/* The parent holds the lock for the whole range */
+	own->lock_fd = -1;
+	if (bram->windowed) {
+		own->map = NULL;
+		own->mem_fd = fcntl(bram->mem_fd, F_DUPFD_CLOEXEC, 0);
+		if (own->mem_fd < 0) {
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			return -1;
+		}
+		if (bram_move_window(own, slice->offset)) {
+			close(own->mem_fd);
+			return -1;
+		}
+	}
+	bram_perf_record(perf, BRAM_PHASE_MAP, start, 0);
+	return 0;
+}
+
+static int return_map(struct bram_split_slice *slice)
+{
+	struct bram_resource *own = &slice->bram;
+	uint64_t start = bram_perf_start(own->perf);
+
+	if (own->windowed && bram_unmap_resource(own)) {
+		return -1;
+	}
+	bram_perf_record(own->perf, BRAM_PHASE_UNMAP, start, 0);
+	return 0;
+}
+
+/*
+ * Each thread pins itself before it touches anything, so whatever the
+ * operation allocates is first touched on the core that will use it
+ */
+static void *split_worker(void *arg)
+{
+	struct split_thread *thread = arg;
+	struct bram_split_slice *slice = thread->slice;
+	cpu_set_t set;
+
+	if (slice->cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(slice->cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set)) {
+			fprintf(stderr, "Error: Could not pin thread to CPU %d: %s\n",
+					slice->cpu, strerror(errno));
+			slice->result = -1;
+			return NULL;
+		}
+	} else {
+		slice->cpu = sched_getcpu();
+	}
+	if (borrow_map(slice, thread->bram,
+				thread->split->perf ? &slice->perf : NULL)) {
+		slice->result = -1;
+		return NULL;
+	}
+	thread->start_ns = bram_clock_ns();
+	slice->result = thread->fn(slice, thread->arg);
+	thread->end_ns = bram_clock_ns();
+	slice->ns = thread->end_ns - thread->start_ns;
+	if (return_map(slice)) {
+		slice->result = -1;
+	}
+	return NULL;
+}
+
+int bram_split_run(struct bram_split *split, const struct bram_resource *bram,
+		size_t offset, size_t len, bram_split_fn fn, void *arg)
+{
+	struct split_thread threads[BRAM_SPLIT_MAX_THREADS];
+	pthread_t ids[BRAM_SPLIT_MAX_THREADS];
+	struct bram_split_slice *slice;
+	unsigned int num_threads;
+	size_t align;
+	size_t per_slice;
+	size_t pos;
+	size_t next;
+	size_t end;
+	size_t num_started = 0;
+	uint64_t first_ns = UINT64_MAX;
+	uint64_t last_ns = 0;
+	int retval = 0;
+
+	if (!split || !bram || !fn) {
+		fprintf(stderr, "Error: Failed NULL pointer check\n");
+		return -1;
+	}
+	if ((offset > bram->map_size) || (len > (bram->map_size - offset))) {
+		fprintf(stderr, "Error: Range exceeds map size\n");
+		return -1;
+	}
+	num_threads = split->threads ? split->threads : split->num_cpus;
+	num_threads = num_threads ? num_threads : 1;
+
+	/*
+	 * Slices meet at map offsets that are multiples of align, so no bus word
+	 * is ever written by two threads. The first slice takes any unaligned
+	 * start and the last any unaligned end. Short ranges end up with fewer
+	 * slices than threads.
+	 */
+	align = bram->map_width / 8;
+	align = (align > BRAM_SPLIT_ALIGN) ? align : BRAM_SPLIT_ALIGN;
+	per_slice = (len + num_threads - 1) / num_threads;
+	per_slice = (per_slice + align - 1) & ~(align - 1);
+	split->count = 0;
+	pos = offset;
+	end = offset + len;
+	while (pos != end) {
+		next = (pos - (pos % align)) + per_slice;
+		if ((next > end) || (split->count == (num_threads - 1))) {
+			next = end;
+		}
+		slice = &split->slices[split->count];
+		memset(slice, 0, sizeof(*slice));
+		slice->offset = pos;
+		slice->len = next - pos;
+		pos = next;
+		split->count++;
+	}
+	for (size_t i = 0; i < split->count; i++) {
+		slice = &split->slices[i];
+		slice->cpu = split->num_cpus ? split->cpus[i % split->num_cpus] : -1;
+		bram_xfer_stats_init(&slice->stats);
+		bram_perf_init(&slice->perf);
+
+		threads[i].split = split;
+		threads[i].slice = slice;
+		threads[i].bram = bram;
+		threads[i].fn = fn;
+		threads[i].arg = arg;
+		threads[i].start_ns = 0;
+		threads[i].end_ns = 0;
+	}
+
+	for (; num_started < split->count; num_started++) {
+		if (pthread_create(&ids[num_started], NULL, split_worker,
+					&threads[num_started])) {
+			fprintf(stderr, "Error: Could not start thread %zu\n", num_started);
+			retval = -1;
+			break;
+		}
+	}
+	for (size_t i = 0; i < num_started; i++) {
+		pthread_join(ids[i], NULL);
+	}
+
+	for (size_t i = 0; i < num_started; i++) {
+		if (split->slices[i].result) {
+			retval = -1;
+		}
+		if (threads[i].end_ns) {
+			first_ns = (threads[i].start_ns < first_ns) ? threads[i].start_ns :
+				first_ns;
+			last_ns = (threads[i].end_ns > last_ns) ? threads[i].end_ns : last_ns;
+		}
+		if (split->perf) {
+			bram_perf_add(split->perf, &split->slices[i].perf);
+		}
+	}
+	split->ns = (last_ns > first_ns) ? (last_ns - first_ns) : 0;
+	return retval;
+}
+
+static double split_mbps(size_t bytes, uint64_t ns)
+{
+	return ns ? ((double) bytes * 1e3 / (double) ns) : 0.0;
+}
+
+void bram_split_print(FILE *stream, const struct bram_split *split)
+{
+	const struct bram_split_slice *slice;
+	size_t bytes = 0;
+	size_t transactions = 0;
+
+	for (size_t i = 0; i < split->count; i++) {
+		slice = &split->slices[i];
+		fprintf(stream, "  thread %zu on cpu %d: 0x%04zx-0x%04zx, %zu bytes in "
+				"%zu bus transactions, %.3f ms (%.2f MB/s)\n", i, slice->cpu,
+				slice->offset, slice->offset + slice->len - 1,
+				slice->stats.bytes, slice->stats.transactions,
+				(double) slice->ns / 1e6,
+				split_mbps(slice->stats.bytes, slice->ns));
+		bytes += slice->stats.bytes;
+		transactions += slice->stats.transactions;
+	}
+	fprintf(stream, "  %zu threads: %zu bytes in %zu bus transactions, %.3f ms "
+			"(%.2f MB/s)\n", split->count, bytes, transactions,
+			(double) split->ns / 1e6, split_mbps(bytes, split->ns));
+	return;
+}
@@ -0,0 +1,83 @@
+#ifndef BRAM_SPLIT_H
+#define BRAM_SPLIT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "bram_resource.h"
+#include "bram_access.h"
+
+/* Most threads a single range can be split across */
+#define BRAM_SPLIT_MAX_THREADS		16
+
+/*
+ * Slices meet at map offsets that are multiples of this or of the bus width,
+ * whichever is larger, so that two threads never share a bus word and the
+ * parts of a staging buffer laid out by map offset that they write never
+ * share a cache line. Cortex-A9 lines are 32 bytes, this also covers the
+ * hosts the tools get run on off target.
+ */
+#define BRAM_SPLIT_ALIGN		64
+
+/*
+ * One thread's share of the range. Every slice has a resource of its own that
+ * shares the parent's mapping, or for a windowed map has windows of its own,
+ * so no resource is ever used from more than one thread and the rules in
+ * bram_resource.h hold without any locking here.
+ */
+struct bram_split_slice {
+	struct bram_resource bram;
+	size_t offset;
+	size_t len;
+	/* Core the thread was pinned to, or the one it started on if not pinned */
+	int cpu;
+	struct bram_xfer_stats stats;
+	/* Time spent in the operation itself, not in mapping */
+	uint64_t ns;
+	int result;
+	struct bram_perf perf;
+};
+
+/*
+ * A range of one map split into consecutive slices that are worked on by a
+ * thread each. With cpus given, slice i runs pinned to cpus[i % num_cpus].
+ */
+struct bram_split {
+	unsigned int threads;
+	int cpus[BRAM_SPLIT_MAX_THREADS];
+	unsigned int num_cpus;
+	/* Set to instrument every slice, each is folded into it when done */
+	struct bram_perf *perf;
+	size_t count;
+	struct bram_split_slice slices[BRAM_SPLIT_MAX_THREADS];
+	/* From the first thread starting to the last one finishing */
+	uint64_t ns;
+};
+
+/* Work on one slice, returning -1 on failure */
+typedef int (*bram_split_fn)(struct bram_split_slice *slice, void *arg);
+
+void bram_split_init(struct bram_split *split, unsigned int threads);
+
+/*
+ * Arguments to -j, from 1 to BRAM_SPLIT_MAX_THREADS, and to --cpus, a comma
+ * separated list of cores or ranges of cores such as 0,1 or 0-1. A list also
+ * sets the number of threads to its length unless -j says otherwise.
+ */
+int bram_split_parse_threads(struct bram_split *split, const char *str);
+int bram_split_parse_cpus(struct bram_split *split, const char *str);
+
+/*
+ * Split len bytes at offset of the map behind bram and run fn on every slice
+ * at once. The slices go through the mapping of bram, which must not be
+ * destroyed or have its window moved until this returns. Returns -1 if any
+ * slice failed, with the individual results left in each slice.
+ */
+int bram_split_run(struct bram_split *split, const struct bram_resource *bram,
+		size_t offset, size_t len, bram_split_fn fn, void *arg);
+
+/* One line per thread with its range, core and throughput, then the total */
+void bram_split_print(FILE *stream, const struct bram_split *split);
+
+#endif /* BRAM_SPLIT_H */
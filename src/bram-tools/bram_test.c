@@ -0,0 +1,432 @@
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_memtest.h"
+
+/* Long options without a short equivalent */
+enum {
+	OPT_STATS = 0x100,
+	OPT_WAIT,
+};
+
+/* Only this many failing ranges are listed, the bitmap has the rest */
+#define MAX_LISTED_RANGES		16
+
+struct test_entry {
+	const char *name;
+	int (*run)(const struct bram_test_port *port,
+			struct bram_test_result *result);
+	bool selected;
+};
+
+static struct test_entry tests[] = {
+	{ "March C-", bram_test_march, false },
+	{ "Walking bits", bram_test_walking, false },
+	{ "Address", bram_test_address, false },
+};
+
+#define NUM_TESTS	(sizeof(tests) / sizeof(tests[0]))
+
+/* Faults are given as stuck:OFFSET:BIT:VALUE, alias:LINE or lane:LANE */
+static int parse_fault(struct bram_fault *fault, const char *spec)
+{
+	int consumed = 0;
+
+	memset(fault, 0, sizeof(*fault));
+	if ((sscanf(spec, "stuck:%zx:%u:%u%n", &fault->offset, &fault->bit,
+					&fault->value, &consumed) == 3) && !spec[consumed]) {
+		fault->type = BRAM_FAULT_STUCK_BIT;
+		return 0;
+	}
+	if ((sscanf(spec, "alias:%u%n", &fault->bit, &consumed) == 1) &&
+			!spec[consumed]) {
+		fault->type = BRAM_FAULT_ADDR_LINE;
+		return 0;
+	}
+	if ((sscanf(spec, "lane:%u%n", &fault->bit, &consumed) == 1) &&
+			!spec[consumed]) {
+		fault->type = BRAM_FAULT_BYTE_LANE;
+		return 0;
+	}
+	return -1;
+}
+
+static double elapsed_since(const struct timespec *t_start)
+{
+	struct timespec t_stop;
+
+	clock_gettime(CLOCK_MONOTONIC, &t_stop);
+	return (double) (t_stop.tv_sec - t_start->tv_sec) +
+		((double) (t_stop.tv_nsec - t_start->tv_nsec) / 1e9);
+}
+
+static void print_bits(const char *label, uint32_t bits)
+{
+	printf("  %-24s", label);
+	if (!bits) {
+		printf("none\n");
+		return;
+	}
+	for (unsigned int bit = 0; bit < 32; bit++) {
+		if ((bits >> bit) & 0x1) {
+			printf(" %u", bit);
+		}
+	}
+	printf("\n");
+	return;
+}
+
+/* Collapse the error bitmap into runs of consecutive failing words */
+static void print_failing_ranges(const struct bram_test_result *result)
+{
+	size_t end = result->start + result->len;
+	size_t run_start = 0;
+	size_t listed = 0;
+	size_t runs = 0;
+	bool in_run = false;
+
+	for (size_t offset = result->start; offset <= end; offset += 4) {
+		if ((offset < end) && bram_test_word_failed(result, offset)) {
+			if (!in_run) {
+				run_start = offset;
+				in_run = true;
+			}
+			continue;
+		}
+		if (in_run) {
+			runs++;
+			if (listed < MAX_LISTED_RANGES) {
+				printf("    0x%04zx-0x%04zx\n", run_start, offset - 1);
+				listed++;
+			}
+			in_run = false;
+		}
+	}
+	if (runs > listed) {
+		printf("    ... %zu more\n", runs - listed);
+	}
+	return;
+}
+
+static int save_error_map(const struct bram_test_result *result,
+		const char *path)
+{
+	size_t map_bytes = ((result->len / 4) + 7) / 8;
+	ssize_t written;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Could not open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	written = write(fd, result->error_map, map_bytes);
+	if ((close(fd) || (written < 0)) || ((size_t) written != map_bytes)) {
+		fprintf(stderr, "Error: Could not write error map to %s\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Run every selected test over the range and print a line per test followed
+ * by a summary of everything that failed. Returns 1 if any word failed.
+ */
+static int run_tests(const struct bram_test_port *port, size_t start, size_t len,
+		const char *map_path)
+{
+	struct bram_test_result total;
+	struct bram_test_result result;
+	struct timespec t_start;
+	double elapsed;
+	int retval = 0;
+
+	if (bram_test_result_init(&total, start, len)) {
+		return -1;
+	}
+	printf("Testing 0x%04zx to 0x%04zx (%zu words)\n", start, start + len - 1,
+			len / 4);
+	for (size_t i = 0; i < NUM_TESTS; i++) {
+		if (!tests[i].selected) {
+			continue;
+		}
+		if (bram_test_result_init(&result, start, len)) {
+			retval = -1;
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t_start);
+		if (tests[i].run(port, &result)) {
+			bram_test_result_free(&result);
+			retval = -1;
+			break;
+		}
+		elapsed = elapsed_since(&t_start);
+		printf("  %-14s%-6s %8zu accesses %8.3f ms %8.2f MB/s %6zu bad words\n",
+				tests[i].name, result.failed_words ? "FAIL" : "pass",
+				result.accesses, elapsed * 1e3,
+				(elapsed > 0) ? ((double) result.accesses * 4 / elapsed / 1e6) : 0.0,
+				result.failed_words);
+		bram_test_result_merge(&total, &result);
+		bram_test_result_free(&result);
+	}
+
+	if (!retval) {
+		printf("Result: %s, %zu of %zu words failed\n",
+				total.failed_words ? "FAIL" : "PASS", total.failed_words, len / 4);
+		if (total.failed_words) {
+			print_bits("Bits reading 0 for 1:", total.stuck_zero);
+			print_bits("Bits reading 1 for 0:", total.stuck_one);
+			print_bits("Failing byte lanes:", total.failing_lanes);
+			print_bits("Aliased address lines:", total.alias_lines);
+			printf("  Failing ranges:\n");
+			print_failing_ranges(&total);
+			retval = 1;
+		}
+		if (map_path && save_error_map(&total, map_path)) {
+			retval = -1;
+		}
+	}
+	bram_test_result_free(&total);
+	return retval;
+}
+
+void print_usage()
+{
+	printf("Usage: bram_test [-m] [-w] [-a] [-o MAPFILE] DEVICE MAP [START [END]]\n");
+	printf("       bram_test -s SIZE [-f FAULT]... [-m] [-w] [-a] [START [END]]\n");
+	printf("\n");
+	printf("Destructively tests the range, running every test if none is selected.\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("  %-15s%-30s\n", "-h", "display program usage");
+	printf("  %-15s%-30s\n", "-m", "run the March C- test");
+	printf("  %-15s%-30s\n", "-w", "run the walking bit test");
+	printf("  %-15s%-30s\n", "-a", "run the address uniqueness test");
+	printf("  %-15s%-30s\n", "-o MAPFILE", "save the per-word error bitmap");
+	printf("  %-15s%-30s\n", "-s SIZE", "test a memory stand-in of SIZE bytes");
+	printf("  %-15s%-30s\n", "-f FAULT", "inject stuck:OFFSET:BIT:VALUE,");
+	printf("  %-15s%-30s\n", "", "alias:LINE or lane:LANE into the stand-in");
+	printf("  %-15s%-30s\n", "--wait MS", "give up on a locked map after MS ms");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase to stderr");
+	printf("\n");
+
+	return;
+}
+
+int main(int argc, char *argv[])
+{
+	int uio_number;
+	int map_number;
+	size_t start_addr = 0;
+	size_t stop_addr = 0;
+	size_t standin_size = 0;
+	bool stop_given = false;
+	bool any_selected = false;
+	const char *map_path = NULL;
+
+	struct bram_fault faults[BRAM_FAULT_MAX];
+	size_t num_faults = 0;
+	struct bram_fault_map fmap;
+	struct bram_test_port port;
+	struct bram_resource bram;
+	bool use_bram;
+
+	int retval;
+	int num_pos_args;
+	int pos;
+
+	int opt;
+	static const struct option long_options[] = {
+		{ "wait", required_argument, NULL, OPT_WAIT },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct bram_perf perf;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+	struct bram_lock lock;
+
+	bram_lock_init(&lock, BRAM_LOCK_EXCLUSIVE);
+	bram_perf_init(&perf);
+	while ((opt = getopt_long(argc, argv, "hmwao:s:f:", long_options,
+					NULL)) != -1) {
+		switch (opt) {
+			case 'h':
+				print_usage();
+				return 0;
+			case 'm':
+				tests[0].selected = true;
+				break;
+			case 'w':
+				tests[1].selected = true;
+				break;
+			case 'a':
+				tests[2].selected = true;
+				break;
+			case 'o':
+				map_path = optarg;
+				break;
+			case 's':
+				if (str_to_size(&standin_size, optarg) || !standin_size) {
+					fprintf(stderr, "Error: Bad stand-in size\n");
+					return 1;
+				}
+				break;
+			case 'f':
+				if (num_faults == BRAM_FAULT_MAX) {
+					fprintf(stderr, "Error: Too many faults\n");
+					return 1;
+				}
+				if (parse_fault(&faults[num_faults], optarg)) {
+					fprintf(stderr, "Error: Bad fault `%s'\n", optarg);
+					return 1;
+				}
+				num_faults++;
+				break;
+			case OPT_WAIT:
+				if (bram_lock_parse_wait(&lock.timeout_ms, optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				break;
+			case '?':
+				if ((optopt == 'o') || (optopt == 's') || (optopt == 'f')) {
+					fprintf(stderr, "Error: Option -%c requires an argument\n", optopt);
+				} else if (isprint(optopt)) {
+					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+				} else {
+					fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+				}
+				return 1;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+	for (size_t i = 0; i < NUM_TESTS; i++) {
+		any_selected |= tests[i].selected;
+	}
+	if (!any_selected) {
+		for (size_t i = 0; i < NUM_TESTS; i++) {
+			tests[i].selected = true;
+		}
+	}
+	if (num_faults && !standin_size) {
+		fprintf(stderr, "Error: Faults can only be injected into a stand-in (-s)\n");
+		return 1;
+	}
+
+	/* The stand-in takes the place of the DEVICE and MAP arguments */
+	use_bram = !standin_size;
+	num_pos_args = argc - optind;
+	pos = optind;
+	if (use_bram) {
+		if ((num_pos_args < 2) || (num_pos_args > 4)) {
+			fprintf(stderr, "Error: Incorrect number of positional arguments\n");
+			print_usage();
+			return 1;
+		}
+		if (str_to_index(&uio_number, argv[pos++])) {
+			fprintf(stderr, "Error: Bad UIO device number\n");
+			return 1;
+		}
+		if (str_to_index(&map_number, argv[pos++])) {
+			fprintf(stderr, "Error: Bad map number\n");
+			return 1;
+		}
+	} else if (num_pos_args > 2) {
+		fprintf(stderr, "Error: Incorrect number of positional arguments\n");
+		print_usage();
+		return 1;
+	}
+	if (pos < argc) {
+		if (str_to_size(&start_addr, argv[pos++])) {
+			fprintf(stderr, "Error: Bad starting address\n");
+			return 1;
+		}
+	}
+	if (pos < argc) {
+		if (str_to_size(&stop_addr, argv[pos++])) {
+			fprintf(stderr, "Error: Bad ending address\n");
+			return 1;
+		}
+		stop_given = true;
+	}
+
+	if (use_bram) {
+		lock.offset = start_addr;
+		if (stop_given && (stop_addr >= start_addr)) {
+			lock.len = 1 + (stop_addr - start_addr);
+		}
+		if (bram_create_locked(&bram, uio_number, map_number,
+					stats_format ? &perf : NULL, &lock)) {
+			fprintf(stderr, "Could not create block RAM resource for UIO device %d "
+					"or map number %d\n", uio_number, map_number);
+			return 1;
+		}
+		retval = bram_test_port_init(&port, &bram);
+	} else {
+		memset(&fmap, 0, sizeof(fmap));
+		retval = bram_fault_map_create(&fmap, standin_size);
+		for (size_t i = 0; !retval && (i < num_faults); i++) {
+			retval = bram_fault_map_add(&fmap, &faults[i]);
+		}
+		if (!retval) {
+			retval = bram_fault_port_init(&port, &fmap);
+		}
+	}
+	if (retval) {
+		retval = 1;
+		goto err_exit;
+	}
+
+	if (!stop_given) {
+		stop_addr = port.size - 1;
+	}
+	if (start_addr > stop_addr) {
+		fprintf(stderr, "Error: Start address is greater than stop address\n");
+		retval = 1;
+		goto err_exit;
+	}
+	if (stop_addr > (port.size - 1)) {
+		fprintf(stderr, "Error: Stop address cannot exceed map size\n");
+		retval = 1;
+		goto err_exit;
+	}
+	/* Every access is a full word, so the range has to cover whole words */
+	if ((start_addr % 4) || ((stop_addr + 1) % 4)) {
+		fprintf(stderr, "Error: Range has to start and end on a word boundary\n");
+		retval = 1;
+		goto err_exit;
+	}
+
+	retval = run_tests(&port, start_addr, (stop_addr - start_addr) + 1,
+			map_path) ? 1 : 0;
+
+err_exit:
+	if (use_bram) {
+		bram_destroy(&bram);
+		if (stats_format) {
+			bram_perf_print(stderr, "bram_test", &perf, stats_format);
+		}
+	} else {
+		bram_fault_map_destroy(&fmap);
+	}
+	return retval;
+}
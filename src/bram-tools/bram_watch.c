@@ -0,0 +1,557 @@
+#define _POSIX_C_SOURCE 200809L
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/resource.h>
+
+#include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_access.h"
+#include "bram_snapshot.h"
+
+/* Long options without a short equivalent */
+enum {
+	OPT_STATS = 0x100,
+	OPT_WAIT,
+};
+
+/* Snapshots taken per second unless -r says otherwise */
+#define WATCH_DEFAULT_RATE	100
+
+/*
+ * Changed bytes separated by fewer unchanged ones than this are reported as
+ * one range, so a counter that ticks over does not come out as three
+ */
+#define WATCH_MERGE_GAP		8
+
+/* Equal stretches are skipped this many bytes at a time */
+#define WATCH_SKIP_BLOCK	64
+
+/*
+ * The binary stream starts with
+ *
+ *   magic[8]     "BRAMWAT1"
+ *   start        offset of the watched range in the map
+ *   length       length of the watched range
+ *   rate         requested snapshots per second, 0 for free running
+ *
+ * followed by one record per changed range of
+ *
+ *   time[8]      nanoseconds since the first snapshot
+ *   offset       offset of the range in the map
+ *   len          number of bytes in the range
+ *   old[len]     contents in the previous snapshot
+ *   new[len]     contents in this snapshot
+ *
+ * with every number little-endian and all but time 32 bits wide.
+ */
+#define WATCH_MAGIC		"BRAMWAT1"
+#define WATCH_MAGIC_SIZE	8
+
+#define NSEC_PER_SEC		UINT64_C(1000000000)
+
+/* Buffer for the output stream, so changes go out in large writes */
+#define WATCH_OUT_BUF_SIZE	(64 * 1024)
+
+struct watch_state {
+	FILE *out;
+	bool binary;
+	size_t changes;
+	size_t changed_bytes;
+	/* Taken on the watched range for each snapshot only */
+	const struct bram_lock *lock;
+};
+
+static volatile sig_atomic_t running = 1;
+static char out_buf[WATCH_OUT_BUF_SIZE];
+
+void print_usage()
+{
+	printf("Usage: bram_watch [-r RATE] [-n SAMPLES] [-b] [-o OUTFILE] DEVICE MAP "
+			"[START [LENGTH]]\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("  %-15s%-30s\n", "-h", "display program usage");
+	printf("  %-15s%-30s\n", "-r RATE", "take RATE snapshots a second, 0 to run");
+	printf("  %-15s%-30s\n", "", "flat out (default 100)");
+	printf("  %-15s%-30s\n", "-n SAMPLES", "stop after SAMPLES snapshots");
+	printf("  %-15s%-30s\n", "-b", "write a binary stream instead of text");
+	printf("  %-15s%-30s\n", "-o OUTFILE", "write changes to OUTFILE instead of stdout");
+	printf("  %-15s%-30s\n", "--wait MS", "give up on a locked map after MS ms");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase to stderr");
+	printf("\n");
+	printf("Each range that changed between two snapshots is printed as\n");
+	printf("SECONDS OFFSET LENGTH OLD -> NEW. Runs until SAMPLES or an interrupt,\n");
+	printf("then the achieved rate and CPU usage are printed to stderr.\n");
+	printf("\n");
+	return;
+}
+
+static void handle_signal(int sig)
+{
+	(void) sig;
+	running = 0;
+	return;
+}
+
+static void put_le32(uint8_t *dst, uint32_t value)
+{
+	dst[0] = (uint8_t) value;
+	dst[1] = (uint8_t) (value >> 8);
+	dst[2] = (uint8_t) (value >> 16);
+	dst[3] = (uint8_t) (value >> 24);
+	return;
+}
+
+static uint64_t ts_to_ns(const struct timespec *ts)
+{
+	return (uint64_t) ts->tv_sec * NSEC_PER_SEC + (uint64_t) ts->tv_nsec;
+}
+
+static uint64_t tv_to_ns(const struct timeval *tv)
+{
+	return (uint64_t) tv->tv_sec * NSEC_PER_SEC + (uint64_t) tv->tv_usec * 1000;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts_to_ns(&ts);
+}
+
+static uint64_t cpu_ns(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return tv_to_ns(&usage.ru_utime) + tv_to_ns(&usage.ru_stime);
+}
+
+static int write_header(struct watch_state *state, size_t start, size_t len,
+		unsigned long rate)
+{
+	uint8_t header[WATCH_MAGIC_SIZE + 3 * 4];
+
+	memcpy(header, WATCH_MAGIC, WATCH_MAGIC_SIZE);
+	put_le32(header + WATCH_MAGIC_SIZE, (uint32_t) start);
+	put_le32(header + WATCH_MAGIC_SIZE + 4, (uint32_t) len);
+	put_le32(header + WATCH_MAGIC_SIZE + 8, (uint32_t) rate);
+	if (fwrite(header, sizeof(header), 1, state->out) != 1) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int emit_change(struct watch_state *state, uint64_t stamp, size_t offset,
+		const uint8_t *old, const uint8_t *new, size_t len)
+{
+	uint8_t record[8 + 2 * 4];
+	int result = 0;
+
+	state->changes++;
+	state->changed_bytes += len;
+	if (state->binary) {
+		put_le32(record, (uint32_t) stamp);
+		put_le32(record + 4, (uint32_t) (stamp >> 32));
+		put_le32(record + 8, (uint32_t) offset);
+		put_le32(record + 12, (uint32_t) len);
+		if ((fwrite(record, sizeof(record), 1, state->out) != 1) ||
+				(fwrite(old, len, 1, state->out) != 1) ||
+				(fwrite(new, len, 1, state->out) != 1)) {
+			result = -1;
+		}
+	} else {
+		result = fprintf(state->out, "%4"PRIu64".%06"PRIu64"  0x%04zx  %zu ",
+				stamp / NSEC_PER_SEC, (stamp % NSEC_PER_SEC) / 1000, offset, len);
+		for (size_t i = 0; (result >= 0) && (i < len); i++) {
+			result = fprintf(state->out, " %02x", old[i]);
+		}
+		if (result >= 0) {
+			result = fprintf(state->out, " ->");
+		}
+		for (size_t i = 0; (result >= 0) && (i < len); i++) {
+			result = fprintf(state->out, " %02x", new[i]);
+		}
+		if (result >= 0) {
+			result = fprintf(state->out, "\n");
+		}
+	}
+	if (result < 0) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Index of the first byte from pos on that differs. Unchanged memory is the
+ * common case, so it is skipped a block at a time with memcmp(), which the C
+ * library vectorizes, before narrowing down to the byte.
+ */
+static size_t next_change(const uint8_t *old, const uint8_t *new, size_t pos,
+		size_t len)
+{
+	while (((len - pos) >= WATCH_SKIP_BLOCK) &&
+			!memcmp(old + pos, new + pos, WATCH_SKIP_BLOCK)) {
+		pos += WATCH_SKIP_BLOCK;
+	}
+	while ((pos != len) && (old[pos] == new[pos])) {
+		pos++;
+	}
+	return pos;
+}
+
+/* End of the changed range starting at pos, bridging short unchanged gaps */
+static size_t change_end(const uint8_t *old, const uint8_t *new, size_t pos,
+		size_t len)
+{
+	size_t gap;
+
+	while (pos != len) {
+		if (old[pos] != new[pos]) {
+			pos++;
+			continue;
+		}
+		gap = pos;
+		while ((gap != len) && ((gap - pos) < WATCH_MERGE_GAP) &&
+				(old[gap] == new[gap])) {
+			gap++;
+		}
+		if ((gap == len) || ((gap - pos) == WATCH_MERGE_GAP)) {
+			break;
+		}
+		pos = gap;
+	}
+	return pos;
+}
+
+static int compare_snapshots(struct watch_state *state, uint64_t stamp,
+		size_t start, const uint8_t *old, const uint8_t *new, size_t len)
+{
+	size_t pos = 0;
+	size_t end;
+	size_t changes = state->changes;
+
+	while ((pos = next_change(old, new, pos, len)) != len) {
+		end = change_end(old, new, pos, len);
+		if (emit_change(state, stamp, start + pos, old + pos, new + pos,
+					end - pos)) {
+			return -1;
+		}
+		pos = end;
+	}
+	/* Push each batch out as it happens so the output can be followed live */
+	if ((state->changes != changes) && fflush(state->out)) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * The range is locked only while a snapshot of it is taken, so that writers
+ * get in between snapshots rather than waiting for the whole watch to end
+ */
+static int take_snapshot(struct watch_state *state, struct bram_snapshot *snap,
+		size_t start, size_t len, struct bram_xfer_stats *stats)
+{
+	int result;
+
+	if (bram_lock_range(snap->bram, state->lock)) {
+		return -1;
+	}
+	result = bram_snapshot_take(snap, start, len, stats);
+	if (bram_unlock_range(snap->bram)) {
+		result = -1;
+	}
+	return result;
+}
+
+/*
+ * Snapshot the range at the requested rate until told to stop. Two snapshots
+ * take turns, the older one being retaken after each comparison, so after the
+ * first two the loop never allocates or copies.
+ */
+int watch_bram(struct bram_resource *bram, size_t start, size_t len,
+		unsigned long rate, size_t max_samples, struct watch_state *state)
+{
+	struct bram_xfer_stats stats;
+	struct bram_snapshot snaps[2];
+	struct bram_snapshot *old = &snaps[0];
+	struct bram_snapshot *new = &snaps[1];
+	struct bram_snapshot *swap;
+	uint64_t period = rate ? (NSEC_PER_SEC / rate) : 0;
+	uint64_t t_start;
+	uint64_t t_now;
+	uint64_t t_next;
+	uint64_t t_read = 0;
+	uint64_t cpu_start;
+	uint64_t elapsed;
+	size_t samples = 0;
+	size_t overruns = 0;
+	struct timespec deadline;
+	int retval = -1;
+
+	if ((start > bram->map_size) || (len > (bram->map_size - start))) {
+		fprintf(stderr, "Error: Watch range exceeds map size\n");
+		return -1;
+	}
+	bram_snapshot_init(old, bram);
+	bram_snapshot_init(new, bram);
+	if (state->binary && write_header(state, start, len, rate)) {
+		goto out;
+	}
+
+	bram_xfer_stats_init(&stats);
+	cpu_start = cpu_ns();
+	if (take_snapshot(state, old, start, len, &stats)) {
+		goto out;
+	}
+	t_start = old->taken_ns;
+	t_next = t_start;
+	while (running && (!max_samples || (samples < max_samples))) {
+		if (period) {
+			t_next += period;
+			t_now = now_ns();
+			if (t_now >= t_next) {
+				/* Fell behind, drop the missed slots rather than bursting */
+				overruns++;
+				t_next = t_now;
+			} else {
+				deadline.tv_sec = (time_t) (t_next / NSEC_PER_SEC);
+				deadline.tv_nsec = (long) (t_next % NSEC_PER_SEC);
+				while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+							NULL) == EINTR) {
+					if (!running) {
+						break;
+					}
+				}
+				if (!running) {
+					break;
+				}
+			}
+		}
+		if (take_snapshot(state, new, start, len, &stats)) {
+			goto out;
+		}
+		t_read += now_ns() - new->taken_ns;
+		if (compare_snapshots(state, new->taken_ns - t_start, start, old->data,
+					new->data, len)) {
+			goto out;
+		}
+		swap = old;
+		old = new;
+		new = swap;
+		samples++;
+	}
+	elapsed = now_ns() - t_start;
+	retval = 0;
+
+	fprintf(stderr, "Took %zu snapshots of %zu bytes in %.3f s, %.1f Hz "
+			"(requested %lu), %zu overruns\n", samples, len,
+			(double) elapsed / 1e9,
+			elapsed ? ((double) samples * 1e9 / (double) elapsed) : 0.0,
+			rate, overruns);
+	fprintf(stderr, "Mean snapshot read %.1f us, %zu bus transactions, CPU "
+			"usage %.1f%%\n",
+			samples ? ((double) t_read / (double) samples / 1e3) : 0.0,
+			stats.transactions,
+			elapsed ? (100.0 * (double) (cpu_ns() - cpu_start) /
+				(double) elapsed) : 0.0);
+	fprintf(stderr, "%zu changed ranges, %zu bytes\n", state->changes,
+			state->changed_bytes);
+
+out:
+	bram_snapshot_free(old);
+	bram_snapshot_free(new);
+	return retval;
+}
+
+int main(int argc, char *argv[])
+{
+	int result;
+	int retval;
+
+	struct bram_resource bram;
+	struct watch_state state;
+	struct sigaction sa;
+	int uio_number;
+	int map_number;
+	size_t start_addr = 0;
+	size_t length = 0;
+	bool length_given = false;
+	unsigned long rate = WATCH_DEFAULT_RATE;
+	size_t max_samples = 0;
+	char *filename = NULL;
+	char *endptr = NULL;
+	int num_pos_args;
+
+	int opt;
+
+	memset(&state, 0, sizeof(state));
+	static const struct option long_options[] = {
+		{ "wait", required_argument, NULL, OPT_WAIT },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct bram_perf perf;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+	struct bram_lock lock;
+
+	bram_lock_init(&lock, BRAM_LOCK_SHARED);
+	bram_perf_init(&perf);
+	while ((opt = getopt_long(argc, argv, "hr:n:bo:", long_options,
+					NULL)) != -1) {
+		switch (opt) {
+			case 'h':
+				print_usage();
+				return 0;
+			case 'r':
+				errno = 0;
+				rate = strtoul(optarg, &endptr, 10);
+				if (errno || (endptr == optarg) || *endptr || (*optarg == '-') ||
+						(rate > NSEC_PER_SEC)) {
+					fprintf(stderr, "Error: Bad snapshot rate\n");
+					return 1;
+				}
+				break;
+			case 'n':
+				errno = 0;
+				max_samples = strtoul(optarg, &endptr, 10);
+				if (errno || (endptr == optarg) || *endptr || (*optarg == '-')) {
+					fprintf(stderr, "Error: Bad snapshot count\n");
+					return 1;
+				}
+				break;
+			case 'b':
+				state.binary = true;
+				break;
+			case 'o':
+				filename = optarg;
+				break;
+			case OPT_WAIT:
+				if (bram_lock_parse_wait(&lock.timeout_ms, optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				break;
+			case '?':
+				if ((optopt == 'r') || (optopt == 'n') || (optopt == 'o')) {
+					fprintf(stderr, "Error: Option -%c requires an argument\n", optopt);
+				} else if (isprint(optopt)) {
+					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+				} else {
+					fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+				}
+				return 1;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+	/* Require at least 2 and at most 4 positional arguments */
+	num_pos_args = argc - optind;
+	if ((num_pos_args < 2) || (num_pos_args > 4)) {
+		print_usage();
+		return 1;
+	}
+	if (str_to_index(&uio_number, argv[optind])) {
+		fprintf(stderr, "Error: Bad UIO device number\n");
+		return 1;
+	}
+	if (str_to_index(&map_number, argv[optind + 1])) {
+		fprintf(stderr, "Error: Bad map number\n");
+		return 1;
+	}
+	if (num_pos_args > 2) {
+		if (str_to_size(&start_addr, argv[optind + 2])) {
+			fprintf(stderr, "Error: Bad starting address\n");
+			return 1;
+		}
+	}
+	if (num_pos_args > 3) {
+		if (str_to_size(&length, argv[optind + 3])) {
+			fprintf(stderr, "Error: Bad length\n");
+			return 1;
+		}
+		length_given = true;
+	}
+
+	/* Only the range being read has to stay put, and only while it is read */
+	lock.offset = start_addr;
+	lock.len = length_given ? length : 0;
+	state.lock = &lock;
+	result = bram_create_perf(&bram, uio_number, map_number,
+			stats_format ? &perf : NULL);
+	if (result) {
+		fprintf(stderr, "Could not create block RAM resource for UIO device %d "
+				"or map number %d\n", uio_number, map_number);
+		return 1;
+	}
+
+	/* Without a length, watch everything from the start address onwards */
+	if (!length_given) {
+		if (start_addr > bram.map_size) {
+			fprintf(stderr, "Error: Start address exceeds map size\n");
+			bram_destroy(&bram);
+			return 1;
+		}
+		length = bram.map_size - start_addr;
+	}
+
+	if (filename) {
+		state.out = fopen(filename, state.binary ? "wb" : "w");
+		if (!state.out) {
+			fprintf(stderr, "Error: Could not open %s: %s\n", filename,
+					strerror(errno));
+			bram_destroy(&bram);
+			return 1;
+		}
+	} else {
+		state.out = stdout;
+	}
+	setvbuf(state.out, out_buf, _IOFBF, sizeof(out_buf));
+
+	/* Stop cleanly on an interrupt so the summary still gets printed */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	retval = 0;
+	result = watch_bram(&bram, start_addr, length, rate, max_samples, &state);
+	if (result) {
+		fprintf(stderr, "Could not watch block RAM resource\n");
+		retval = 1;
+	}
+	if (fflush(state.out) || (filename && fclose(state.out))) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		retval = 1;
+	}
+	if (bram_destroy(&bram)) {
+		fprintf(stderr, "Could not destroy block RAM resource\n");
+		retval = 1;
+	}
+	if (stats_format) {
+		bram_perf_print(stderr, "bram_watch", &perf, stats_format);
+	}
+	return retval;
+}
@@ -0,0 +1,391 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <getopt.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "bramd_proto.h"
+#include "bramd_client.h"
+#include "bram_resource.h"
+#include "bram_helper.h"
+
+/* Most tokens a single command line read from stdin can have */
+#define BRAMCTL_MAX_TOKENS	8
+
+/* Long options without a short equivalent */
+enum {
+	OPT_STATS = 0x100,
+};
+
+/*
+ * The bus work happens in the daemon, so round trips count as transfers and
+ * writing dumps out as file time. NULL unless --stats was given.
+ */
+static struct bram_perf *perf;
+
+/* A request and its response, timed as a transfer of bytes */
+static int timed_call(int sock, const struct bramd_request *req, int fd,
+		struct bramd_response *resp, size_t bytes)
+{
+	uint64_t t_start = bram_perf_start(perf);
+	int result;
+
+	result = bramd_call(sock, req, fd, resp);
+	bram_perf_record(perf, BRAM_PHASE_TRANSFER, t_start, bytes);
+	if (perf) {
+		perf->transactions++;
+	}
+	return result;
+}
+
+void print_usage()
+{
+	printf("Usage: bramctl [-s SOCKET] [COMMAND DEVICE MAP [ARGS...]]\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("  %-15s%-30s\n", "-h", "display program usage");
+	printf("  %-15s%-30s\n", "-s SOCKET", "connect to bramd on SOCKET");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase to stderr");
+	printf("\n");
+	printf("Commands:\n");
+	printf("  %-36s%s\n", "info DEVICE MAP", "describe a map");
+	printf("  %-36s%s\n", "peek DEVICE MAP ADDR [WIDTH]", "read 1, 2 or 4 bytes");
+	printf("  %-36s%s\n", "poke DEVICE MAP ADDR VALUE [WIDTH]", "write 1, 2 or 4 bytes");
+	printf("  %-36s%s\n", "fill DEVICE MAP START LENGTH VALUE", "fill a range");
+	printf("  %-36s%s\n", "load DEVICE MAP ADDR FILE", "load FILE at ADDR");
+	printf("  %-36s%s\n", "dump DEVICE MAP START LENGTH [FILE]", "dump a range");
+	printf("\n");
+	printf("With no command, commands are read one per line from stdin and\n");
+	printf("sent over a single connection. Numbers are hexadecimal.\n");
+	return;
+}
+
+static int parse_hex(uint64_t *value, const char *str)
+{
+	char *endptr = NULL;
+	unsigned long long result;
+
+	errno = 0;
+	result = strtoull(str, &endptr, 16);
+	if ((str == endptr) || *endptr || errno || (*str == '-')) {
+		fprintf(stderr, "Error: Invalid number `%s'\n", str);
+		return -1;
+	}
+	*value = result;
+	return 0;
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t result;
+
+	while (len) {
+		result = write(fd, buf, len);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			return -1;
+		}
+		buf += result;
+		len -= result;
+	}
+	return 0;
+}
+
+static int do_load(int sock, struct bramd_request *req, const char *filename)
+{
+	struct bramd_response resp;
+	struct stat sb;
+	int fd;
+	int retval = 0;
+
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Could not open %s: %s\n", filename,
+				strerror(errno));
+		return -1;
+	}
+	/* The daemon maps the file directly, so it has to be a real file */
+	if (fstat(fd, &sb) || !S_ISREG(sb.st_mode)) {
+		fprintf(stderr, "Error: %s is not a regular file\n", filename);
+		close(fd);
+		return -1;
+	}
+	req->length = sb.st_size;
+	if (timed_call(sock, req, fd, &resp, req->length)) {
+		retval = -1;
+	} else if (resp.status) {
+		fprintf(stderr, "Error: Load failed: %s\n", strerror(-resp.status));
+		retval = -1;
+	}
+	close(fd);
+	return retval;
+}
+
+static int do_dump(int sock, struct bramd_request *req, const char *filename)
+{
+	struct bramd_response resp;
+	void *payload = MAP_FAILED;
+	int memfd;
+	int outfd = STDOUT_FILENO;
+	uint64_t t_file;
+	int retval = -1;
+
+	/* The daemon copies straight into this shared region */
+	memfd = memfd_create("bramctl", MFD_CLOEXEC);
+	if (memfd < 0) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	if (ftruncate(memfd, req->length)) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		goto out;
+	}
+	if (timed_call(sock, req, memfd, &resp, req->length)) {
+		goto out;
+	}
+	if (resp.status) {
+		fprintf(stderr, "Error: Dump failed: %s\n", strerror(-resp.status));
+		goto out;
+	}
+	if (!req->length) {
+		retval = 0;
+		goto out;
+	}
+	payload = mmap(NULL, req->length, PROT_READ, MAP_SHARED, memfd, 0);
+	if (payload == MAP_FAILED) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		goto out;
+	}
+	if (filename) {
+		outfd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (outfd < 0) {
+			fprintf(stderr, "Error: Could not open %s: %s\n", filename,
+					strerror(errno));
+			goto out;
+		}
+	}
+	t_file = bram_perf_start(perf);
+	retval = write_all(outfd, payload, req->length);
+	bram_perf_record(perf, BRAM_PHASE_FILE, t_file, req->length);
+	if (filename && close(outfd)) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		retval = -1;
+	}
+
+out:
+	if (payload != MAP_FAILED) {
+		munmap(payload, req->length);
+	}
+	close(memfd);
+	return retval;
+}
+
+static int run_command(int sock, int argc, char *argv[])
+{
+	struct bramd_request req;
+	struct bramd_response resp;
+	uint64_t value;
+	const char *cmd;
+	int uio_number;
+	int map_number;
+	int nargs;
+
+	if (argc < 3) {
+		fprintf(stderr, "Error: Commands need a device and map number\n");
+		return -1;
+	}
+	cmd = argv[0];
+	nargs = argc - 3;
+
+	memset(&req, 0, sizeof(req));
+	if (str_to_index(&uio_number, argv[1])) {
+		fprintf(stderr, "Error: Bad UIO device number\n");
+		return -1;
+	}
+	if (str_to_index(&map_number, argv[2])) {
+		fprintf(stderr, "Error: Bad map number\n");
+		return -1;
+	}
+	req.uio_number = uio_number;
+	req.map_number = map_number;
+	req.width = 1;
+
+	if (!strcmp(cmd, "info") && (nargs == 0)) {
+		req.op = BRAMD_OP_INFO;
+	} else if (!strcmp(cmd, "peek") && ((nargs == 1) || (nargs == 2))) {
+		req.op = BRAMD_OP_PEEK;
+		if (parse_hex(&req.offset, argv[3])) {
+			return -1;
+		}
+		if (nargs == 2) {
+			if (parse_hex(&value, argv[4])) {
+				return -1;
+			}
+			req.width = (uint32_t) value;
+		}
+	} else if (!strcmp(cmd, "poke") && ((nargs == 2) || (nargs == 3))) {
+		req.op = BRAMD_OP_POKE;
+		if (parse_hex(&req.offset, argv[3]) || parse_hex(&req.value, argv[4])) {
+			return -1;
+		}
+		if (nargs == 3) {
+			if (parse_hex(&value, argv[5])) {
+				return -1;
+			}
+			req.width = (uint32_t) value;
+		}
+	} else if (!strcmp(cmd, "fill") && (nargs == 3)) {
+		req.op = BRAMD_OP_FILL;
+		if (parse_hex(&req.offset, argv[3]) || parse_hex(&req.length, argv[4]) ||
+				parse_hex(&req.value, argv[5])) {
+			return -1;
+		}
+	} else if (!strcmp(cmd, "load") && (nargs == 2)) {
+		req.op = BRAMD_OP_LOAD;
+		if (parse_hex(&req.offset, argv[3])) {
+			return -1;
+		}
+		return do_load(sock, &req, argv[4]);
+	} else if (!strcmp(cmd, "dump") && ((nargs == 2) || (nargs == 3))) {
+		req.op = BRAMD_OP_DUMP;
+		if (parse_hex(&req.offset, argv[3]) || parse_hex(&req.length, argv[4])) {
+			return -1;
+		}
+		return do_dump(sock, &req, (nargs == 3) ? argv[5] : NULL);
+	} else {
+		fprintf(stderr, "Error: Unknown command or wrong number of arguments "
+				"for `%s'\n", cmd);
+		return -1;
+	}
+
+	if (timed_call(sock, &req, -1, &resp,
+				(req.op == BRAMD_OP_FILL) ? req.length :
+				(req.op == BRAMD_OP_INFO) ? 0 : req.width)) {
+		return -1;
+	}
+	if (resp.status) {
+		fprintf(stderr, "Error: %s failed: %s\n", cmd, strerror(-resp.status));
+		return -1;
+	}
+	switch (req.op) {
+		case BRAMD_OP_INFO:
+			printf("%-16s%.*s\n", "Map name:", BRAMD_MAX_NAME_SIZE, resp.map_name);
+			printf("%-16s0x%08"PRIx64"\n", "Map addr:", resp.map_addr);
+			printf("%-16s0x%08"PRIx64"\n", "Map size:", resp.map_size);
+			break;
+		case BRAMD_OP_PEEK:
+			printf("0x%0*"PRIx64"\n", (int) (2 * req.width), resp.value);
+			break;
+		default:
+			break;
+	}
+	return 0;
+}
+
+/* Run every command on stdin over the one connection */
+static int run_script(int sock)
+{
+	char *line = NULL;
+	size_t line_size = 0;
+	char *tokens[BRAMCTL_MAX_TOKENS];
+	char *token;
+	int ntokens;
+	int retval = 0;
+
+	while (getline(&line, &line_size, stdin) != -1) {
+		ntokens = 0;
+		token = strtok(line, " \t\r\n");
+		while (token && (ntokens < BRAMCTL_MAX_TOKENS)) {
+			tokens[ntokens++] = token;
+			token = strtok(NULL, " \t\r\n");
+		}
+		/* Blank lines and comments */
+		if (!ntokens || (tokens[0][0] == '#')) {
+			continue;
+		}
+		if (token) {
+			fprintf(stderr, "Error: Too many arguments for `%s'\n", tokens[0]);
+			retval = -1;
+			continue;
+		}
+		if (run_command(sock, ntokens, tokens)) {
+			retval = -1;
+		}
+		/* Keep output in step with the commands that produced it */
+		fflush(stdout);
+	}
+	free(line);
+	return retval;
+}
+
+int main(int argc, char *argv[])
+{
+	char *sock_path = NULL;
+	int sock;
+	int result;
+	struct bram_perf stats;
+	enum bram_perf_format stats_format = BRAM_PERF_OFF;
+
+	static const struct option long_options[] = {
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
+	bram_perf_init(&stats);
+	int opt;
+	while ((opt = getopt_long(argc, argv, "+hs:", long_options, NULL)) != -1) {
+		switch (opt) {
+			case 'h':
+				print_usage();
+				return 0;
+			case 's':
+				sock_path = optarg;
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				perf = &stats;
+				break;
+			case '?':
+				if (optopt == 's') {
+					fprintf(stderr, "Error: No socket path specified\n");
+				} else if (isprint(optopt)) {
+					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+				} else {
+					fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+				}
+				return 1;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+
+	sock = bramd_connect(sock_path);
+	if (sock < 0) {
+		return 1;
+	}
+	if (optind == argc) {
+		result = run_script(sock);
+	} else {
+		result = run_command(sock, argc - optind, &argv[optind]);
+	}
+	close(sock);
+	if (stats_format) {
+		bram_perf_print(stderr, "bramctl", &stats, stats_format);
+	}
+	return result ? 1 : 0;
+}
@@ -0,0 +1,522 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "bram_resource.h"
+#include "bram_helper.h"
+#include "bram_access.h"
+#include "bramd_proto.h"
+
+/* Number of distinct UIO device and map pairs kept open at once */
+#define BRAMD_MAX_RESOURCES	16
+/* Number of clients that can be connected at once */
+#define BRAMD_MAX_CLIENTS	32
+#define BRAMD_BACKLOG		8
+/*
+ * Milliseconds a request waits for a conflicting lock by default. Nothing else
+ * is served meanwhile, so the wait is never left open-ended.
+ */
+#define BRAMD_LOCK_WAIT_MS	1000
+
+/* Long options without a short equivalent */
+enum {
+	OPT_STATS = 0x100,
+	OPT_WAIT,
+};
+
+struct bramd_slot {
+	bool in_use;
+	struct bram_resource bram;
+	struct bram_perf perf;
+};
+
+static struct bramd_slot slots[BRAMD_MAX_RESOURCES];
+static volatile sig_atomic_t running = 1;
+static enum bram_perf_format stats_format = BRAM_PERF_OFF;
+static int lock_wait_ms = BRAMD_LOCK_WAIT_MS;
+
+void print_usage()
+{
+	printf("Usage: bramd [-s SOCKET] [DEVICE MAP]...\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("  %-15s%-30s\n", "-h", "display program usage");
+	printf("  %-15s%-30s\n", "-s SOCKET", "listen on SOCKET instead of "
+			BRAMD_SOCKET_PATH);
+	printf("  %-15s%-30s\n", "--wait MS", "fail requests on a locked range after");
+	printf("  %-15s%-30s\n", "", "MS ms (default 1000)");
+	printf("  %-15s%-30s\n", "--stats[=json]", "print time spent per phase on each");
+	printf("  %-15s%-30s\n", "", "map to stderr at exit");
+	printf("\n");
+	printf("Any DEVICE MAP pairs given are opened at startup, all others are\n");
+	printf("opened on first use and kept open until the daemon exits. Each\n");
+	printf("request locks the range it touches for as long as it runs.\n");
+	return;
+}
+
+static void handle_signal(int sig)
+{
+	(void) sig;
+	running = 0;
+	return;
+}
+
+static struct bramd_slot *bramd_get_slot(int uio_number, int map_number)
+{
+	struct bramd_slot *free_slot = NULL;
+
+	for (int i = 0; i < BRAMD_MAX_RESOURCES; i++) {
+		if (!slots[i].in_use) {
+			if (!free_slot) {
+				free_slot = &slots[i];
+			}
+			continue;
+		}
+		if ((slots[i].bram.uio_number == uio_number) &&
+				(slots[i].bram.map_number == map_number)) {
+			return &slots[i];
+		}
+	}
+	if (!free_slot) {
+		fprintf(stderr, "Error: No free resource slots for UIO device %d "
+				"map %d\n", uio_number, map_number);
+		return NULL;
+	}
+	bram_perf_init(&free_slot->perf);
+	if (bram_create_perf(&free_slot->bram, uio_number, map_number,
+				stats_format ? &free_slot->perf : NULL)) {
+		return NULL;
+	}
+	free_slot->in_use = true;
+	fprintf(stderr, "Opened UIO device %d map %d (%s)\n", uio_number,
+			map_number, free_slot->bram.map_name);
+	return free_slot;
+}
+
+/* Map the payload descriptor attached to a bulk request */
+static void *bramd_map_payload(int fd, size_t length, int prot)
+{
+	struct stat sb;
+	void *payload;
+
+	if (fstat(fd, &sb)) {
+		return NULL;
+	}
+	if ((size_t) sb.st_size < length) {
+		fprintf(stderr, "Error: Payload of %zu bytes is smaller than the "
+				"request\n", (size_t) sb.st_size);
+		return NULL;
+	}
+	payload = mmap(NULL, length, prot, MAP_SHARED, fd, 0);
+	if (payload == MAP_FAILED) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return NULL;
+	}
+	return payload;
+}
+
+static void bramd_execute(struct bram_resource *bram,
+		const struct bramd_request *req, int fd, struct bramd_response *resp)
+{
+	uint32_t value;
+	void *payload = NULL;
+	int prot;
+
+	switch (req->op) {
+		case BRAMD_OP_INFO:
+			resp->map_addr = bram->map_addr;
+			resp->map_size = bram->map_size;
+			snprintf(resp->map_name, sizeof(resp->map_name), "%s",
+					bram->map_name);
+			break;
+		case BRAMD_OP_PEEK:
+			if (bram_peek(bram, req->offset, req->width, &value)) {
+				resp->status = -EINVAL;
+				break;
+			}
+			resp->value = value;
+			break;
+		case BRAMD_OP_POKE:
+			if (bram_poke(bram, req->offset, req->width, (uint32_t) req->value)) {
+				resp->status = -EINVAL;
+			}
+			break;
+		case BRAMD_OP_FILL:
+			if (bram_fill_range(bram, req->offset, req->length,
+						(uint8_t) req->value, NULL)) {
+				resp->status = -EINVAL;
+				break;
+			}
+			resp->value = req->length;
+			break;
+		case BRAMD_OP_LOAD:
+		case BRAMD_OP_DUMP:
+			if (fd < 0) {
+				resp->status = -EBADF;
+				break;
+			}
+			if (!req->length) {
+				break;
+			}
+			prot = (req->op == BRAMD_OP_LOAD) ? PROT_READ : PROT_READ | PROT_WRITE;
+			payload = bramd_map_payload(fd, req->length, prot);
+			if (!payload) {
+				resp->status = -EFAULT;
+				break;
+			}
+			if (req->op == BRAMD_OP_LOAD) {
+				resp->status = bram_write_range(bram, req->offset, payload,
+						req->length, NULL) ? -EIO : 0;
+			} else {
+				resp->status = bram_read_range(bram, req->offset, payload,
+						req->length, NULL) ? -EIO : 0;
+			}
+			munmap(payload, req->length);
+			if (!resp->status) {
+				resp->value = req->length;
+			}
+			break;
+		default:
+			resp->status = -EOPNOTSUPP;
+			break;
+	}
+	return;
+}
+
+/*
+ * Lock the bytes a request touches, shared for the ones that only read and
+ * exclusive for the rest, or nothing for a request that is not understood
+ */
+static int bramd_lock(struct bram_resource *bram,
+		const struct bramd_request *req)
+{
+	struct bram_lock lock;
+
+	switch (req->op) {
+		case BRAMD_OP_INFO:
+		case BRAMD_OP_PEEK:
+		case BRAMD_OP_DUMP:
+			bram_lock_init(&lock, BRAM_LOCK_SHARED);
+			break;
+		case BRAMD_OP_POKE:
+		case BRAMD_OP_FILL:
+		case BRAMD_OP_LOAD:
+			bram_lock_init(&lock, BRAM_LOCK_EXCLUSIVE);
+			break;
+		default:
+			return 0;
+	}
+	lock.offset = req->offset;
+	if ((req->op == BRAMD_OP_PEEK) || (req->op == BRAMD_OP_POKE)) {
+		lock.len = req->width;
+	} else {
+		lock.len = req->length;
+	}
+	/* A length of 0 would lock the whole map rather than no bytes at all */
+	if (!lock.len) {
+		return 0;
+	}
+	lock.timeout_ms = lock_wait_ms;
+	return bram_lock_range(bram, &lock);
+}
+
+static void bramd_handle(const struct bramd_request *req, int fd,
+		struct bramd_response *resp)
+{
+	struct bramd_slot *slot;
+	struct bram_resource *bram;
+
+	memset(resp, 0, sizeof(*resp));
+
+	slot = bramd_get_slot(req->uio_number, req->map_number);
+	if (!slot) {
+		resp->status = -ENODEV;
+		return;
+	}
+	bram = &slot->bram;
+
+	if ((req->offset > bram->map_size) ||
+			(req->length > (bram->map_size - req->offset))) {
+		resp->status = -ERANGE;
+		return;
+	}
+
+	/* The lock is dropped again before the client hears back */
+	if (bramd_lock(bram, req)) {
+		resp->status = -EBUSY;
+		return;
+	}
+	bramd_execute(bram, req, fd, resp);
+	if (bram_unlock_range(bram) && !resp->status) {
+		resp->status = -EIO;
+	}
+	return;
+}
+
+/*
+ * Service one message from a client. Returns -1 once the client has gone away
+ * or sent something unrecoverable, so that the connection can be dropped.
+ */
+static int bramd_serve(int sock)
+{
+	struct bramd_request req;
+	struct bramd_response resp;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	ssize_t result;
+	int fd = -1;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &req;
+	iov.iov_len = sizeof(req);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	result = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	if (result <= 0) {
+		return -1;
+	}
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+		}
+	}
+
+	if ((result != sizeof(req)) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+		memset(&resp, 0, sizeof(resp));
+		resp.status = -EINVAL;
+	} else {
+		bramd_handle(&req, fd, &resp);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+
+	result = send(sock, &resp, sizeof(resp), MSG_NOSIGNAL);
+	if (result != sizeof(resp)) {
+		return -1;
+	}
+	return 0;
+}
+
+static int bramd_listen(const char *path)
+{
+	struct sockaddr_un addr;
+	int sock;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Error: Socket path too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	/* A stale socket left behind by an earlier instance would block bind() */
+	unlink(path);
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr))) {
+		fprintf(stderr, "Error: Could not bind %s: %s\n", path, strerror(errno));
+		close(sock);
+		return -1;
+	}
+	if (listen(sock, BRAMD_BACKLOG)) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		close(sock);
+		unlink(path);
+		return -1;
+	}
+	return sock;
+}
+
+int main(int argc, char *argv[])
+{
+	char *sock_path = NULL;
+	int listen_sock;
+	struct pollfd fds[1 + BRAMD_MAX_CLIENTS];
+	nfds_t nfds;
+	struct sigaction sa;
+	int uio_number;
+	int map_number;
+	char label[32];
+	int retval = 0;
+
+	static const struct option long_options[] = {
+		{ "wait", required_argument, NULL, OPT_WAIT },
+		{ "stats", optional_argument, NULL, OPT_STATS },
+		{ NULL, 0, NULL, 0 }
+	};
+	int opt;
+	while ((opt = getopt_long(argc, argv, "hs:", long_options, NULL)) != -1) {
+		switch (opt) {
+			case 'h':
+				print_usage();
+				return 0;
+			case 's':
+				sock_path = optarg;
+				break;
+			case OPT_WAIT:
+				if (bram_lock_parse_wait(&lock_wait_ms, optarg)) {
+					return 1;
+				}
+				break;
+			case OPT_STATS:
+				if (bram_perf_parse_format(&stats_format, optarg)) {
+					return 1;
+				}
+				break;
+			case '?':
+				if (optopt == 's') {
+					fprintf(stderr, "Error: No socket path specified\n");
+				} else if (isprint(optopt)) {
+					fprintf(stderr, "Unknown option `-%c'.\n", optopt);
+				} else {
+					fprintf(stderr, "Unknown option character `\\x%x'.\n", optopt);
+				}
+				return 1;
+			default:
+				print_usage();
+				return 1;
+		}
+	}
+	if ((argc - optind) % 2) {
+		fprintf(stderr, "Error: UIO device and map numbers must be given in pairs\n");
+		print_usage();
+		return 1;
+	}
+	if (!sock_path) {
+		sock_path = getenv(BRAMD_SOCKET_ENV);
+	}
+	if (!sock_path || !*sock_path) {
+		sock_path = BRAMD_SOCKET_PATH;
+	}
+
+	/* Opening everything requested up front catches bad arguments early */
+	for (int i = optind; i < argc; i += 2) {
+		if (str_to_index(&uio_number, argv[i])) {
+			fprintf(stderr, "Error: Bad UIO device number\n");
+			retval = 1;
+			goto exit;
+		}
+		if (str_to_index(&map_number, argv[i + 1])) {
+			fprintf(stderr, "Error: Bad map number\n");
+			retval = 1;
+			goto exit;
+		}
+		if (!bramd_get_slot(uio_number, map_number)) {
+			fprintf(stderr, "Error: Could not open UIO device %d map %d\n",
+					uio_number, map_number);
+			retval = 1;
+			goto exit;
+		}
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	listen_sock = bramd_listen(sock_path);
+	if (listen_sock < 0) {
+		retval = 1;
+		goto exit;
+	}
+	fprintf(stderr, "Listening on %s\n", sock_path);
+
+	fds[0].fd = listen_sock;
+	fds[0].events = POLLIN;
+	nfds = 1;
+	while (running) {
+		if (poll(fds, nfds, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			fprintf(stderr, "Error: %s\n", strerror(errno));
+			retval = 1;
+			break;
+		}
+		/* Service existing clients first, dropping any that go away */
+		for (nfds_t i = 1; i < nfds; i++) {
+			if (!fds[i].revents) {
+				continue;
+			}
+			if ((fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) &&
+					!(fds[i].revents & POLLIN)) {
+				close(fds[i].fd);
+				fds[i--] = fds[--nfds];
+				continue;
+			}
+			if (bramd_serve(fds[i].fd)) {
+				close(fds[i].fd);
+				fds[i--] = fds[--nfds];
+			}
+		}
+		if (fds[0].revents & POLLIN) {
+			int client = accept4(listen_sock, NULL, NULL, SOCK_CLOEXEC);
+			if (client < 0) {
+				continue;
+			}
+			if (nfds == (1 + BRAMD_MAX_CLIENTS)) {
+				fprintf(stderr, "Error: Too many clients\n");
+				close(client);
+				continue;
+			}
+			fds[nfds].fd = client;
+			fds[nfds].events = POLLIN;
+			fds[nfds].revents = 0;
+			nfds++;
+		}
+	}
+
+	for (nfds_t i = 1; i < nfds; i++) {
+		close(fds[i].fd);
+	}
+	close(listen_sock);
+	unlink(sock_path);
+
+exit:
+	for (int i = 0; i < BRAMD_MAX_RESOURCES; i++) {
+		if (!slots[i].in_use) {
+			continue;
+		}
+		snprintf(label, sizeof(label), "bramd uio%d:%d",
+				slots[i].bram.uio_number, slots[i].bram.map_number);
+		if (bram_destroy(&slots[i].bram)) {
+			fprintf(stderr, "Could not destroy block RAM resource\n");
+			retval = 1;
+		}
+		if (stats_format) {
+			bram_perf_print(stderr, label, &slots[i].perf, stats_format);
+		}
+	}
+	return retval;
+}
@@ -0,0 +1,88 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "bramd_proto.h"
+#include "bramd_client.h"
+
+int bramd_connect(const char *path)
+{
+	struct sockaddr_un addr;
+	int sock;
+
+	if (!path) {
+		path = getenv(BRAMD_SOCKET_ENV);
+	}
+	if (!path || !*path) {
+		path = BRAMD_SOCKET_PATH;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Error: Socket path too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (sock < 0) {
+		fprintf(stderr, "Error: %s\n", strerror(errno));
+		return -1;
+	}
+	if (connect(sock, (struct sockaddr *) &addr, sizeof(addr))) {
+		fprintf(stderr, "Error: Could not connect to %s: %s\n", path,
+				strerror(errno));
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+int bramd_call(int sock, const struct bramd_request *req, int fd,
+		struct bramd_response *resp)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		char buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct cmsghdr *cmsg;
+	ssize_t result;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = (void *) req;
+	iov.iov_len = sizeof(*req);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	if (fd >= 0) {
+		memset(&control, 0, sizeof(control));
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	}
+
+	result = sendmsg(sock, &msg, MSG_NOSIGNAL);
+	if (result != sizeof(*req)) {
+		fprintf(stderr, "Error: Could not send request: %s\n", strerror(errno));
+		return -1;
+	}
+	result = recv(sock, resp, sizeof(*resp), 0);
+	if (result != sizeof(*resp)) {
+		fprintf(stderr, "Error: Bad or missing response from bramd\n");
+		return -1;
+	}
+	return 0;
+}
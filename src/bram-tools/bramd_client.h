@@ -0,0 +1,20 @@
+#ifndef BRAMD_CLIENT_H
+#define BRAMD_CLIENT_H
+
+#include "bramd_proto.h"
+
+/*
+ * Connect to a running bramd. A NULL path uses the socket named by the
+ * BRAMD_SOCKET environment variable or the compiled in default.
+ */
+int bramd_connect(const char *path);
+
+/*
+ * Send one request, optionally attaching fd as the bulk payload (pass -1 for
+ * none), and wait for the response. Returns -1 on a transport error - the
+ * outcome of the request itself is in resp->status.
+ */
+int bramd_call(int sock, const struct bramd_request *req, int fd,
+		struct bramd_response *resp);
+
+#endif /* BRAMD_CLIENT_H */
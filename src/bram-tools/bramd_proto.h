@@ -0,0 +1,58 @@
+#ifndef BRAMD_PROTO_H
+#define BRAMD_PROTO_H
+
+#include <stdint.h>
+
+/*
+ * Wire protocol spoken between bramd and its clients over a Unix domain
+ * SOCK_SEQPACKET socket. Every request is a single fixed size message and is
+ * answered by exactly one fixed size response. Bulk payloads never travel
+ * over the socket itself - the client attaches a file descriptor to the
+ * request with SCM_RIGHTS and the daemon maps it and copies to or from the
+ * block RAM directly. Both ends always live on the same machine, so the
+ * structures are sent in native byte order.
+ */
+
+/* Where the daemon listens unless told otherwise */
+#define BRAMD_SOCKET_PATH		"/var/run/bramd.sock"
+#define BRAMD_SOCKET_ENV		"BRAMD_SOCKET"
+
+#define BRAMD_MAX_NAME_SIZE		64
+
+enum bramd_op {
+	/* Describe the map - no payload */
+	BRAMD_OP_INFO = 1,
+	/* Single access of `width` bytes at `offset` */
+	BRAMD_OP_PEEK,
+	BRAMD_OP_POKE,
+	/* Fill `length` bytes at `offset` with the low byte of `value` */
+	BRAMD_OP_FILL,
+	/* Copy `length` bytes from the attached descriptor to `offset` */
+	BRAMD_OP_LOAD,
+	/* Copy `length` bytes from `offset` into the attached descriptor */
+	BRAMD_OP_DUMP,
+};
+
+struct bramd_request {
+	uint32_t op;
+	int32_t uio_number;
+	int32_t map_number;
+	uint32_t width;
+	uint64_t offset;
+	uint64_t length;
+	uint64_t value;
+};
+
+struct bramd_response {
+	/* Zero on success or a negated errno value */
+	int32_t status;
+	uint32_t reserved;
+	/* Value read by a peek or number of bytes moved by a bulk operation */
+	uint64_t value;
+	/* Only filled in by BRAMD_OP_INFO */
+	uint64_t map_addr;
+	uint64_t map_size;
+	char map_name[BRAMD_MAX_NAME_SIZE];
+};
+
+#endif /* BRAMD_PROTO_H */